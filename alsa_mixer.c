@@ -1,14 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <alsa/asoundlib.h>
 #include <glib.h>
-#include <math.h>
 
 #include "mixer.h"
 #include "alsa_mixer.h"
 
 #define ALSAMIXER(x) ((alsa_mixer_t *)x->priv)
 static mixer_ops_t *get_mixer_ops(void);
+static void alsa_mixer_detach(mixer_t *mixer);
+#ifdef ALSA_CTL
+#define ALSACTL(x) ((alsa_ctl_t *)x->priv)
+static mixer_ops_t *get_ctl_ops(void);
+static void alsa_ctl_handle_events(mixer_t *mixer, unsigned short revents);
+#endif
 
 enum {
   CTL_PLAYBACK = 0,
@@ -27,6 +34,12 @@ error(const char *fmt, ...) {
   va_end(va);
 }
 
+/* dirty flags per device */
+enum {
+  DIRTY_VALUE = 1 << 0,  /* cached volume is stale */
+  DIRTY_NOTIFY = 1 << 1  /* change not reported to the frontend yet */
+};
+
 static int
 mixer_event(snd_mixer_t * m, unsigned int mask, snd_mixer_elem_t * elem) {
   mixer_t *mixer = (mixer_t *) snd_mixer_get_callback_private(m);
@@ -35,35 +48,318 @@ mixer_event(snd_mixer_t * m, unsigned int mask, snd_mixer_elem_t * elem) {
   return 0;
 }
 
-static mixer_t *
-alsa_mixer_open(char *card) {
-  mixer_t *result;
-  alsa_mixer_t *alsaresult;
-  int err;
-  snd_mixer_t *handle;
-  snd_mixer_selem_id_t *sid;
+static int
+elem_event(snd_mixer_elem_t *elem, unsigned int mask) {
+  mixer_t *mixer = (mixer_t *) snd_mixer_elem_get_callback_private(elem);
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+  int i;
+
+  if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+    alsamixer->changed_state = 1;
+    return 0;
+  }
+  if (mask & (SND_CTL_EVENT_MASK_VALUE | SND_CTL_EVENT_MASK_INFO)) {
+    /* an element can back a playback, capture and switch device */
+    for (i = 0; i < mixer->nrdevices; i++)
+      if (alsamixer->elems[i] == elem)
+        alsamixer->dirty[i] |= DIRTY_VALUE | DIRTY_NOTIFY;
+  }
+  return 0;
+}
+
+/* looks up the elements of all devices and hooks up their callbacks */
+static void
+alsa_mixer_bind(mixer_t *mixer) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
   snd_mixer_elem_t *elem;
+  int i;
 
-  snd_ctl_card_info_t *hw_info;
-  snd_ctl_t *ctl_handle;
+  for (i = 0; i < mixer->nrdevices; i++) {
+    elem = snd_mixer_find_selem(alsamixer->handle, alsamixer->sids[i]);
+    alsamixer->elems[i] = elem;
+    alsamixer->dirty[i] |= DIRTY_VALUE;
+    if (elem == NULL)
+      continue;
+    snd_mixer_elem_set_callback(elem, elem_event);
+    snd_mixer_elem_set_callback_private(elem, mixer);
+  }
+}
 
-  int count, i;
+/* All open cards share one event source in the io thread, so the descriptors
+ * of every card are polled in a single poll set and events get handled as
+ * soon as they come in. Cards of the ctl engine poll their hctl, the others
+ * their simple mixer */
+G_LOCK_DEFINE_STATIC(alsa_mixers);
+static GSList *alsa_mixers = NULL;
+static GSource *alsa_source = NULL;
+static GPollFD *alsa_gpfds = NULL;
+static struct pollfd *alsa_pfds = NULL;
+static int alsa_npfds = 0;
 
-  snd_mixer_selem_id_alloca(&sid);
-  snd_ctl_card_info_alloca(&hw_info);
+static alsa_poll_t *
+alsa_poll(mixer_t *mixer) {
+#ifdef ALSA_CTL
+  if (mixer->ops == get_ctl_ops())
+    return &ALSACTL(mixer)->poll;
+#endif
+  return &ALSAMIXER(mixer)->poll;
+}
 
-  if ((err = snd_ctl_open(&ctl_handle, card, 0)) < 0) {
-    error("Control info %s error: %s", card, snd_strerror(err));
-//    snd_ctl_close(ctl_handle);
-    return NULL;
+static int
+alsa_poll_descriptors_count(mixer_t *mixer) {
+#ifdef ALSA_CTL
+  if (mixer->ops == get_ctl_ops())
+    return snd_hctl_poll_descriptors_count(ALSACTL(mixer)->hctl);
+#endif
+  return snd_mixer_poll_descriptors_count(ALSAMIXER(mixer)->handle);
+}
+
+static int
+alsa_poll_descriptors(mixer_t *mixer, struct pollfd *pfds,
+                      unsigned int space) {
+#ifdef ALSA_CTL
+  if (mixer->ops == get_ctl_ops())
+    return snd_hctl_poll_descriptors(ALSACTL(mixer)->hctl, pfds, space);
+#endif
+  return snd_mixer_poll_descriptors(ALSAMIXER(mixer)->handle, pfds, space);
+}
+
+static void
+alsa_poll_revents(mixer_t *mixer, struct pollfd *pfds, unsigned int nfds,
+                  unsigned short *revents) {
+#ifdef ALSA_CTL
+  if (mixer->ops == get_ctl_ops()) {
+    snd_hctl_poll_descriptors_revents(ALSACTL(mixer)->hctl, pfds, nfds,
+                                      revents);
+    return;
+  }
+#endif
+  snd_mixer_poll_descriptors_revents(ALSAMIXER(mixer)->handle, pfds, nfds,
+                                     revents);
+}
+
+/* must be called with the alsa_mixers lock held */
+static void
+alsa_source_rebuild(void) {
+  GSList *l;
+  alsa_poll_t *ap;
+  int i, count, n = 0;
+
+  for (i = 0; i < alsa_npfds; i++)
+    g_source_remove_poll(alsa_source, &alsa_gpfds[i]);
+
+  for (l = alsa_mixers; l != NULL; l = l->next)
+    if ((count = alsa_poll_descriptors_count((mixer_t *) l->data)) > 0)
+      n += count;
+
+  alsa_gpfds = g_renew(GPollFD, alsa_gpfds, n);
+  alsa_pfds = g_renew(struct pollfd, alsa_pfds, n);
+
+  i = 0;
+  for (l = alsa_mixers; l != NULL; l = l->next) {
+    ap = alsa_poll((mixer_t *) l->data);
+    ap->pfd_first = i;
+    ap->pfd_count =
+      alsa_poll_descriptors((mixer_t *) l->data, alsa_pfds + i, n - i);
+    if (ap->pfd_count < 0)
+      ap->pfd_count = 0;
+    i += ap->pfd_count;
   }
+  alsa_npfds = i;
 
-  if ((err = snd_ctl_card_info(ctl_handle, hw_info)) < 0) {
-    error("Control info %s error: %s", card, snd_strerror(err));
-    snd_ctl_close(ctl_handle);
-    return NULL;
+  for (i = 0; i < alsa_npfds; i++) {
+    alsa_gpfds[i].fd = alsa_pfds[i].fd;
+    alsa_gpfds[i].events = alsa_pfds[i].events;
+    alsa_gpfds[i].revents = 0;
+    g_source_add_poll(alsa_source, &alsa_gpfds[i]);
   }
-  snd_ctl_close(ctl_handle);
+}
+
+static gboolean
+alsa_source_prepare(GSource *source, gint *timeout) {
+  *timeout = -1;
+  return FALSE;
+}
+
+static gboolean
+alsa_source_check(GSource *source) {
+  int i;
+
+  for (i = 0; i < alsa_npfds; i++)
+    if (alsa_gpfds[i].revents)
+      return TRUE;
+  return FALSE;
+}
+
+/* takes the next mixer with events off the list. Handling events can detach
+ * a mixer and change the list, so it's searched again for every one */
+static mixer_t *
+alsa_next_events(unsigned short *revents) {
+  GSList *l;
+  alsa_poll_t *ap;
+  mixer_t *result = NULL;
+
+  G_LOCK(alsa_mixers);
+  for (l = alsa_mixers; l != NULL; l = l->next) {
+    ap = alsa_poll((mixer_t *) l->data);
+    if (ap->revents) {
+      result = (mixer_t *) l->data;
+      *revents = ap->revents;
+      ap->revents = 0;
+      break;
+    }
+  }
+  G_UNLOCK(alsa_mixers);
+  return result;
+}
+
+static gboolean
+alsa_source_dispatch(GSource *source, GSourceFunc callback, gpointer data) {
+  GSList *l;
+  mixer_t *mixer;
+  alsa_mixer_t *alsamixer;
+  alsa_poll_t *ap;
+  unsigned short revents;
+  int i, err;
+
+  G_LOCK(alsa_mixers);
+  for (l = alsa_mixers; l != NULL; l = l->next) {
+    ap = alsa_poll((mixer_t *) l->data);
+    for (i = ap->pfd_first; i < ap->pfd_first + ap->pfd_count; i++) {
+      alsa_pfds[i].revents = alsa_gpfds[i].revents;
+      alsa_gpfds[i].revents = 0;
+    }
+    revents = 0;
+    alsa_poll_revents((mixer_t *) l->data, alsa_pfds + ap->pfd_first,
+                      ap->pfd_count, &revents);
+    ap->revents = revents & (POLLIN | POLLERR | POLLHUP);
+  }
+  G_UNLOCK(alsa_mixers);
+
+  /* mixers are only closed from the io thread, so these stay valid */
+  while ((mixer = alsa_next_events(&revents)) != NULL) {
+#ifdef ALSA_CTL
+    if (mixer->ops == get_ctl_ops()) {
+      alsa_ctl_handle_events(mixer, revents);
+      continue;
+    }
+#endif
+    alsamixer = ALSAMIXER(mixer);
+    if ((err = snd_mixer_handle_events(alsamixer->handle)) < 0) {
+      /* its descriptors would fire again right away, the next read
+       * attaches the card again */
+      if (err == -ENODEV)
+        error("Mixer %s (%s) is gone", mixer->name, alsamixer->card_id);
+      else
+        error("Mixer %s event error: %s", mixer->name, snd_strerror(err));
+      alsa_mixer_detach(mixer);
+      mixer_failed(mixer);
+      continue;
+    }
+    for (i = 0; i < mixer->nrdevices; i++) {
+      if (alsamixer->dirty[i] & DIRTY_NOTIFY) {
+        alsamixer->dirty[i] &= ~DIRTY_NOTIFY;
+        mixer_notify(mixer, i);
+      }
+    }
+  }
+  return TRUE;
+}
+
+static GSourceFuncs alsa_source_funcs = {
+  alsa_source_prepare,
+  alsa_source_check,
+  alsa_source_dispatch,
+  NULL
+};
+
+static void
+alsa_source_add_mixer(mixer_t *mixer) {
+  G_LOCK(alsa_mixers);
+  if (alsa_source == NULL) {
+    alsa_source = g_source_new(&alsa_source_funcs, sizeof(GSource));
+    g_source_attach(alsa_source, mixer_get_context());
+  }
+  alsa_mixers = g_slist_prepend(alsa_mixers, mixer);
+  alsa_source_rebuild();
+  G_UNLOCK(alsa_mixers);
+}
+
+static void
+alsa_source_remove_mixer(mixer_t *mixer) {
+  G_LOCK(alsa_mixers);
+  alsa_mixers = g_slist_remove(alsa_mixers, mixer);
+  alsa_source_rebuild();
+  if (alsa_mixers == NULL) {
+    g_source_destroy(alsa_source);
+    g_source_unref(alsa_source);
+    alsa_source = NULL;
+  }
+  G_UNLOCK(alsa_mixers);
+}
+
+/* The card was unplugged. The handle is closed, the devices stay as they
+ * are until the card with the same id comes back */
+static void
+alsa_mixer_detach(mixer_t *mixer) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+  int i;
+
+  if (alsamixer->handle == NULL)
+    return;
+  alsa_source_remove_mixer(mixer);
+  snd_mixer_close(alsamixer->handle);
+  alsamixer->handle = NULL;
+  alsamixer->changed_state = 0;
+  for (i = 0; i < mixer->nrdevices; i++)
+    alsamixer->elems[i] = NULL;
+}
+
+/* The simple element class of alsa-lib creates a simple element for every
+ * ctl element that gets added, reading its info and value. A mixer that is
+ * sparse lets only the elements of its wanted devices through, a ctl
+ * element "Master Playback Volume" belongs to the device "Master" */
+static snd_mixer_event_t selem_event = NULL;
+
+static gboolean
+alsa_mixer_wants(mixer_t *mixer, const char *name) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+  const char *dev;
+  size_t len;
+  int i;
+
+  if (!alsamixer->sparse)
+    return TRUE;
+  for (i = 0; i < mixer->nrdevices; i++) {
+    if (!alsamixer->wanted[i])
+      continue;
+    dev = snd_mixer_selem_id_get_name(alsamixer->sids[i]);
+    len = strlen(dev);
+    if (!strncmp(name, dev, len) && (name[len] == '\0' || name[len] == ' '))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static int
+alsa_filter_event(snd_mixer_class_t *class, unsigned int mask,
+                  snd_hctl_elem_t *helem, snd_mixer_elem_t *melem) {
+  mixer_t *mixer = (mixer_t *)
+    snd_mixer_get_callback_private(snd_mixer_class_get_mixer(class));
+
+  if (mask != SND_CTL_EVENT_MASK_REMOVE && (mask & SND_CTL_EVENT_MASK_ADD) &&
+      mixer != NULL && !alsa_mixer_wants(mixer, snd_hctl_elem_get_name(helem)))
+    return 0;
+  return selem_event(class, mask, helem, melem);
+}
+
+/* opens and loads the simple mixer of a card, only the wanted elements if
+ * mixer is sparse */
+static snd_mixer_t *
+alsa_mixer_load(const char *card, mixer_t *mixer) {
+  snd_mixer_t *handle;
+  snd_mixer_class_t *class;
+  int err;
 
   if ((err = snd_mixer_open(&handle, 0)) < 0) {
     error("Mixer %s open error: %s", card, snd_strerror(err));
@@ -74,111 +370,463 @@ alsa_mixer_open(char *card) {
     snd_mixer_close(handle);
     return NULL;
   }
-  if ((err = snd_mixer_selem_register(handle, NULL, NULL)) < 0) {
+  snd_mixer_set_callback_private(handle, mixer);
+  if ((err = snd_mixer_selem_register(handle, NULL, &class)) < 0) {
     error("Mixer register error: %s", snd_strerror(err));
     snd_mixer_close(handle);
     return NULL;
   }
+  if (selem_event == NULL)
+    selem_event = snd_mixer_class_get_event(class);
+  snd_mixer_class_set_event(class, alsa_filter_event);
   err = snd_mixer_load(handle);
   if (err < 0) {
     error("Mixer %s load error: %s", card, snd_strerror(err));
     snd_mixer_close(handle);
     return NULL;
   }
+  return handle;
+}
+
+/* "hw:<index>" of the card with this id, or NULL if it isn't there */
+static char *
+alsa_find_card(const char *card_id) {
+  snd_ctl_card_info_t *info;
+  snd_ctl_t *ctl;
+  char name[32];
+  char *result = NULL;
+  int index = -1;
+
+  snd_ctl_card_info_alloca(&info);
+  while (result == NULL && snd_card_next(&index) == 0 && index >= 0) {
+    snprintf(name, sizeof(name), "hw:%d", index);
+    if (snd_ctl_open(&ctl, name, 0) < 0)
+      continue;
+    if (snd_ctl_card_info(ctl, info) == 0 &&
+        !strcmp(snd_ctl_card_info_get_id(info), card_id))
+      result = g_strdup(name);
+    snd_ctl_close(ctl);
+  }
+  return result;
+}
+
+static gboolean
+alsa_reattached(gpointer data) {
+  mixer_t *mixer = (mixer_t *) data;
+  int i;
+
+  ALSAMIXER(mixer)->reattach_id = 0;
+  for (i = 0; i < mixer->nrdevices; i++)
+    mixer_notify(mixer, i);
+  return FALSE;
+}
+
+/* Tries to get a detached mixer back. The card may have come back under
+ * another index, only the element table is rebuilt. Called while detached
+ * on every read, which the io thread backs off from while the mixer is
+ * offline */
+static gboolean
+alsa_mixer_reattach(mixer_t *mixer) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+  snd_mixer_t *handle;
+  GSource *idle;
+  char *card;
+  int i;
+
+  if ((card = alsa_find_card(alsamixer->card_id)) == NULL)
+    return FALSE;
+  handle = alsa_mixer_load(card, mixer);
+  g_free(card);
+  if (handle == NULL)
+    return FALSE;
+
+  alsamixer->handle = handle;
+  snd_mixer_set_callback(handle, mixer_event);
+  snd_mixer_set_callback_private(handle, mixer);
+  alsa_mixer_bind(mixer);
+  alsa_source_add_mixer(mixer);
+  for (i = 0; i < mixer->nrdevices; i++)
+    alsamixer->dirty[i] |= DIRTY_VALUE;
+
+  /* the volumes might have been reset, report them once this call is done */
+  if (alsamixer->reattach_id == 0) {
+    idle = g_idle_source_new();
+    g_source_set_callback(idle, alsa_reattached, mixer, NULL);
+    alsamixer->reattach_id = g_source_attach(idle, mixer_get_context());
+    g_source_unref(idle);
+  }
+  return TRUE;
+}
+
+/* The channels of an element, in the order they are described. Mono
+ * elements only have SND_MIXER_SCHN_MONO */
+static int
+alsa_elem_channels(snd_mixer_elem_t *elem, int capture,
+                   snd_mixer_selem_channel_id_t *chn) {
+  int c, n = 0;
+
+  if (capture ? snd_mixer_selem_is_capture_mono(elem)
+              : snd_mixer_selem_is_playback_mono(elem)) {
+    chn[0] = SND_MIXER_SCHN_MONO;
+    return 1;
+  }
+  for (c = 0; c <= SND_MIXER_SCHN_LAST && n < MIXER_MAX_CHANNELS; c++)
+    if (capture ? snd_mixer_selem_has_capture_channel(elem, c)
+                : snd_mixer_selem_has_playback_channel(elem, c))
+      chn[n++] = c;
+  return n;
+}
+
+/* where a channel of an element sits, as MIXER_CH_* */
+static int
+alsa_channel_position(snd_mixer_selem_channel_id_t chn, int n) {
+  /* SND_MIXER_SCHN_MONO is the front left channel */
+  if (n == 1)
+    return MIXER_CH_MONO;
+  return chn >= 0 && chn < MIXER_CH_LAST - 1 ? chn + 1 : MIXER_CH_MONO;
+}
+
+/* channels, range and dB scale of an element as a device of type */
+static void
+alsa_elem_describe(snd_mixer_elem_t *elem, int type, mixer_device_t *desc) {
+  snd_mixer_selem_channel_id_t chn[MIXER_MAX_CHANNELS];
+  long min, max;
+  int i, err = -1;
+
+  desc->channels = alsa_elem_channels(elem, type == CTL_CAPTURE, chn);
+  for (i = 0; i < desc->channels; i++)
+    desc->position[i] = alsa_channel_position(chn[i], desc->channels);
+  switch (type) {
+    case CTL_PLAYBACK:
+      snd_mixer_selem_get_playback_volume_range(elem, &desc->min, &desc->max);
+      err = snd_mixer_selem_get_playback_dB_range(elem, &min, &max);
+      break;
+    case CTL_CAPTURE:
+      snd_mixer_selem_get_capture_volume_range(elem, &desc->min, &desc->max);
+      err = snd_mixer_selem_get_capture_dB_range(elem, &min, &max);
+      break;
+  }
+  if (err >= 0)
+    desc->flags |= MIXER_DEVICE_DB;
+}
 
-  count = 0;
+/* a device as found on the card or in the device cache */
+typedef struct {
+  int type;
+  unsigned int index;
+  /* channels, positions, range and MIXER_DEVICE_DB */
+  mixer_device_t desc;
+  char *realname, *name;
+} alsa_device_t;
+
+static void
+alsa_device_add(GArray *devices, int type, snd_mixer_elem_t *elem,
+                char *name) {
+  alsa_device_t dev;
+
+  memset(&dev, 0, sizeof(dev));
+  dev.type = type;
+  dev.index = snd_mixer_selem_get_index(elem);
+  alsa_elem_describe(elem, type, &dev.desc);
+  dev.realname = g_strdup(snd_mixer_selem_get_name(elem));
+  dev.name = name;
+  g_array_append_val(devices, dev);
+}
+
+/* all devices of a loaded card, in one pass */
+static GArray *
+alsa_scan_devices(snd_mixer_t *handle) {
+  GArray *result = g_array_new(FALSE, FALSE, sizeof(alsa_device_t));
+  snd_mixer_elem_t *elem;
+  const char *name;
+  int playback, capture;
 
   for (elem = snd_mixer_first_elem(handle); elem;
        elem = snd_mixer_elem_next(elem)) {
     if (!snd_mixer_selem_is_active(elem))
       continue;
-    if (snd_mixer_selem_has_playback_volume(elem)) {
-      count++;
+    name = snd_mixer_selem_get_name(elem);
+    playback = snd_mixer_selem_has_playback_volume(elem);
+    capture = snd_mixer_selem_has_capture_volume(elem);
+    if (playback)
+      alsa_device_add(result, CTL_PLAYBACK, elem,
+          g_strdup_printf("%s %s", name, capture ? "playback" : ""));
+    if (capture)
+      alsa_device_add(result, CTL_CAPTURE, elem,
+          g_strdup_printf("%s %s", name, playback ? "capture" : ""));
+    if (snd_mixer_selem_has_playback_switch(elem))
+      alsa_device_add(result, CTL_PLAYBACK_SWITCH, elem, g_strdup(name));
+  }
+  return result;
+}
+
+/* Finding the devices means loading every element of the card, which takes
+ * long on cards with hundreds of controls. So the devices of a card are
+ * cached in a file, and used as long as the card looks the same (mixer
+ * name and number of controls). With the devices known, only the elements
+ * of wanted devices are loaded */
+#define ALSA_CACHE_VERSION 2
+
+static gchar *
+alsa_cache_path(const char *card_id) {
+  gchar *file = g_strconcat("alsa-", card_id, NULL);
+  gchar *path = g_build_filename(g_get_user_cache_dir(), "gkrellm-volume",
+                                 file, NULL);
+
+  g_free(file);
+  return path;
+}
+
+/* "<pos>,<pos>,..." of a cache line */
+static int
+alsa_cache_positions(const char *s, unsigned char *position) {
+  char *end;
+  int n = 0;
+
+  while (n < MIXER_MAX_CHANNELS) {
+    position[n] = CLAMP(strtol(s, &end, 10), 0, MIXER_CH_LAST - 1);
+    if (end == s)
+      break;
+    n++;
+    if (*end != ',')
+      break;
+    s = end + 1;
+  }
+  return n;
+}
+
+static GArray *
+alsa_cache_read(const char *card_id, const char *signature) {
+  gchar *path = alsa_cache_path(card_id);
+  gchar *contents = NULL, **lines, **fields;
+  GArray *result = NULL;
+  alsa_device_t dev;
+  int i;
+
+  if (g_file_get_contents(path, &contents, NULL, NULL)) {
+    lines = g_strsplit(contents, "\n", 0);
+    if (lines[0] != NULL && !strcmp(lines[0], signature)) {
+      result = g_array_new(FALSE, FALSE, sizeof(alsa_device_t));
+      for (i = 1; lines[i] != NULL && lines[i][0] != '\0'; i++) {
+        fields = g_strsplit(lines[i], "\t", 8);
+        if (g_strv_length(fields) == 8) {
+          memset(&dev, 0, sizeof(dev));
+          dev.type = atoi(fields[0]);
+          dev.index = atoi(fields[1]);
+          dev.desc.channels = alsa_cache_positions(fields[2],
+                                                   dev.desc.position);
+          dev.desc.min = atol(fields[3]);
+          dev.desc.max = atol(fields[4]);
+          dev.desc.flags = atoi(fields[5]);
+          dev.realname = g_strdup(fields[6]);
+          dev.name = g_strdup(fields[7]);
+          g_array_append_val(result, dev);
+        }
+        g_strfreev(fields);
+      }
     }
-    if (snd_mixer_selem_has_playback_switch(elem)) {
-      count++;
+    g_strfreev(lines);
+  }
+  g_free(contents);
+  g_free(path);
+  return result;
+}
+
+static void
+alsa_cache_write(const char *card_id, const char *signature,
+                 GArray *devices) {
+  GString *contents = g_string_new(signature);
+  gchar *path = alsa_cache_path(card_id);
+  gchar *dir = g_path_get_dirname(path);
+  alsa_device_t *dev;
+  guint i;
+  int c;
+
+  g_string_append_c(contents, '\n');
+  for (i = 0; i < devices->len; i++) {
+    dev = &g_array_index(devices, alsa_device_t, i);
+    g_string_append_printf(contents, "%d\t%u\t", dev->type, dev->index);
+    for (c = 0; c < dev->desc.channels; c++)
+      g_string_append_printf(contents, c > 0 ? ",%d" : "%d",
+                             dev->desc.position[c]);
+    g_string_append_printf(contents, "\t%ld\t%ld\t%d\t%s\t%s\n",
+                           dev->desc.min, dev->desc.max, dev->desc.flags,
+                           dev->realname, dev->name);
+  }
+  if (g_mkdir_with_parents(dir, 0700) == 0)
+    g_file_set_contents(path, contents->str, contents->len, NULL);
+  g_free(dir);
+  g_free(path);
+  g_string_free(contents, TRUE);
+}
+
+#ifdef ALSA_CTL
+static mixer_t *alsa_ctl_open(const char *card, snd_ctl_card_info_t *hw_info,
+                              GArray *devices);
+#endif
+
+static void
+alsa_mixer_free(mixer_t *mixer) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+  int i;
+
+  g_free(alsamixer->card_id);
+  for (i = 0; i < mixer->nrdevices; i++) {
+    g_free(mixer->dev_names[i]);
+    g_free(mixer->dev_realnames[i]);
+    snd_mixer_selem_id_free(alsamixer->sids[i]);
+  }
+  free(mixer->dev_names);
+  free(mixer->dev_realnames);
+  free(alsamixer->ctltype);
+  free(alsamixer->elems);
+  free(alsamixer->dirty);
+  free(alsamixer->wanted);
+  free(alsamixer->volumes);
+  free(alsamixer->descs);
+  free(alsamixer->sids);
+  free(mixer->priv);
+  free(mixer);
+}
+
+static mixer_t *
+alsa_mixer_open(char *card) {
+  mixer_t *result;
+  alsa_mixer_t *alsaresult;
+  int err;
+  snd_mixer_t *handle = NULL;
+  GArray *devices;
+  alsa_device_t *dev;
+  gchar *signature;
+
+  snd_ctl_card_info_t *hw_info;
+  snd_ctl_elem_list_t *elem_list;
+  snd_ctl_t *ctl_handle;
+
+  int count, i;
+
+  snd_ctl_card_info_alloca(&hw_info);
+  snd_ctl_elem_list_alloca(&elem_list);
+
+  if ((err = snd_ctl_open(&ctl_handle, card, 0)) < 0) {
+    error("Control info %s error: %s", card, snd_strerror(err));
+//    snd_ctl_close(ctl_handle);
+    return NULL;
+  }
+
+  if ((err = snd_ctl_card_info(ctl_handle, hw_info)) < 0 ||
+      (err = snd_ctl_elem_list(ctl_handle, elem_list)) < 0) {
+    error("Control info %s error: %s", card, snd_strerror(err));
+    snd_ctl_close(ctl_handle);
+    return NULL;
+  }
+  snd_ctl_close(ctl_handle);
+
+  /* the version of the cache format goes first, older files are rescanned */
+  signature = g_strdup_printf("%d\t%s\t%u", ALSA_CACHE_VERSION,
+                              snd_ctl_card_info_get_mixername(hw_info),
+                              snd_ctl_elem_list_get_count(elem_list));
+  devices = alsa_cache_read(snd_ctl_card_info_get_id(hw_info), signature);
+  if (devices == NULL) {
+    if ((handle = alsa_mixer_load(card, NULL)) == NULL) {
+      g_free(signature);
+      return NULL;
     }
-    if (snd_mixer_selem_has_capture_volume(elem)) {
-      count++;
+    devices = alsa_scan_devices(handle);
+    alsa_cache_write(snd_ctl_card_info_get_id(hw_info), signature, devices);
+  }
+  g_free(signature);
+  count = devices->len;
+
+#ifdef ALSA_CTL
+  /* GKRELLM_VOLUME_ALSA_CTL=0 keeps every card on the simple mixer */
+  if (g_strcmp0(g_getenv("GKRELLM_VOLUME_ALSA_CTL"), "0") &&
+      (result = alsa_ctl_open(card, hw_info, devices)) != NULL) {
+    for (i = 0; i < count; i++) {
+      g_free(g_array_index(devices, alsa_device_t, i).realname);
+      g_free(g_array_index(devices, alsa_device_t, i).name);
     }
+    g_array_free(devices, TRUE);
+    if (handle != NULL)
+      snd_mixer_close(handle);
+    return result;
   }
+#endif
 
-  result = (mixer_t *) malloc(sizeof(mixer_t));
-  alsaresult = (alsa_mixer_t *)malloc(sizeof(mixer_t));
+  result = (mixer_t *) calloc(1, sizeof(mixer_t));
+  alsaresult = (alsa_mixer_t *) calloc(1, sizeof(alsa_mixer_t));
 
   result->priv = (void *)alsaresult;
   result->ops = get_mixer_ops();
+  result->notifies = 1;
 
   result->name = g_strdup_printf("%s", snd_ctl_card_info_get_name(hw_info));
   result->nrdevices = count;
   result->dev_names = (char **) malloc(sizeof(char *) * count);
   result->dev_realnames = (char **) malloc(sizeof(char *) * count);
 
-  alsaresult->handle = handle;
+  /* from the cache nothing is loaded until it's wanted */
+  alsaresult->sparse = handle == NULL;
+  alsaresult->card_id = g_strdup(snd_ctl_card_info_get_id(hw_info));
   alsaresult->sids =
     (snd_mixer_selem_id_t **) malloc(sizeof(snd_mixer_selem_id_t *) * count);
   alsaresult->ctltype = (int *) malloc(sizeof(int) * count);
+  alsaresult->elems =
+    (snd_mixer_elem_t **) calloc(count, sizeof(snd_mixer_elem_t *));
+  alsaresult->dirty = (int *) calloc(count, sizeof(int));
+  alsaresult->wanted = (int *) calloc(count, sizeof(int));
+  alsaresult->volumes =
+    (int *) calloc(count * MIXER_MAX_CHANNELS, sizeof(int));
+  alsaresult->descs = (mixer_device_t *) calloc(count, sizeof(mixer_device_t));
 
-
-  for (elem = snd_mixer_first_elem(handle), i = 0; elem;
-       elem = snd_mixer_elem_next(elem)) {
-    snd_mixer_selem_get_id(elem, sid);
-    if (!snd_mixer_selem_is_active(elem))
-      continue;
-
-    if (snd_mixer_selem_has_playback_volume(elem)) {
-      result->dev_realnames[i] = strdup(snd_mixer_selem_id_get_name(sid));
-      result->dev_names[i] =
-        g_strdup_printf("%s %s", snd_mixer_selem_id_get_name(sid),
-            snd_mixer_selem_has_capture_volume(elem) ? "playback" : "");
-      alsaresult->ctltype[i] = CTL_PLAYBACK;
-      snd_mixer_selem_id_malloc(&alsaresult->sids[i]);
-      snd_mixer_selem_get_id(elem, alsaresult->sids[i]);
-      i++;
-    } 
-    if (snd_mixer_selem_has_capture_volume(elem)) {
-      result->dev_realnames[i] = strdup(snd_mixer_selem_id_get_name(sid));
-      result->dev_names[i] =
-        g_strdup_printf("%s %s", snd_mixer_selem_id_get_name(sid),
-            snd_mixer_selem_has_playback_volume(elem) ? "capture" : "");
-      alsaresult->ctltype[i] = CTL_CAPTURE;
-      snd_mixer_selem_id_malloc(&alsaresult->sids[i]);
-      snd_mixer_selem_get_id(elem, alsaresult->sids[i]);
-      i++;
-    } 
-    if (snd_mixer_selem_has_playback_switch(elem)) {
-      result->dev_realnames[i] = strdup(snd_mixer_selem_id_get_name(sid));
-      result->dev_names[i] =
-        g_strdup_printf("%s", snd_mixer_selem_id_get_name(sid));
-      alsaresult->ctltype[i] = CTL_PLAYBACK_SWITCH;
-      snd_mixer_selem_id_malloc(&alsaresult->sids[i]);
-      snd_mixer_selem_get_id(elem, alsaresult->sids[i]);
-      i++;
-    }
+  for (i = 0; i < count; i++) {
+    dev = &g_array_index(devices, alsa_device_t, i);
+    result->dev_realnames[i] = dev->realname;
+    result->dev_names[i] = dev->name;
+    alsaresult->ctltype[i] = dev->type;
+    alsaresult->descs[i] = dev->desc;
+    snd_mixer_selem_id_malloc(&alsaresult->sids[i]);
+    snd_mixer_selem_id_set_name(alsaresult->sids[i], dev->realname);
+    snd_mixer_selem_id_set_index(alsaresult->sids[i], dev->index);
   }
+  g_array_free(devices, TRUE);
 
+  if (handle == NULL && (handle = alsa_mixer_load(card, result)) == NULL) {
+    alsa_mixer_free(result);
+    return NULL;
+  }
+  alsaresult->handle = handle;
   snd_mixer_set_callback(handle, mixer_event);
   snd_mixer_set_callback_private(handle, result);
+  alsa_mixer_bind(result);
+  alsa_source_add_mixer(result);
 
   return result;
 }
 
 static void
 alsa_mixer_close(mixer_t * mixer) {
-  int i;
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
 
-  snd_mixer_close(ALSAMIXER(mixer)->handle);
-  for (i = 0; i < mixer->nrdevices; i++) {
-    free(mixer->dev_names[i]);
-    free(mixer->dev_realnames[i]);
-    snd_mixer_selem_id_free(ALSAMIXER(mixer)->sids[i]);
-  }
-  free(mixer->dev_names);
-  free(mixer->dev_realnames);
-  free(ALSAMIXER(mixer)->ctltype);
-  free(ALSAMIXER(mixer)->sids);
-  free(mixer->priv);
-  free(mixer);
+  if (alsamixer->reattach_id != 0)
+    g_source_destroy(g_main_context_find_source_by_id(mixer_get_context(),
+                                                      alsamixer->reattach_id));
+  alsa_mixer_detach(mixer);
+  alsa_mixer_free(mixer);
+}
+
+/* a sparse mixer loads the elements of a device once it's wanted */
+static void
+alsa_mixer_device_want(mixer_t *mixer, int devid) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+
+  if (alsamixer->wanted[devid])
+    return;
+  alsamixer->wanted[devid] = 1;
+  /* reloaded on the next read, which follows right away */
+  if (alsamixer->sparse && alsamixer->elems[devid] == NULL &&
+      alsamixer->handle != NULL)
+    alsamixer->changed_state = 1;
 }
 
 /* get the full scale of a device and get/set the volume */
@@ -190,139 +838,270 @@ alsa_mixer_device_get_fullscale(mixer_t * mixer, int devid) {
   return 100;
 }
 
-/* Fuction to convert from volume to percentage. val = volume */
-
+/* The volume for one channel out of the volumes of other channels: the one
+ * at the same position, or the loudest if there's none there (a mono
+ * element between stereo channels and the other way around) */
 static int
-convert_prange(int val, int min, int max) {
-  int range = max - min;
-  int tmp;
+alsa_channel_volume(int position, const unsigned char *positions,
+                    const int *volumes, int n) {
+  int i, loudest = 0;
 
-  if (range == 0)
-    return 0;
-  val -= min;
-  tmp = rint((double) val / (double) range * 100);
-  return tmp;
+  for (i = 0; i < n; i++)
+    if (positions[i] == position)
+      return volumes[i];
+  for (i = 0; i < n; i++)
+    loudest = MAX(loudest, volumes[i]);
+  return loudest;
 }
 
-/* Function to convert from percentage to volume. val = percentage */
-
-static int
-convert_prange1(int val, int min, int max) {
-  int range = max - min;
-  int tmp;
-
-  if (range == 0)
-    return 0;
+/* from the description found when the devices were scanned or cached, so a
+ * sparse card is described right before its elements are loaded */
+static void
+alsa_mixer_device_describe(mixer_t *mixer, int devid, mixer_device_t *desc) {
+  alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
+  const mixer_device_t *found = &alsamixer->descs[devid];
 
-  tmp = rint((double) range * ((double) val * .01)) + min;
-  return tmp;
+  if (alsamixer->ctltype[devid] == CTL_CAPTURE)
+    desc->flags |= MIXER_DEVICE_CAPTURE;
+  if (found->channels == 0)
+    return;
+  desc->channels = found->channels;
+  memcpy(desc->position, found->position, sizeof(desc->position));
+  if (alsamixer->ctltype[devid] != CTL_PLAYBACK_SWITCH) {
+    desc->min = found->min;
+    desc->max = found->max;
+  }
+  desc->flags |= found->flags & MIXER_DEVICE_DB;
 }
 
-void
-alsa_mixer_device_get_volume(mixer_t * mixer, int devid, 
-                             int *left, int *right) {
-  long min, max, lvol, rvol;
-  int sw;
-  int err;
+/* Every described channel gets the element channel at its position */
+static void
+alsa_mixer_device_get_channels(mixer_t *mixer, int devid, int *volumes) {
+  const mixer_device_t *desc = mixer_get_device(mixer, devid);
+  snd_mixer_selem_channel_id_t chn[MIXER_MAX_CHANNELS];
+  unsigned char pos[MIXER_MAX_CHANNELS];
+  int read[MIXER_MAX_CHANNELS];
+  long min = 0, max = 0, vol;
+  int i, n, sw;
+  int err = 0;
   alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
   snd_mixer_elem_t *elem;
+  int *cached = &alsamixer->volumes[devid * MIXER_MAX_CHANNELS];
 
-  snd_mixer_handle_events(alsamixer->handle);
+  if (alsamixer->handle == NULL && !alsa_mixer_reattach(mixer)) {
+    mixer_failed(mixer);
+    return;
+  }
 
+  /* events are handled by the event source, elements only need to be
+   * reloaded when they were added or removed */
   if (alsamixer->changed_state) {
     snd_mixer_free(alsamixer->handle);
 
     err = snd_mixer_load(alsamixer->handle);
     if (err < 0) {
+      /* most likely the card went away */
       error("Mixer load error: %s", snd_strerror(err));
-      snd_mixer_close(alsamixer->handle);
+      alsa_mixer_detach(mixer);
+      mixer_failed(mixer);
       return;
     }
     alsamixer->changed_state = 0;
+    alsa_mixer_bind(mixer);
+  }
+
+  if (!(alsamixer->dirty[devid] & DIRTY_VALUE)) {
+    memcpy(volumes, cached, sizeof(int) * MIXER_MAX_CHANNELS);
+    return;
   }
 
-  elem = snd_mixer_find_selem(alsamixer->handle, alsamixer->sids[devid]);
+  elem = alsamixer->elems[devid];
+  if (elem == NULL)
+    return;
 
   switch (alsamixer->ctltype[devid]) {
     case CTL_PLAYBACK:
       snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-      snd_mixer_selem_get_playback_volume(elem, 0, &lvol);
-      if (snd_mixer_selem_is_playback_mono(elem))  {
-          rvol = lvol;
-      } else {
-        snd_mixer_selem_get_playback_volume(elem, 1, &rvol);
-      }
       break;
     case CTL_CAPTURE:
       snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
-      snd_mixer_selem_get_capture_volume(elem, 0, &lvol);
-      if (snd_mixer_selem_is_capture_mono(elem))  {
-          rvol = lvol;
-      } else {
-        snd_mixer_selem_get_capture_volume(elem, 1, &rvol);
-      }
-      break;
-    case CTL_PLAYBACK_SWITCH:
-      snd_mixer_selem_get_playback_switch(elem, 0, &sw);
-      *left = sw;
-      *right = sw;
-      return;
-      break;
-    default:
-      g_assert_not_reached();
       break;
   }
+  n = alsa_elem_channels(elem, alsamixer->ctltype[devid] == CTL_CAPTURE, chn);
+  for (i = 0; i < n && err >= 0; i++) {
+    switch (alsamixer->ctltype[devid]) {
+      case CTL_PLAYBACK:
+        err = snd_mixer_selem_get_playback_volume(elem, chn[i], &vol);
+        read[i] = mixer_raw_to_percent(vol, min, max);
+        break;
+      case CTL_CAPTURE:
+        err = snd_mixer_selem_get_capture_volume(elem, chn[i], &vol);
+        read[i] = mixer_raw_to_percent(vol, min, max);
+        break;
+      case CTL_PLAYBACK_SWITCH:
+        err = snd_mixer_selem_get_playback_switch(elem, chn[i], &sw);
+        read[i] = sw;
+        break;
+      default:
+        g_assert_not_reached();
+        break;
+    }
+  }
 
-  *left = convert_prange(lvol, min, max);
-  *right = convert_prange(rvol, min, max);
+  if (err < 0) {
+    error("Mixer %s read error: %s", mixer->name, snd_strerror(err));
+    mixer_failed(mixer);
+    return;
+  }
+  for (i = 0; i < n; i++)
+    pos[i] = alsa_channel_position(chn[i], n);
+  for (i = 0; i < MIXER_MAX_CHANNELS; i++)
+    volumes[i] = i < desc->channels ?
+      alsa_channel_volume(desc->position[i], pos, read, n) : 0;
+  memcpy(cached, volumes, sizeof(int) * MIXER_MAX_CHANNELS);
+  alsamixer->dirty[devid] &= ~DIRTY_VALUE;
 }
 
+void
+alsa_mixer_device_get_volume(mixer_t * mixer, int devid, 
+                             int *left, int *right) {
+  int volumes[MIXER_MAX_CHANNELS];
+
+  memset(volumes, 0, sizeof(volumes));
+  alsa_mixer_device_get_channels(mixer, devid, volumes);
+  mixer_channels_to_stereo(mixer_get_device(mixer, devid), volumes,
+                           left, right);
+}
+
+/* Writes the channels of an element. What the library has cached for the
+ * element decides what actually needs writing: nothing if it already is at
+ * that volume, one write for all channels if they end up equal, otherwise
+ * only the channels that change */
+static int
+alsa_write_volume(snd_mixer_elem_t *elem, int capture,
+                  const snd_mixer_selem_channel_id_t *chn, const long *vol,
+                  int n) {
+  long cur[MIXER_MAX_CHANNELS];
+  int i, same = TRUE, equal = TRUE, err = 0;
+
+  for (i = 0; i < n; i++) {
+    if (capture)
+      snd_mixer_selem_get_capture_volume(elem, chn[i], &cur[i]);
+    else
+      snd_mixer_selem_get_playback_volume(elem, chn[i], &cur[i]);
+    same &= cur[i] == vol[i];
+    equal &= vol[i] == vol[0];
+  }
+  if (same)
+    return 0;
+  if (equal)
+    return capture ? snd_mixer_selem_set_capture_volume_all(elem, vol[0])
+                   : snd_mixer_selem_set_playback_volume_all(elem, vol[0]);
+  for (i = 0; i < n && err >= 0; i++) {
+    if (cur[i] == vol[i])
+      continue;
+    err = capture ? snd_mixer_selem_set_capture_volume(elem, chn[i], vol[i])
+                  : snd_mixer_selem_set_playback_volume(elem, chn[i], vol[i]);
+  }
+  return err;
+}
+
+/* Same for the switches, which only change when a channel goes to or comes
+ * back from 0 */
+static int
+alsa_write_switch(snd_mixer_elem_t *elem, int capture,
+                  const snd_mixer_selem_channel_id_t *chn, const int *on,
+                  int n) {
+  int cur[MIXER_MAX_CHANNELS];
+  int i, same = TRUE, equal = TRUE, err = 0;
+
+  if (capture ? !snd_mixer_selem_has_capture_switch(elem)
+              : !snd_mixer_selem_has_playback_switch(elem))
+    return 0;
+  for (i = 0; i < n; i++) {
+    if (capture)
+      snd_mixer_selem_get_capture_switch(elem, chn[i], &cur[i]);
+    else
+      snd_mixer_selem_get_playback_switch(elem, chn[i], &cur[i]);
+    same &= !cur[i] == !on[i];
+    equal &= !on[i] == !on[0];
+  }
+  if (same)
+    return 0;
+  if (equal)
+    return capture ? snd_mixer_selem_set_capture_switch_all(elem, on[0])
+                   : snd_mixer_selem_set_playback_switch_all(elem, on[0]);
+  for (i = 0; i < n && err >= 0; i++) {
+    if (!cur[i] == !on[i])
+      continue;
+    err = capture ? snd_mixer_selem_set_capture_switch(elem, chn[i], on[i])
+                  : snd_mixer_selem_set_playback_switch(elem, chn[i], on[i]);
+  }
+  return err;
+}
+
+/* Every element channel gets the described channel at its position */
 static void
-alsa_mixer_device_set_volume(mixer_t * mixer, int devid, int left, int right) {
-  long min, max, lvol, rvol;
+alsa_mixer_device_set_channels(mixer_t *mixer, int devid, const int *volumes) {
+  const mixer_device_t *desc = mixer_get_device(mixer, devid);
+  snd_mixer_selem_channel_id_t chn[MIXER_MAX_CHANNELS];
+  long min = 0, max = 0, vol[MIXER_MAX_CHANNELS];
+  int on[MIXER_MAX_CHANNELS];
   alsa_mixer_t *alsamixer = ALSAMIXER(mixer);
   snd_mixer_elem_t *elem;
+  int i, n, capture, err;
+
+  if (alsamixer->handle == NULL && !alsa_mixer_reattach(mixer)) {
+    mixer_failed(mixer);
+    return;
+  }
+  elem = alsamixer->elems[devid];
+  if (elem == NULL)
+    return;
+  /* reread on the next get, the event for this write comes in later */
+  alsamixer->dirty[devid] |= DIRTY_VALUE;
+
+  capture = alsamixer->ctltype[devid] == CTL_CAPTURE;
+  if (capture)
+    snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
+  else if (alsamixer->ctltype[devid] == CTL_PLAYBACK)
+    snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+  n = alsa_elem_channels(elem, capture, chn);
+  for (i = 0; i < n; i++) {
+    on[i] = alsa_channel_volume(alsa_channel_position(chn[i], n),
+                                desc->position, volumes, desc->channels);
+    vol[i] = mixer_percent_to_raw(on[i], min, max);
+  }
 
-  elem = snd_mixer_find_selem(alsamixer->handle, alsamixer->sids[devid]);
-  
   switch (alsamixer->ctltype[devid]) {
     case CTL_PLAYBACK:
-      snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-      lvol = convert_prange1(left, min, max);
-      rvol = convert_prange1(right, min, max);
-      snd_mixer_selem_set_playback_volume(elem, 0, lvol);
-      if (left == 0)
-        snd_mixer_selem_set_playback_switch(elem, 0, 0);
-      else
-        snd_mixer_selem_set_playback_switch(elem, 0, 1);
-      snd_mixer_selem_set_playback_volume(elem, 1, rvol);
-      if (right == 0)
-        snd_mixer_selem_set_playback_switch(elem, 1, 0);
-      else
-        snd_mixer_selem_set_playback_switch(elem, 1, 1);
-      break;
     case CTL_CAPTURE:
-      snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
-      lvol = convert_prange1(left, min, max);
-      rvol = convert_prange1(right, min, max);
-      snd_mixer_selem_set_capture_volume(elem, 0, lvol);
-      if (left == 0)
-        snd_mixer_selem_set_capture_switch(elem, 0, 0);
-      else
-        snd_mixer_selem_set_capture_switch(elem, 0, 1);
-      snd_mixer_selem_set_capture_volume(elem, 1, rvol);
-      if (right == 0)
-        snd_mixer_selem_set_capture_switch(elem, 1, 0);
-      else
-      snd_mixer_selem_set_capture_switch(elem, 1, 1);
+      err = alsa_write_volume(elem, capture, chn, vol, n);
+      /* a channel at 0 is switched off as well */
+      if (err >= 0)
+        err = alsa_write_switch(elem, capture, chn, on, n);
       break;
     case CTL_PLAYBACK_SWITCH:
-      snd_mixer_selem_set_playback_switch(elem, 0, left);
+      err = alsa_write_switch(elem, FALSE, chn, on, n);
       break;
     default:
       g_assert_not_reached();
+      err = 0;
       break;
   }
+  if (err < 0) {
+    error("Mixer %s write error: %s", mixer->name, snd_strerror(err));
+    mixer_failed(mixer);
+  }
+}
+
+static void
+alsa_mixer_device_set_volume(mixer_t * mixer, int devid, int left, int right) {
+  int volumes[MIXER_MAX_CHANNELS];
+
+  mixer_stereo_to_channels(mixer_get_device(mixer, devid), left, right,
+                           volumes);
+  alsa_mixer_device_set_channels(mixer, devid, volumes);
 }
 
 mixer_idz_t *
@@ -353,13 +1132,482 @@ alsa_mixer_get_id_list(void) {
   return result;
 }
 
+#ifdef ALSA_CTL
+/* The ctl engine. Instead of going through the simple mixer layer it
+ * drives the ctl elements behind the devices directly. Their values are
+ * read once when the device is wanted and after that only when an event
+ * says they changed, so reading a device is a table lookup. Cards where a
+ * device has no plainly named element ("<name> Playback Volume" and so on)
+ * are left to the simple mixer. */
+static void alsa_ctl_detach(mixer_t *mixer);
+
+/* "<name> <suffix>", or "<name> <fallback>" if there's no such element */
+static snd_hctl_elem_t *
+alsa_ctl_find(snd_hctl_t *hctl, const char *name, unsigned int index,
+              const char *suffix, const char *fallback) {
+  snd_ctl_elem_id_t *id;
+  snd_hctl_elem_t *elem;
+  gchar *full;
+
+  snd_ctl_elem_id_alloca(&id);
+  snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+  snd_ctl_elem_id_set_index(id, index);
+  full = g_strconcat(name, " ", suffix, NULL);
+  snd_ctl_elem_id_set_name(id, full);
+  g_free(full);
+  if ((elem = snd_hctl_find_elem(hctl, id)) != NULL || fallback == NULL)
+    return elem;
+  full = g_strconcat(name, " ", fallback, NULL);
+  snd_ctl_elem_id_set_name(id, full);
+  g_free(full);
+  return snd_hctl_find_elem(hctl, id);
+}
+
+/* looks up the elements of every device, FALSE if a device has none */
+static gboolean
+alsa_ctl_bind(mixer_t *mixer) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  const char *name;
+  int i;
+
+  for (i = 0; i < mixer->nrdevices; i++) {
+    name = mixer->dev_realnames[i];
+    switch (ctl->ctltype[i]) {
+      case CTL_PLAYBACK:
+        ctl->main[i].elem = alsa_ctl_find(ctl->hctl, name, ctl->index[i],
+                                          "Playback Volume", "Volume");
+        ctl->sw[i].elem = alsa_ctl_find(ctl->hctl, name, ctl->index[i],
+                                        "Playback Switch", "Switch");
+        break;
+      case CTL_CAPTURE:
+        ctl->main[i].elem = alsa_ctl_find(ctl->hctl, name, ctl->index[i],
+                                          "Capture Volume", NULL);
+        ctl->sw[i].elem = alsa_ctl_find(ctl->hctl, name, ctl->index[i],
+                                        "Capture Switch", NULL);
+        break;
+      case CTL_PLAYBACK_SWITCH:
+        ctl->main[i].elem = alsa_ctl_find(ctl->hctl, name, ctl->index[i],
+                                          "Playback Switch", "Switch");
+        ctl->sw[i].elem = NULL;
+        break;
+    }
+    if (ctl->main[i].elem == NULL)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* the volume of a device from the values of its element */
+static void
+alsa_ctl_update(mixer_t *mixer, int devid) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  alsa_ctl_elem_t *e = &ctl->main[devid];
+  int *volumes = &ctl->volumes[devid * MIXER_MAX_CHANNELS];
+  unsigned int ch;
+
+  memset(volumes, 0, sizeof(int) * MIXER_MAX_CHANNELS);
+  if (e->elem == NULL || e->value == NULL)
+    return;
+  for (ch = 0; ch < e->channels && ch < MIXER_MAX_CHANNELS; ch++)
+    volumes[ch] = e->is_switch ?
+        snd_ctl_elem_value_get_boolean(e->value, ch) :
+        mixer_raw_to_percent(snd_ctl_elem_value_get_integer(e->value, ch),
+                             e->min, e->max);
+}
+
+static int
+alsa_ctl_elem_event(snd_hctl_elem_t *elem, unsigned int mask) {
+  mixer_t *mixer = (mixer_t *) snd_hctl_elem_get_callback_private(elem);
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  alsa_ctl_elem_t *e;
+  int i;
+
+  for (i = 0; i < mixer->nrdevices; i++) {
+    if (ctl->main[i].elem == elem)
+      e = &ctl->main[i];
+    else if (ctl->sw[i].elem == elem)
+      e = &ctl->sw[i];
+    else
+      continue;
+    if (mask == SND_CTL_EVENT_MASK_REMOVE)
+      e->elem = NULL;
+    else if ((mask & SND_CTL_EVENT_MASK_VALUE) && e->value != NULL)
+      snd_hctl_elem_read(elem, e->value);
+    alsa_ctl_update(mixer, i);
+    ctl->changed[i] = 1;
+  }
+  return 0;
+}
+
+/* reads the info and value of an element and hooks it up, FALSE if it
+ * isn't what the device needs */
+static gboolean
+alsa_ctl_elem_init(mixer_t *mixer, alsa_ctl_elem_t *e, int is_switch) {
+  snd_ctl_elem_info_t *info;
+  snd_ctl_elem_type_t type;
+
+  if (e->elem == NULL)
+    return TRUE;
+  snd_ctl_elem_info_alloca(&info);
+  if (snd_hctl_elem_info(e->elem, info) < 0)
+    return FALSE;
+  type = snd_ctl_elem_info_get_type(info);
+  if (type != (is_switch ? SND_CTL_ELEM_TYPE_BOOLEAN : SND_CTL_ELEM_TYPE_INTEGER))
+    return FALSE;
+  e->is_switch = is_switch;
+  e->channels = snd_ctl_elem_info_get_count(info);
+  if (!is_switch) {
+    e->min = snd_ctl_elem_info_get_min(info);
+    e->max = snd_ctl_elem_info_get_max(info);
+  }
+  if (e->value == NULL)
+    snd_ctl_elem_value_malloc(&e->value);
+  snd_hctl_elem_set_callback(e->elem, alsa_ctl_elem_event);
+  snd_hctl_elem_set_callback_private(e->elem, mixer);
+  return snd_hctl_elem_read(e->elem, e->value) >= 0;
+}
+
+/* only wanted devices have their elements read */
+static void
+alsa_ctl_device_want(mixer_t *mixer, int devid) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+
+  ctl->wanted[devid] = 1;
+  if (ctl->hctl == NULL)
+    return;
+  if (!alsa_ctl_elem_init(mixer, &ctl->main[devid],
+                          ctl->ctltype[devid] == CTL_PLAYBACK_SWITCH))
+    ctl->main[devid].elem = NULL;
+  if (!alsa_ctl_elem_init(mixer, &ctl->sw[devid], TRUE))
+    ctl->sw[devid].elem = NULL;
+  alsa_ctl_update(mixer, devid);
+}
+
+/* from the shared event source. Any error detaches the card, its
+ * descriptors would fire again right away otherwise. A card that is still
+ * there is attached again by the next read */
+static void
+alsa_ctl_handle_events(mixer_t *mixer, unsigned short revents) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  int i, err = 0;
+
+  if (revents & (POLLERR | POLLHUP))
+    err = -ENODEV;
+  else if (revents & POLLIN)
+    err = snd_hctl_handle_events(ctl->hctl);
+  if (err < 0) {
+    error("Mixer %s event error: %s", mixer->name, snd_strerror(err));
+    alsa_ctl_detach(mixer);
+    mixer_failed(mixer);
+    return;
+  }
+  for (i = 0; i < mixer->nrdevices; i++) {
+    if (ctl->changed[i]) {
+      ctl->changed[i] = 0;
+      mixer_notify(mixer, i);
+    }
+  }
+}
+
+/* opens the card, finds the elements of the devices and starts listening
+ * for their events */
+static gboolean
+alsa_ctl_attach(mixer_t *mixer, const char *card) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  int i, err;
+
+  if ((err = snd_hctl_open(&ctl->hctl, card, SND_CTL_NONBLOCK)) < 0) {
+    error("Control %s open error: %s", card, snd_strerror(err));
+    ctl->hctl = NULL;
+    return FALSE;
+  }
+  /* only lists the elements, their info and values are read on demand */
+  if ((err = snd_hctl_load(ctl->hctl)) < 0 ||
+      (err = snd_ctl_subscribe_events(snd_hctl_ctl(ctl->hctl), 1)) < 0 ||
+      !alsa_ctl_bind(mixer)) {
+    if (err < 0)
+      error("Control %s load error: %s", card, snd_strerror(err));
+    snd_hctl_close(ctl->hctl);
+    ctl->hctl = NULL;
+    return FALSE;
+  }
+  for (i = 0; i < mixer->nrdevices; i++)
+    if (ctl->wanted[i])
+      alsa_ctl_device_want(mixer, i);
+
+  alsa_source_add_mixer(mixer);
+  return TRUE;
+}
+
+static void
+alsa_ctl_detach(mixer_t *mixer) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  int i;
+
+  if (ctl->hctl == NULL)
+    return;
+  alsa_source_remove_mixer(mixer);
+  snd_hctl_close(ctl->hctl);
+  ctl->hctl = NULL;
+  for (i = 0; i < mixer->nrdevices; i++)
+    ctl->main[i].elem = ctl->sw[i].elem = NULL;
+}
+
+static gboolean
+alsa_ctl_reattached(gpointer data) {
+  mixer_t *mixer = (mixer_t *) data;
+  int i;
+
+  ALSACTL(mixer)->reattach_id = 0;
+  for (i = 0; i < mixer->nrdevices; i++)
+    mixer_notify(mixer, i);
+  return FALSE;
+}
+
+/* like the simple mixer, a card that went away is looked for by its id */
+static gboolean
+alsa_ctl_reattach(mixer_t *mixer) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  char *card = alsa_find_card(ctl->card_id);
+  GSource *idle;
+  gboolean result;
+
+  if (card == NULL)
+    return FALSE;
+  result = alsa_ctl_attach(mixer, card);
+  g_free(card);
+  if (result && ctl->reattach_id == 0) {
+    idle = g_idle_source_new();
+    g_source_set_callback(idle, alsa_ctl_reattached, mixer, NULL);
+    ctl->reattach_id = g_source_attach(idle, mixer_get_context());
+    g_source_unref(idle);
+  }
+  return result;
+}
+
+static void
+alsa_ctl_free(mixer_t *mixer) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  int i;
+
+  for (i = 0; i < mixer->nrdevices; i++) {
+    g_free(mixer->dev_names[i]);
+    g_free(mixer->dev_realnames[i]);
+    if (ctl->main[i].value != NULL)
+      snd_ctl_elem_value_free(ctl->main[i].value);
+    if (ctl->sw[i].value != NULL)
+      snd_ctl_elem_value_free(ctl->sw[i].value);
+  }
+  g_free(mixer->name);
+  g_free(mixer->dev_names);
+  g_free(mixer->dev_realnames);
+  g_free(ctl->card_id);
+  g_free(ctl->main);
+  g_free(ctl->sw);
+  g_free(ctl->ctltype);
+  g_free(ctl->index);
+  g_free(ctl->wanted);
+  g_free(ctl->volumes);
+  g_free(ctl->changed);
+  g_free(ctl);
+  g_free(mixer);
+}
+
+static mixer_t *
+alsa_ctl_open(const char *card, snd_ctl_card_info_t *hw_info,
+              GArray *devices) {
+  mixer_t *result = g_new0(mixer_t, 1);
+  alsa_ctl_t *ctl = g_new0(alsa_ctl_t, 1);
+  alsa_device_t *dev;
+  int i, n = devices->len;
+
+  result->priv = ctl;
+  result->ops = get_ctl_ops();
+  result->notifies = 1;
+  result->name = g_strdup(snd_ctl_card_info_get_name(hw_info));
+  result->nrdevices = n;
+  result->dev_names = g_new0(gchar *, n);
+  result->dev_realnames = g_new0(gchar *, n);
+  ctl->card_id = g_strdup(snd_ctl_card_info_get_id(hw_info));
+  ctl->main = g_new0(alsa_ctl_elem_t, n);
+  ctl->sw = g_new0(alsa_ctl_elem_t, n);
+  ctl->ctltype = g_new0(int, n);
+  ctl->index = g_new0(unsigned int, n);
+  ctl->wanted = g_new0(int, n);
+  ctl->volumes = g_new0(int, n * MIXER_MAX_CHANNELS);
+  ctl->changed = g_new0(int, n);
+  for (i = 0; i < n; i++) {
+    dev = &g_array_index(devices, alsa_device_t, i);
+    result->dev_realnames[i] = g_strdup(dev->realname);
+    result->dev_names[i] = g_strdup(dev->name);
+    ctl->ctltype[i] = dev->type;
+    ctl->index[i] = dev->index;
+  }
+  if (!alsa_ctl_attach(result, card)) {
+    alsa_ctl_free(result);
+    return NULL;
+  }
+  return result;
+}
+
+static void
+alsa_ctl_close(mixer_t *mixer) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+
+  if (ctl->reattach_id != 0)
+    g_source_destroy(g_main_context_find_source_by_id(mixer_get_context(),
+                                                      ctl->reattach_id));
+  alsa_ctl_detach(mixer);
+  alsa_ctl_free(mixer);
+}
+
+static long
+alsa_ctl_device_get_fullscale(mixer_t *mixer, int devid) {
+  return ALSACTL(mixer)->ctltype[devid] == CTL_PLAYBACK_SWITCH ? 1 : 100;
+}
+
+static void
+alsa_ctl_device_describe(mixer_t *mixer, int devid, mixer_device_t *desc) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  snd_ctl_elem_info_t *info;
+  int i;
+
+  if (ctl->ctltype[devid] == CTL_CAPTURE)
+    desc->flags |= MIXER_DEVICE_CAPTURE;
+  snd_ctl_elem_info_alloca(&info);
+  if (ctl->main[devid].elem == NULL ||
+      snd_hctl_elem_info(ctl->main[devid].elem, info) < 0)
+    return;
+  desc->channels = MIN(snd_ctl_elem_info_get_count(info), MIXER_MAX_CHANNELS);
+  /* mixer elements have their channels in the order of MIXER_CH_* */
+  for (i = 0; i < desc->channels; i++)
+    desc->position[i] = i + 1;
+  if (ctl->ctltype[devid] == CTL_PLAYBACK_SWITCH)
+    return;
+  desc->min = snd_ctl_elem_info_get_min(info);
+  desc->max = snd_ctl_elem_info_get_max(info);
+  if (snd_ctl_elem_info_is_tlv_readable(info))
+    desc->flags |= MIXER_DEVICE_DB;
+}
+
+static void
+alsa_ctl_device_get_channels(mixer_t *mixer, int devid, int *volumes) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+
+  if (ctl->hctl == NULL && !alsa_ctl_reattach(mixer)) {
+    mixer_failed(mixer);
+    return;
+  }
+  memcpy(volumes, &ctl->volumes[devid * MIXER_MAX_CHANNELS],
+         sizeof(int) * MIXER_MAX_CHANNELS);
+}
+
+static void
+alsa_ctl_device_get_volume(mixer_t *mixer, int devid, int *left, int *right) {
+  int volumes[MIXER_MAX_CHANNELS];
+
+  memset(volumes, 0, sizeof(volumes));
+  alsa_ctl_device_get_channels(mixer, devid, volumes);
+  mixer_channels_to_stereo(mixer_get_device(mixer, devid), volumes,
+                           left, right);
+}
+
+/* Sets all channels of an element in one write, channels beyond the
+ * description follow its last one. Only written if that changes the value.
+ * volumes are percentages, or on/off for switches */
+static int
+alsa_ctl_write(alsa_ctl_elem_t *e, const mixer_device_t *desc,
+               const int *volumes) {
+  gboolean changed = FALSE;
+  unsigned int ch;
+  long v;
+  int err;
+
+  if (e->elem == NULL || e->value == NULL)
+    return 0;
+  for (ch = 0; ch < e->channels; ch++) {
+    v = volumes[MIN(ch, (unsigned int) desc->channels - 1)];
+    if (e->is_switch) {
+      if (snd_ctl_elem_value_get_boolean(e->value, ch) != (v != 0)) {
+        snd_ctl_elem_value_set_boolean(e->value, ch, v != 0);
+        changed = TRUE;
+      }
+    } else {
+      v = mixer_percent_to_raw(v, e->min, e->max);
+      if (snd_ctl_elem_value_get_integer(e->value, ch) != v) {
+        snd_ctl_elem_value_set_integer(e->value, ch, v);
+        changed = TRUE;
+      }
+    }
+  }
+  if (!changed)
+    return 0;
+  /* the cached value is what we wanted, not what the card has */
+  if ((err = snd_hctl_elem_write(e->elem, e->value)) < 0)
+    snd_hctl_elem_read(e->elem, e->value);
+  return err;
+}
+
+static void
+alsa_ctl_device_set_channels(mixer_t *mixer, int devid, const int *volumes) {
+  alsa_ctl_t *ctl = ALSACTL(mixer);
+  const mixer_device_t *desc = mixer_get_device(mixer, devid);
+  int err;
+
+  if (ctl->hctl == NULL && !alsa_ctl_reattach(mixer)) {
+    mixer_failed(mixer);
+    return;
+  }
+  err = alsa_ctl_write(&ctl->main[devid], desc, volumes);
+  /* a channel at 0 is switched off as well */
+  if (err >= 0 && ctl->ctltype[devid] != CTL_PLAYBACK_SWITCH)
+    err = alsa_ctl_write(&ctl->sw[devid], desc, volumes);
+  if (err < 0) {
+    error("Mixer %s write error: %s", mixer->name, snd_strerror(err));
+    mixer_failed(mixer);
+  }
+  alsa_ctl_update(mixer, devid);
+}
+
+static void
+alsa_ctl_device_set_volume(mixer_t *mixer, int devid, int left, int right) {
+  int volumes[MIXER_MAX_CHANNELS];
+
+  mixer_stereo_to_channels(mixer_get_device(mixer, devid), left, right,
+                           volumes);
+  alsa_ctl_device_set_channels(mixer, devid, volumes);
+}
+
+static mixer_ops_t alsa_ctl_ops = {
+  .mixer_get_id_list = alsa_mixer_get_id_list,
+  .mixer_open = alsa_mixer_open,
+  .mixer_close = alsa_ctl_close,
+  .mixer_device_get_fullscale = alsa_ctl_device_get_fullscale,
+  .mixer_device_get_volume = alsa_ctl_device_get_volume,
+  .mixer_device_set_volume = alsa_ctl_device_set_volume,
+  .mixer_device_want = alsa_ctl_device_want,
+  .mixer_device_describe = alsa_ctl_device_describe,
+  .mixer_device_get_channels = alsa_ctl_device_get_channels,
+  .mixer_device_set_channels = alsa_ctl_device_set_channels
+};
+
+static mixer_ops_t *
+get_ctl_ops(void) {
+  return &alsa_ctl_ops;
+}
+#endif
+
 static mixer_ops_t alsa_mixer_ops = {
   .mixer_get_id_list = alsa_mixer_get_id_list,
   .mixer_open = alsa_mixer_open,
   .mixer_close = alsa_mixer_close,
   .mixer_device_get_fullscale = alsa_mixer_device_get_fullscale,
   .mixer_device_get_volume = alsa_mixer_device_get_volume,
-  .mixer_device_set_volume = alsa_mixer_device_set_volume
+  .mixer_device_set_volume = alsa_mixer_device_set_volume,
+  .mixer_device_want = alsa_mixer_device_want,
+  .mixer_device_describe = alsa_mixer_device_describe,
+  .mixer_device_get_channels = alsa_mixer_device_get_channels,
+  .mixer_device_set_channels = alsa_mixer_device_set_channels
 };
 
 static mixer_ops_t *
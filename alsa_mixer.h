@@ -4,12 +4,67 @@
 
 #include "mixer.h"
 
+/* a card in the poll set all cards share, whatever engine drives it */
 typedef struct {
+    int pfd_first, pfd_count;
+    /* the poll events not handled yet */
+    unsigned short revents;
+} alsa_poll_t;
+
+typedef struct {
+    /* NULL while the card is gone, see alsa_mixer_detach */
     snd_mixer_t *handle;
+    /* the id of the card ("Headset"), which survives replugging unlike its
+     * index */
+    char *card_id;
+    /* reports every device once the card is back */
+    guint reattach_id;
     snd_mixer_selem_id_t **sids;
+    /* devid to element, rebound after every reload */
+    snd_mixer_elem_t **elems;
     int *ctltype;
     int changed_state;
+    /* the devices came from the cache, only the elements of wanted devices
+     * are loaded */
+    int sparse;
+    int *wanted;
+    /* per device, set by the element callbacks when the value changed */
+    int *dirty;
+    /* last read channels per device, MIXER_MAX_CHANNELS each */
+    int *volumes;
+    /* per device, how it was described when scanned or in the cache */
+    mixer_device_t *descs;
+    alsa_poll_t poll;
 } alsa_mixer_t;
 
+#ifdef ALSA_CTL
+/* a ctl element and its last read value */
+typedef struct {
+    snd_hctl_elem_t *elem;
+    snd_ctl_elem_value_t *value;
+    long min, max;
+    unsigned int channels;
+    int is_switch;
+} alsa_ctl_elem_t;
+
+/* a card driven through its ctl elements, see the ctl engine */
+typedef struct {
+    /* NULL while the card is gone */
+    snd_hctl_t *hctl;
+    char *card_id;
+    guint reattach_id;
+    /* per device: its element, for volumes the switch next to it as well */
+    alsa_ctl_elem_t *main, *sw;
+    int *ctltype;
+    unsigned int *index;
+    int *wanted;
+    /* per device: the channels reads come from (MIXER_MAX_CHANNELS each),
+     * and whether they changed */
+    int *volumes;
+    int *changed;
+    alsa_poll_t poll;
+} alsa_ctl_t;
+#endif
+
 mixer_ops_t *init_alsa_mixer(void);
 #endif
@@ -0,0 +1,161 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* The control element engine of the ALSA backend against the simple mixer,
+ * on a real card: the open, reads of every device and writes of every
+ * volume with the card events they cause. The card comes as argument or in
+ * ALSA_BENCH_CARD, snd-dummy's hw:Dummy is a good one; without a card it's
+ * skipped. Volumes move by a step and are put back afterwards.
+ * GKRELLM_VOLUME_ALSA_CTL=0 picks the simple mixer for the second open. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "mixer.h"
+
+#define OPENS 20
+#define READS 20000
+#define WRITES 500
+
+typedef struct {
+  mixer_t *mixer;
+  double t_open, t_read, t_write;
+  int reads, writes;
+  gboolean done;
+} engine_run_t;
+
+static GMutex run_mutex;
+static GCond run_cond;
+
+/* drains the card events of our writes, like the io thread does */
+static void io_drain(void) {
+  while (g_main_context_iteration(mixer_get_context(), FALSE));
+}
+
+/* runs in the io thread, where the backend calls belong */
+static gboolean engine_run(gpointer data) {
+  engine_run_t *run = data;
+  mixer_t *mixer = run->mixer;
+  mixer_ops_t *ops = mixer->ops;
+  int n = mixer->nrdevices;
+  int (*saved)[MIXER_MAX_CHANNELS] = g_malloc0(n * sizeof(*saved));
+  int volumes[MIXER_MAX_CHANNELS];
+  const mixer_device_t *desc;
+  gint64 start;
+  int i, j, k;
+
+  for (i = 0; i < n; i++) {
+    if (ops->mixer_device_want != NULL) ops->mixer_device_want(mixer, i);
+    ops->mixer_device_get_channels(mixer, i, saved[i]);
+  }
+  io_drain();
+
+  start = g_get_monotonic_time();
+  for (k = 0; k < READS; k++)
+    for (i = 0; i < n; i++) {
+      ops->mixer_device_get_channels(mixer, i, volumes);
+      run->reads++;
+    }
+  run->t_read = (g_get_monotonic_time() - start) / 1e6;
+
+  /* a step down and back up, or up and back down at 0 */
+  start = g_get_monotonic_time();
+  for (k = 0; k < WRITES; k++)
+    for (i = 0; i < n; i++) {
+      desc = mixer_get_device(mixer, i);
+      if (desc->kind != MIXER_VOLUME || desc->fullscale < 1) continue;
+      for (j = 0; j < desc->channels; j++)
+        volumes[j] = saved[i][j] + (k & 1 ? 0 : saved[i][j] > 0 ? -1 : 1);
+      ops->mixer_device_set_channels(mixer, i, volumes);
+      io_drain();
+      run->writes++;
+    }
+  run->t_write = (g_get_monotonic_time() - start) / 1e6;
+
+  for (i = 0; i < n; i++) {
+    desc = mixer_get_device(mixer, i);
+    if (desc->kind == MIXER_VOLUME && desc->fullscale >= 1)
+      ops->mixer_device_set_channels(mixer, i, saved[i]);
+  }
+  io_drain();
+  g_free(saved);
+
+  g_mutex_lock(&run_mutex);
+  run->done = TRUE;
+  g_cond_signal(&run_cond);
+  g_mutex_unlock(&run_mutex);
+  return FALSE;
+}
+
+/* opens id OPENS times for the timing and runs the rest on the last one,
+ * returns its ops or NULL if it can't be opened */
+static mixer_ops_t *engine_bench(char *id, const char *ctl,
+                                 engine_run_t *run) {
+  mixer_ops_t *ops;
+  gint64 start;
+  int i;
+
+  g_setenv("GKRELLM_VOLUME_ALSA_CTL", ctl, TRUE);
+  memset(run, 0, sizeof(*run));
+  start = g_get_monotonic_time();
+  for (i = 0; i < OPENS; i++) {
+    if (run->mixer != NULL) mixer_close(run->mixer);
+    if ((run->mixer = mixer_open(id)) == NULL) return NULL;
+  }
+  run->t_open = (g_get_monotonic_time() - start) / 1e6;
+
+  g_main_context_invoke(mixer_get_context(), engine_run, run);
+  g_mutex_lock(&run_mutex);
+  while (!run->done) g_cond_wait(&run_cond, &run_mutex);
+  g_mutex_unlock(&run_mutex);
+
+  ops = run->mixer->ops;
+  mixer_close(run->mixer);
+  return ops;
+}
+
+static void report(const char *engine, engine_run_t *run) {
+  printf("  %-7s open %.3fms, read %.2fus, write %.2fus\n", engine,
+         run->t_open / OPENS * 1e3, run->t_read / run->reads * 1e6,
+         run->writes > 0 ? run->t_write / run->writes * 1e6 : 0.0);
+}
+
+int main(int argc, char **argv) {
+  engine_run_t ctl_run, simple_run;
+  mixer_ops_t *ctl_ops, *simple_ops;
+  const char *card = argc > 1 ? argv[1] : g_getenv("ALSA_BENCH_CARD");
+  char *id;
+
+  if (card == NULL) {
+    printf("alsa_engine_bench: skipped, no card given\n");
+    return 0;
+  }
+  init_mixer();
+  id = g_strconcat("alsa:", card, NULL);
+  if ((ctl_ops = engine_bench(id, "1", &ctl_run)) == NULL ||
+      (simple_ops = engine_bench(id, "0", &simple_run)) == NULL) {
+    fprintf(stderr, "alsa_engine_bench: can't open %s\n", id);
+    return 1;
+  }
+  printf("alsa_engine_bench: %s, %d devices\n", id,
+         ctl_run.reads / READS);
+  /* without ALSA_CTL, or with elements the ctl engine doesn't take */
+  if (ctl_ops == simple_ops)
+    printf("  %s stays on the simple mixer, nothing to compare\n", card);
+  else
+    report("ctl", &ctl_run);
+  report("simple", &simple_run);
+  g_free(id);
+  return 0;
+}
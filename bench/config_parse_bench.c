@@ -0,0 +1,99 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* parses a generated config with thousands of mixers, sliders and scenes,
+ * the way gkrellm hands it over line by line and as one text */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config_parse.h"
+
+#define MIXERS 500
+#define DEVS 8
+#define SCENES 100
+#define ROUNDS 20
+
+static GString *make_config(int *lines) {
+  GString *text = g_string_new(NULL);
+  int m, d, s;
+
+  *lines = 0;
+  g_string_append(text, "MUTEALL\nPOLL_CEILING 2000\nSCENE_RAMP 300\n");
+  *lines += 3;
+  for (m = 0; m < MIXERS; m++) {
+    g_string_append_printf(text, "ADDMIXER alsa:hw:%d\n", m);
+    (*lines)++;
+    for (d = 0; d < DEVS; d++) {
+      g_string_append_printf(text, "ADDDEV %d\nSETDEVNAME Channel %d of %d\n"
+                             "SHOWBALANCE\nSETVOLUME %d %d %d %d %d %d\n",
+                             d, d, m, d, 90, 80, 70, 60, 50);
+      *lines += 4;
+    }
+  }
+  for (s = 0; s < SCENES; s++) {
+    g_string_append_printf(text, "SCENE scene %d\n", s);
+    (*lines)++;
+    for (d = 0; d < DEVS; d++) {
+      g_string_append_printf(text, "SCENEDEV %d 0 -10 20 10 20 30 40 50 60 "
+                             "70 80 alsa:hw:%d\n", d, s);
+      (*lines)++;
+    }
+  }
+  return text;
+}
+
+int main(void) {
+  int lines, i;
+  GString *text = make_config(&lines);
+  volume_config_t *config;
+  config_parser_t *p;
+  const char *pos, *nl, *end = text->str + text->len;
+  gint64 start;
+  double t_text, t_lines;
+
+  start = g_get_monotonic_time();
+  for (i = 0; i < ROUNDS; i++)
+    config_free(config_parse(text->str, text->len));
+  t_text = (g_get_monotonic_time() - start) / 1e6;
+
+  start = g_get_monotonic_time();
+  for (i = 0; i < ROUNDS; i++) {
+    p = config_parser_new();
+    for (pos = text->str; pos < end; pos = nl + 1) {
+      nl = strchr(pos, '\n');
+      config_parse_line(p, pos, nl - pos);
+    }
+    config_free(config_parser_finish(p));
+  }
+  t_lines = (g_get_monotonic_time() - start) / 1e6;
+
+  /* and a look whether it got them all */
+  config = config_parse(text->str, text->len);
+  if (config->mixers->len != MIXERS || config->scenes->len != SCENES ||
+      g_array_index(config->mixers, config_mixer_t, MIXERS - 1).devs->len
+      != DEVS) {
+    fprintf(stderr, "config_parse_bench: parsed config is incomplete\n");
+    return 1;
+  }
+  config_free(config);
+
+  printf("config_parse_bench: %d lines, %lu bytes, %d rounds\n",
+         lines, (unsigned long) text->len, ROUNDS);
+  printf("  config_parse       %.3fs %.0f lines/s\n",
+         t_text, lines * ROUNDS / t_text);
+  printf("  config_parse_line  %.3fs %.0f lines/s\n",
+         t_lines, lines * ROUNDS / t_lines);
+  g_string_free(text, TRUE);
+  return 0;
+}
@@ -0,0 +1,88 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* the integer percent conversions against the double and rint based pair
+ * the ALSA backend used before, a read and a write of every percent on a
+ * dB range per round */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "mixer.h"
+
+#define ROUNDS 500000
+#define RANGE_MIN -6400
+#define RANGE_MAX 0
+
+/* as they were in alsa_mixer.c */
+static int
+convert_prange(int val, int min, int max) {
+  int range = max - min;
+  int tmp;
+
+  if (range == 0)
+    return 0;
+  val -= min;
+  tmp = rint((double) val / (double) range * 100);
+  return tmp;
+}
+
+static int
+convert_prange1(int val, int min, int max) {
+  int range = max - min;
+  int tmp;
+
+  if (range == 0)
+    return 0;
+
+  tmp = rint((double) range * ((double) val * .01)) + min;
+  return tmp;
+}
+
+/* the range comes in through volatiles so neither loop gets folded */
+static volatile int vmin = RANGE_MIN, vmax = RANGE_MAX;
+static volatile long sink;
+
+static double run_new(void) {
+  gint64 start = g_get_monotonic_time();
+  int i, p, min = vmin, max = vmax;
+  long sum = 0;
+
+  for (i = 0; i < ROUNDS; i++)
+    for (p = 0; p <= 100; p++)
+      sum += mixer_raw_to_percent(mixer_percent_to_raw(p, min, max), min, max);
+  sink = sum;
+  return (g_get_monotonic_time() - start) / 1e6;
+}
+
+static double run_old(void) {
+  gint64 start = g_get_monotonic_time();
+  int i, p, min = vmin, max = vmax;
+  long sum = 0;
+
+  for (i = 0; i < ROUNDS; i++)
+    for (p = 0; p <= 100; p++)
+      sum += convert_prange(convert_prange1(p, min, max), min, max);
+  sink = sum;
+  return (g_get_monotonic_time() - start) / 1e6;
+}
+
+int main(void) {
+  double t_new = run_new(), t_old = run_old();
+  double n = (double) ROUNDS * 101;
+
+  printf("convert_bench: %.0f round trips\n", n);
+  printf("  integer  %.3fs %.2fns each\n", t_new, t_new / n * 1e9);
+  printf("  rint     %.3fs %.2fns each\n", t_old, t_old / n * 1e9);
+  return 0;
+}
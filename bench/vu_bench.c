@@ -0,0 +1,188 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* Holds the vu meter to what vu_meter.h promises: at VU_RATE and a period
+ * every VU_PERIOD_US, below 0.1% of a CPU. The meter runs for real on a
+ * capture PCM: the one given as argument, else snd-aloop's hw:Loopback,1,0
+ * when the module is loaded, else "vu_bench", a null PCM the bench
+ * defines itself. The CPU time of the whole process is compared with the
+ * seconds of audio the meter captured. A null PCM always has a full buffer
+ * and never makes the meter wait, so there it runs flat out.
+ * Then vu_measure and vu_publish run on their own over an hour of
+ * generated stereo audio, without ALSA. Exits with 1 if either is over
+ * budget. vu_meter.c is included for vu_publish, with the mmap commits of
+ * the meter thread counted. */
+
+#include <sys/resource.h>
+#include <glib.h>
+#include <alsa/asoundlib.h>
+
+/* frames the meter thread captured */
+static volatile gint captured = 0;
+
+static snd_pcm_sframes_t
+counted_mmap_commit(snd_pcm_t *pcm, snd_pcm_uframes_t offset,
+                    snd_pcm_uframes_t frames) {
+  snd_pcm_sframes_t n = snd_pcm_mmap_commit(pcm, offset, frames);
+
+  if (n > 0) g_atomic_int_add(&captured, n);
+  return n;
+}
+
+#define snd_pcm_mmap_commit counted_mmap_commit
+#include "vu_meter.c"
+#undef snd_pcm_mmap_commit
+
+/* 0.1% */
+#define BUDGET 0.001
+#define CHANNELS 2
+#define PERIOD_FRAMES (VU_RATE / (G_USEC_PER_SEC / VU_PERIOD_US))
+#define AUDIO_SECONDS 3600
+/* a paced PCM is read this long, a null one until it gave an hour */
+#define PCM_SECONDS 10
+#define PCM_NAME "vu_bench"
+#define ASOUNDRC "pcm." PCM_NAME " { type null }"
+
+/* user and system time of the process so far, in s */
+static double cpu_time(void) {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+         ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int verdict(const char *what, double cpu, double seconds) {
+  double share = cpu / seconds;
+
+  printf("vu_bench: %s, %.0fs of audio in %.4fs of CPU, %.5f%% "
+         "(budget %.3f%%)\n", what, seconds, cpu, share * 100, BUDGET * 100);
+  if (share > BUDGET) {
+    fprintf(stderr, "vu_bench: over budget\n");
+    return 1;
+  }
+  return 0;
+}
+
+/* a second of a 440 Hz tone with some noise, every period different */
+static gint16 *make_audio(void) {
+  gint16 *samples = g_new(gint16, VU_RATE * CHANNELS);
+  guint32 noise = 1;
+  int i, c;
+
+  for (i = 0; i < VU_RATE; i++)
+    for (c = 0; c < CHANNELS; c++) {
+      noise = noise * 1103515245 + 12345;
+      samples[i * CHANNELS + c] =
+        (gint16) (12000 * sin(2 * G_PI * 440 * i / VU_RATE) +
+                  ((int) (noise >> 16) % 2000) - 1000);
+    }
+  return samples;
+}
+
+static int bench_generated(void) {
+  gint16 *audio = make_audio();
+  vu_meter_t vu;
+  gint64 energy;
+  double start;
+  int i, offset, peak;
+
+  memset(&vu, 0, sizeof(vu));
+  vu.channels = CHANNELS;
+  start = cpu_time();
+  for (i = 0; i < AUDIO_SECONDS * VU_RATE / PERIOD_FRAMES; i++) {
+    offset = i * PERIOD_FRAMES % (VU_RATE - PERIOD_FRAMES + 1);
+    vu_measure(audio + offset * CHANNELS, PERIOD_FRAMES * CHANNELS, &peak,
+               &energy);
+    vu_publish(&vu, peak, energy, PERIOD_FRAMES);
+  }
+  g_free(audio);
+  return verdict("vu_measure and vu_publish", cpu_time() - start,
+                 AUDIO_SECONDS);
+}
+
+/* adds ASOUNDRC to the configuration snd_pcm_open looks names up in */
+static int define_pcm(void) {
+  snd_input_t *in;
+  int err;
+
+  if ((err = snd_config_update()) < 0 ||
+      (err = snd_input_buffer_open(&in, ASOUNDRC, -1)) < 0)
+    return err;
+  err = snd_config_load(snd_config, in);
+  snd_input_close(in);
+  return err;
+}
+
+/* the capture PCM to meter, NULL if there is none */
+static const char *pick_pcm(int argc, char **argv) {
+  int err;
+
+  if (argc > 1) return argv[1];
+  if (snd_card_get_index("Loopback") >= 0) return "hw:Loopback,1,0";
+  if ((err = define_pcm()) < 0) {
+    fprintf(stderr, "vu_bench: can't define %s: %s\n", PCM_NAME,
+            snd_strerror(err));
+    return NULL;
+  }
+  return PCM_NAME;
+}
+
+/* the rate the meter got, the closest the PCM has to VU_RATE */
+static unsigned int pcm_rate(vu_meter_t *vu) {
+  snd_pcm_hw_params_t *hw;
+  unsigned int rate = VU_RATE;
+  int dir;
+
+  snd_pcm_hw_params_alloca(&hw);
+  if (snd_pcm_hw_params_current(vu->pcm, hw) < 0 ||
+      snd_pcm_hw_params_get_rate(hw, &rate, &dir) < 0 || rate == 0)
+    return VU_RATE;
+  return rate;
+}
+
+static int bench_pcm(const char *name) {
+  vu_meter_t *vu;
+  unsigned int rate;
+  double start;
+  int i, peak, rms;
+
+  start = cpu_time();
+  if ((vu = vu_meter_open(name)) == NULL) {
+    fprintf(stderr, "vu_bench: can't open %s\n", name);
+    return 1;
+  }
+  rate = pcm_rate(vu);
+  /* read like the plugin does on every update */
+  for (i = 0; i < PCM_SECONDS * 10 &&
+              g_atomic_int_get(&captured) < (gint) (AUDIO_SECONDS * rate);
+       i++) {
+    g_usleep(G_USEC_PER_SEC / 10);
+    vu_meter_read(vu, &peak, &rms);
+  }
+  vu_meter_close(vu);
+  if (g_atomic_int_get(&captured) == 0) {
+    fprintf(stderr, "vu_bench: %s captured nothing\n", name);
+    return 1;
+  }
+  return verdict(name, cpu_time() - start,
+                 (double) g_atomic_int_get(&captured) / rate);
+}
+
+int main(int argc, char **argv) {
+  const char *name = pick_pcm(argc, argv);
+  int result = name != NULL ? bench_pcm(name) : 1;
+
+  result |= bench_generated();
+  return result;
+}
@@ -245,6 +245,21 @@ bluetooth_mixer_get_id_list(void) {
     return result;
 }
 
+/* ObjectManager.InterfacesRemoved, a disconnected device takes its transport
+ * with it */
+static void
+bt_interfaces_removed(GDBusConnection *connection, const gchar *sender,
+                      const gchar *object_path, const gchar *interface,
+                      const gchar *signal, GVariant *parameters,
+                      gpointer data) {
+    bluetooth_mixer_t *bt_mixer = (bluetooth_mixer_t *) data;
+    const gchar *path;
+
+    g_variant_get(parameters, "(&oas)", &path, NULL);
+    if (g_strcmp0(path, bt_mixer->transport_path) == 0)
+        bt_mixer->stale = TRUE;
+}
+
 static mixer_t *
 bluetooth_mixer_open(char *device_path) {
     mixer_t *result;
@@ -298,6 +313,12 @@ bluetooth_mixer_open(char *device_path) {
     }
 
     result->priv = bt_mixer;
+    /* the proxy keeps Volume up to date from PropertiesChanged, so reads
+     * come from its cache until the transport is removed */
+    bt_mixer->removed_watch = g_dbus_connection_signal_subscribe(connection,
+        BLUEZ_SERVICE, "org.freedesktop.DBus.ObjectManager",
+        "InterfacesRemoved", "/", NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+        bt_interfaces_removed, bt_mixer, NULL);
     result->ops = get_mixer_ops();
 
     /* Get device name */
@@ -340,6 +361,9 @@ static void
 bluetooth_mixer_close(mixer_t *mixer) {
     bluetooth_mixer_t *bt_mixer = BTMIXER(mixer);
 
+    if (bt_mixer->removed_watch)
+        g_dbus_connection_signal_unsubscribe(bt_mixer->connection,
+                                             bt_mixer->removed_watch);
     if (bt_mixer->media_proxy)
         g_object_unref(bt_mixer->media_proxy);
 
@@ -364,6 +388,12 @@ bluetooth_device_get_fullscale(mixer_t *mixer, int devid) {
     return 127;
 }
 
+static void
+bluetooth_device_describe(mixer_t *mixer, int devid, mixer_device_t *desc) {
+    /* AVRCP has one volume for both channels */
+    desc->channels = 1;
+}
+
 static gboolean
 bluetooth_refresh_transport(bluetooth_mixer_t *bt_mixer) {
     gchar *new_transport_path;
@@ -401,6 +431,7 @@ bluetooth_refresh_transport(bluetooth_mixer_t *bt_mixer) {
             g_error_free(error);
             return FALSE;
         }
+        bt_mixer->stale = FALSE;
     } else {
         g_free(new_transport_path);
     }
@@ -413,9 +444,20 @@ bluetooth_device_get_volume(mixer_t *mixer, int devid, int *left, int *right) {
     bluetooth_mixer_t *bt_mixer = BTMIXER(mixer);
     GError *error = NULL;
     GVariant *result;
+    GVariant *cached;
 
     if (!bt_mixer->media_proxy) {
         *left = *right = 0;
+        mixer_failed(mixer);
+        return;
+    }
+
+    /* no D-Bus round trip, and nothing allocated, while the cache is good */
+    if (!bt_mixer->stale &&
+        (cached = g_dbus_proxy_get_cached_property(bt_mixer->media_proxy,
+                                                   "Volume")) != NULL) {
+        *left = *right = g_variant_get_uint16(cached);
+        g_variant_unref(cached);
         return;
     }
 
@@ -456,6 +498,7 @@ bluetooth_device_get_volume(mixer_t *mixer, int devid, int *left, int *right) {
         if (error) {
             bt_error("Failed to get volume: %s", error->message);
             g_error_free(error);
+            mixer_failed(mixer);
             return;
         }
     }
@@ -477,8 +520,10 @@ bluetooth_device_set_volume(mixer_t *mixer, int devid, int left, int right) {
     guint16 volume;
     GVariant *result;
 
-    if (!bt_mixer->media_proxy)
+    if (!bt_mixer->media_proxy) {
+        mixer_failed(mixer);
         return;
+    }
 
     /* Use the higher of left/right for stereo devices */
     volume = (left > right) ? left : right;
@@ -526,10 +571,15 @@ bluetooth_device_set_volume(mixer_t *mixer, int devid, int left, int right) {
         if (error) {
             bt_error("Failed to set volume: %s", error->message);
             g_error_free(error);
+            mixer_failed(mixer);
         }
     }
 
     if (result) {
+        /* the read back right after this mustn't see the old volume before
+         * PropertiesChanged arrives */
+        g_dbus_proxy_set_cached_property(bt_mixer->media_proxy, "Volume",
+                                         g_variant_new_uint16(volume));
         g_variant_unref(result);
     }
 }
@@ -540,7 +590,9 @@ static mixer_ops_t bluetooth_ops = {
     bluetooth_mixer_close,
     bluetooth_device_get_fullscale,
     bluetooth_device_get_volume,
-    bluetooth_device_set_volume
+    bluetooth_device_set_volume,
+    NULL,
+    bluetooth_device_describe
 };
 
 static mixer_ops_t *
@@ -10,6 +10,9 @@ typedef struct {
     gchar *device_path;
     gchar *transport_path;
     int changed_state;
+    /* the transport went away, Volume in the proxy's cache is stale */
+    guint removed_watch;
+    gboolean stale;
 } bluetooth_mixer_t;
 
 mixer_ops_t *init_bluetooth_mixer(void);
@@ -0,0 +1,243 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+#include <string.h>
+
+#include "config_parse.h"
+
+struct config_parser {
+  volume_config_t *config;
+  /* where ADDDEV and SCENEDEV lines go, NULL before the first ADDMIXER or
+   * SCENE and after an ADDDEV the plugin couldn't use */
+  config_mixer_t *mixer;
+  config_dev_t *dev;
+  config_scene_t *scene;
+};
+
+/* a line split into its keyword and the rest, both bounded by end */
+typedef struct {
+  const char *pos, *end;
+} config_cursor_t;
+
+static gboolean
+cursor_space(const config_cursor_t *c) {
+  return c->pos < c->end && g_ascii_isspace(*c->pos);
+}
+
+static void
+cursor_skip_space(config_cursor_t *c) {
+  while (cursor_space(c))
+    c->pos++;
+}
+
+/* does the cursor sit on word followed by space or the end, moves past it */
+static gboolean
+cursor_word(config_cursor_t *c, const char *word) {
+  gsize n = strlen(word);
+
+  if ((gsize) (c->end - c->pos) < n || memcmp(c->pos, word, n) ||
+      (c->pos + n < c->end && !g_ascii_isspace(c->pos[n])))
+    return FALSE;
+  c->pos += n;
+  cursor_skip_space(c);
+  return TRUE;
+}
+
+/* a decimal int, clamped to the int range */
+static gboolean
+cursor_int(config_cursor_t *c, int *result) {
+  const char *p = c->pos;
+  gboolean negative = FALSE;
+  gint64 v = 0;
+
+  if (p < c->end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  if (p == c->end || !g_ascii_isdigit(*p))
+    return FALSE;
+  for (; p < c->end && g_ascii_isdigit(*p); p++)
+    v = MIN(v * 10 + (*p - '0'), (gint64) G_MAXINT + 1);
+  if (p < c->end && !g_ascii_isspace(*p))
+    return FALSE;
+  v = negative ? -v : v;
+  *result = (int) CLAMP(v, G_MININT, G_MAXINT);
+  c->pos = p;
+  cursor_skip_space(c);
+  return TRUE;
+}
+
+/* the rest of the line without trailing space, NULL if that's empty */
+static char *
+cursor_rest(config_cursor_t *c) {
+  const char *end = c->end;
+
+  while (end > c->pos && g_ascii_isspace(end[-1]))
+    end--;
+  if (end == c->pos)
+    return NULL;
+  return g_strndup(c->pos, end - c->pos);
+}
+
+static void
+parse_setvolume(config_parser_t *p, config_cursor_t *c) {
+  config_dev_t *d = p->dev;
+  int n = 0;
+
+  if (d == NULL)
+    return;
+  d->save_volume = TRUE;
+  while (n < MIXER_MAX_CHANNELS && cursor_int(c, &d->volumes[n]))
+    n++;
+  d->nr_volumes = n;
+}
+
+static void
+parse_scenedev(config_parser_t *p, config_cursor_t *c) {
+  config_scene_dev_t d;
+  int *fields[] = { &d.dev, &d.muted, &d.balance, &d.fader };
+  int i;
+
+  if (p->scene == NULL)
+    return;
+  memset(&d, 0, sizeof(d));
+  for (i = 0; i < 4; i++)
+    if (!cursor_int(c, fields[i]))
+      return;
+  for (i = 0; i < MIXER_MAX_CHANNELS; i++)
+    if (!cursor_int(c, &d.volumes[i]))
+      return;
+  if ((d.id = cursor_rest(c)) != NULL)
+    g_array_append_val(p->scene->devs, d);
+}
+
+config_parser_t *
+config_parser_new(void) {
+  config_parser_t *p = g_new0(config_parser_t, 1);
+
+  p->config = g_new0(volume_config_t, 1);
+  p->config->poll_ceiling = -1;
+  p->config->scene_ramp = -1;
+  p->config->mixers = g_array_new(FALSE, TRUE, sizeof(config_mixer_t));
+  p->config->scenes = g_array_new(FALSE, TRUE, sizeof(config_scene_t));
+  return p;
+}
+
+void
+config_parse_line(config_parser_t *p, const char *line, gsize len) {
+  volume_config_t *config = p->config;
+  config_cursor_t c = { line, line + len };
+  config_mixer_t m;
+  config_dev_t d;
+  config_scene_t sc;
+  int v;
+
+  cursor_skip_space(&c);
+  if (cursor_word(&c, "MUTEALL")) {
+    config->muteall = TRUE;
+  } else if (cursor_word(&c, "ADDMIXER")) {
+    p->mixer = NULL;
+    p->dev = NULL;
+    if ((m.id = cursor_rest(&c)) == NULL)
+      return;
+    m.devs = g_array_new(FALSE, TRUE, sizeof(config_dev_t));
+    g_array_append_val(config->mixers, m);
+    p->mixer = &g_array_index(config->mixers, config_mixer_t,
+                              config->mixers->len - 1);
+  } else if (cursor_word(&c, "RIGHT_CLICK_CMD")) {
+    g_free(config->right_click_cmd);
+    config->right_click_cmd = cursor_rest(&c);
+  } else if (cursor_word(&c, "POLL_CEILING")) {
+    if (cursor_int(&c, &v))
+      config->poll_ceiling = MAX(v, 100);
+  } else if (cursor_word(&c, "SCENE_RAMP")) {
+    if (cursor_int(&c, &v))
+      config->scene_ramp = CLAMP(v, 0, 5000);
+  } else if (cursor_word(&c, "ADDDEV")) {
+    p->dev = NULL;
+    if (p->mixer == NULL || !cursor_int(&c, &v) || v < 0)
+      return;
+    memset(&d, 0, sizeof(d));
+    d.dev = v;
+    g_array_append_val(p->mixer->devs, d);
+    p->dev = &g_array_index(p->mixer->devs, config_dev_t,
+                            p->mixer->devs->len - 1);
+  } else if (cursor_word(&c, "SETDEVNAME")) {
+    if (p->dev != NULL) {
+      g_free(p->dev->name);
+      p->dev->name = cursor_rest(&c);
+    }
+  } else if (cursor_word(&c, "SHOWBALANCE")) {
+    if (p->dev != NULL) p->dev->balance = TRUE;
+  } else if (cursor_word(&c, "SHOWVU")) {
+    if (p->dev != NULL) p->dev->vu = TRUE;
+  } else if (cursor_word(&c, "SETVOLUME")) {
+    parse_setvolume(p, &c);
+  } else if (cursor_word(&c, "SCENE")) {
+    p->scene = NULL;
+    if ((sc.name = cursor_rest(&c)) == NULL)
+      return;
+    sc.devs = g_array_new(FALSE, TRUE, sizeof(config_scene_dev_t));
+    g_array_append_val(config->scenes, sc);
+    p->scene = &g_array_index(config->scenes, config_scene_t,
+                              config->scenes->len - 1);
+  } else if (cursor_word(&c, "SCENEDEV")) {
+    parse_scenedev(p, &c);
+  }
+}
+
+volume_config_t *
+config_parser_finish(config_parser_t *p) {
+  volume_config_t *config = p->config;
+
+  g_free(p);
+  return config;
+}
+
+volume_config_t *
+config_parse(const char *text, gsize len) {
+  config_parser_t *p = config_parser_new();
+  const char *end = text + len, *nl;
+
+  while (text < end) {
+    if ((nl = memchr(text, '\n', end - text)) == NULL)
+      nl = end;
+    config_parse_line(p, text, nl - text);
+    text = nl + 1;
+  }
+  return config_parser_finish(p);
+}
+
+void
+config_free(volume_config_t *config) {
+  config_mixer_t *m;
+  config_scene_t *sc;
+  guint i, j;
+
+  for (i = 0; i < config->mixers->len; i++) {
+    m = &g_array_index(config->mixers, config_mixer_t, i);
+    for (j = 0; j < m->devs->len; j++)
+      g_free(g_array_index(m->devs, config_dev_t, j).name);
+    g_array_free(m->devs, TRUE);
+    g_free(m->id);
+  }
+  for (i = 0; i < config->scenes->len; i++) {
+    sc = &g_array_index(config->scenes, config_scene_t, i);
+    for (j = 0; j < sc->devs->len; j++)
+      g_free(g_array_index(sc->devs, config_scene_dev_t, j).id);
+    g_array_free(sc->devs, TRUE);
+    g_free(sc->name);
+  }
+  g_array_free(config->mixers, TRUE);
+  g_array_free(config->scenes, TRUE);
+  g_free(config->right_click_cmd);
+  g_free(config);
+}
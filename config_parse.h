@@ -0,0 +1,68 @@
+#ifndef VOLUME_CONFIG_PARSE_H
+#define VOLUME_CONFIG_PARSE_H
+
+#include <glib.h>
+
+#include "mixer.h"
+
+/* Parser of the plugin's lines in the gkrellm user config, without the
+ * volume_plugin_config keyword gkrellm strips. It builds a tree of what the
+ * lines configure and doesn't touch any mixer, the plugin applies the tree
+ * once all lines are in. All state lives in the parser, lines are never
+ * modified. Lines it doesn't understand are skipped. */
+
+/* a configured slider, ADDDEV and the lines after it */
+typedef struct {
+  int dev;
+  /* SETDEVNAME, NULL if not renamed */
+  char *name;
+  gboolean balance, vu;
+  /* SETVOLUME, either left and right or every channel */
+  gboolean save_volume;
+  int nr_volumes;
+  int volumes[MIXER_MAX_CHANNELS];
+} config_dev_t;
+
+/* ADDMIXER */
+typedef struct {
+  char *id;
+  GArray *devs; /* of config_dev_t */
+} config_mixer_t;
+
+/* SCENEDEV */
+typedef struct {
+  char *id;
+  int dev;
+  int muted, balance, fader;
+  int volumes[MIXER_MAX_CHANNELS];
+} config_scene_dev_t;
+
+/* SCENE */
+typedef struct {
+  char *name;
+  GArray *devs; /* of config_scene_dev_t */
+} config_scene_t;
+
+typedef struct {
+  gboolean muteall;
+  /* NULL, or -1, if not set */
+  char *right_click_cmd;
+  int poll_ceiling;
+  int scene_ramp;
+  GArray *mixers; /* of config_mixer_t, in config order */
+  GArray *scenes; /* of config_scene_t */
+} volume_config_t;
+
+typedef struct config_parser config_parser_t;
+
+config_parser_t *config_parser_new(void);
+/* one line of len bytes, it doesn't need to be nul terminated */
+void config_parse_line(config_parser_t *p, const char *line, gsize len);
+/* the tree of all lines so far, frees the parser */
+volume_config_t *config_parser_finish(config_parser_t *p);
+
+/* all lines of a text at once */
+volume_config_t *config_parse(const char *text, gsize len);
+void config_free(volume_config_t *config);
+
+#endif /* VOLUME_CONFIG_PARSE_H */
@@ -0,0 +1,394 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* Control socket, so scripts and hotkey daemons can change volumes without
+ * spawning a mixer program for every key press. The protocol is line based,
+ * a client may send any number of commands at once and gets one reply line
+ * per command, in order:
+ *
+ *   get <id> <devid>                  ok <left> <right> <fullscale> <muted>
+ *   set <id> <devid> <left> [<right>] ok
+ *   step <id> <devid> <delta>         ok <left> <right>
+ *   mute <id> <devid> on|off|toggle   ok <muted>
+ *   list <id>                         dev <devid> <name> lines, then ok
+ *   stats <id>                        ok <poll interval ms> <changes/min>
+ *   scene <name> [<ramp ms>]          ok
+ *   save-scene <name>                 ok
+ *   scenes                            scene <name> lines, then ok
+ *   subscribe, unsubscribe            ok
+ *
+ * Failures are answered with "err <reason>". Subscribed clients get
+ * "event <id> <devid> <left> <right> <muted>" lines whenever a slider
+ * changes. The volume of a muted slider is the one unmuting restores, a
+ * step moves that one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include "control.h"
+
+/* longest command line we accept, clients sending more are dropped */
+#define CONTROL_LINE_MAX 1024
+
+typedef struct {
+  int fd;
+  guint watch;
+  gboolean subscribed;
+  /* handling a batch, events must not free it meanwhile */
+  gboolean busy;
+  /* failed to keep up, freed once not busy */
+  gboolean dead;
+  char buf[CONTROL_LINE_MAX];
+  size_t len;
+} control_client_t;
+
+static const control_ops_t *control_ops = NULL;
+static int control_fd = -1;
+static char *control_path = NULL;
+static GSList *control_clients = NULL;
+
+static void
+control_client_free(control_client_t *c) {
+  control_clients = g_slist_remove(control_clients, c);
+  g_source_remove(c->watch);
+  close(c->fd);
+  g_free(c);
+}
+
+/* replies never block the main loop, a client that doesn't keep up with
+ * its replies or events is dropped */
+static gboolean
+control_send(control_client_t *c, GString *out) {
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < out->len) {
+    n = send(c->fd, out->str + done, out->len - done,
+             MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return FALSE;
+    }
+    done += n;
+  }
+  return TRUE;
+}
+
+static gboolean
+parse_int(const char *s, int *result) {
+  char *end;
+  long v;
+
+  if (s == NULL)
+    return FALSE;
+  v = strtol(s, &end, 10);
+  if (*s == '\0' || *end != '\0')
+    return FALSE;
+  *result = (int) v;
+  return TRUE;
+}
+
+/* looks up the mixer and device named by the first two arguments */
+static mixer_t *
+control_device(char **argv, int argc, int *devid, GString *out) {
+  mixer_t *mixer;
+
+  if (argc < 3 || !parse_int(argv[2], devid)) {
+    g_string_append(out, "err usage\n");
+    return NULL;
+  }
+  if ((mixer = control_ops->find_mixer(argv[1])) == NULL) {
+    g_string_append(out, "err no such mixer\n");
+    return NULL;
+  }
+  if (*devid < 0 || *devid >= mixer_get_nr_devices(mixer)) {
+    g_string_append(out, "err no such device\n");
+    return NULL;
+  }
+  /* devices without a slider might not be loaded yet */
+  mixer_want_device(mixer, *devid);
+  return mixer;
+}
+
+/* the hardware of a muted slider is at 0, what counts is its own volume */
+static void
+control_get_volume(mixer_t *mixer, const char *id, int devid,
+                   int *left, int *right) {
+  if (!control_ops->get_volume(id, devid, left, right))
+    mixer_get_device_volume(mixer, devid, left, right);
+}
+
+static void
+control_command(control_client_t *c, char **argv, int argc, GString *out) {
+  mixer_t *mixer;
+  int devid, left, right, value, i;
+  long full;
+  gchar **names;
+
+  if (!strcmp(argv[0], "get")) {
+    if ((mixer = control_device(argv, argc, &devid, out)) == NULL) return;
+    control_get_volume(mixer, argv[1], devid, &left, &right);
+    value = control_ops->get_mute(argv[1], devid);
+    g_string_append_printf(out, "ok %d %d %ld %d\n", left, right,
+                           mixer_get_device_fullscale(mixer, devid),
+                           value > 0);
+  } else if (!strcmp(argv[0], "set")) {
+    if ((mixer = control_device(argv, argc, &devid, out)) == NULL) return;
+    if (argc < 4 || !parse_int(argv[3], &left) ||
+        (argc > 4 && !parse_int(argv[4], &right))) {
+      g_string_append(out, "err usage\n");
+      return;
+    }
+    if (argc == 4) right = left;
+    full = mixer_get_device_fullscale(mixer, devid);
+    left = CLAMP(left, 0, full);
+    right = CLAMP(right, 0, full);
+    control_ops->set_volume(argv[1], devid, left, right);
+    g_string_append(out, "ok\n");
+  } else if (!strcmp(argv[0], "step")) {
+    if ((mixer = control_device(argv, argc, &devid, out)) == NULL) return;
+    if (argc < 4 || !parse_int(argv[3], &value)) {
+      g_string_append(out, "err usage\n");
+      return;
+    }
+    full = mixer_get_device_fullscale(mixer, devid);
+    control_get_volume(mixer, argv[1], devid, &left, &right);
+    left = CLAMP(left + value, 0, full);
+    right = CLAMP(right + value, 0, full);
+    control_ops->set_volume(argv[1], devid, left, right);
+    g_string_append_printf(out, "ok %d %d\n", left, right);
+  } else if (!strcmp(argv[0], "mute")) {
+    if ((mixer = control_device(argv, argc, &devid, out)) == NULL) return;
+    if (argc < 4) value = -2;
+    else if (!strcmp(argv[3], "on")) value = 1;
+    else if (!strcmp(argv[3], "off")) value = 0;
+    else if (!strcmp(argv[3], "toggle")) value = -1;
+    else value = -2;
+    if (value == -2) {
+      g_string_append(out, "err usage\n");
+      return;
+    }
+    if ((value = control_ops->set_mute(argv[1], devid, value)) < 0)
+      g_string_append(out, "err device has no slider\n");
+    else
+      g_string_append_printf(out, "ok %d\n", value);
+  } else if (!strcmp(argv[0], "list")) {
+    if (argc < 2 || (mixer = control_ops->find_mixer(argv[1])) == NULL) {
+      g_string_append(out, argc < 2 ? "err usage\n" : "err no such mixer\n");
+      return;
+    }
+    for (i = 0; i < mixer_get_nr_devices(mixer); i++)
+      g_string_append_printf(out, "dev %d %s\n", i,
+                             mixer_get_device_name(mixer, i));
+    g_string_append(out, "ok\n");
+  } else if (!strcmp(argv[0], "stats")) {
+    if (argc < 2) {
+      g_string_append(out, "err usage\n");
+    } else if (!control_ops->get_stats(argv[1], &left, &right)) {
+      g_string_append(out, "err no such mixer\n");
+    } else {
+      g_string_append_printf(out, "ok %d %d\n", left, right);
+    }
+  } else if (!strcmp(argv[0], "scene")) {
+    value = -1;
+    if (argc < 2 || (argc > 2 && (!parse_int(argv[2], &value) || value < 0))) {
+      g_string_append(out, "err usage\n");
+    } else if (!control_ops->apply_scene(argv[1], value)) {
+      g_string_append(out, "err no such scene\n");
+    } else {
+      g_string_append(out, "ok\n");
+    }
+  } else if (!strcmp(argv[0], "save-scene")) {
+    if (argc < 2) {
+      g_string_append(out, "err usage\n");
+      return;
+    }
+    control_ops->save_scene(argv[1]);
+    g_string_append(out, "ok\n");
+  } else if (!strcmp(argv[0], "scenes")) {
+    names = control_ops->get_scenes();
+    for (i = 0; names[i] != NULL; i++)
+      g_string_append_printf(out, "scene %s\n", names[i]);
+    g_strfreev(names);
+    g_string_append(out, "ok\n");
+  } else if (!strcmp(argv[0], "subscribe")) {
+    c->subscribed = TRUE;
+    g_string_append(out, "ok\n");
+  } else if (!strcmp(argv[0], "unsubscribe")) {
+    c->subscribed = FALSE;
+    g_string_append(out, "ok\n");
+  } else {
+    g_string_append(out, "err unknown command\n");
+  }
+}
+
+static void
+control_line(control_client_t *c, char *line, GString *out) {
+  char *argv[6];
+  int argc = 0;
+  char *tok, *save = NULL;
+
+  for (tok = strtok_r(line, " \t\r", &save); tok != NULL && argc < 6;
+       tok = strtok_r(NULL, " \t\r", &save))
+    argv[argc++] = tok;
+  if (argc > 0)
+    control_command(c, argv, argc, out);
+}
+
+static gboolean
+control_client_cb(GIOChannel *source, GIOCondition cond, gpointer data) {
+  control_client_t *c = (control_client_t *) data;
+  GString *out;
+  char *start, *nl;
+  ssize_t n;
+
+  if (cond & (G_IO_HUP | G_IO_ERR)) {
+    if (!(cond & G_IO_IN)) {
+      control_client_free(c);
+      return FALSE;
+    }
+  }
+  n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+  if (n < 0 && (errno == EINTR || errno == EAGAIN))
+    return TRUE;
+  if (n <= 0) {
+    control_client_free(c);
+    return FALSE;
+  }
+  c->len += n;
+
+  /* handle every complete line of the batch, keep the rest */
+  out = g_string_new(NULL);
+  c->busy = TRUE;
+  start = c->buf;
+  while ((nl = memchr(start, '\n', c->len - (start - c->buf))) != NULL) {
+    *nl = '\0';
+    control_line(c, start, out);
+    start = nl + 1;
+  }
+  c->len -= start - c->buf;
+  memmove(c->buf, start, c->len);
+  c->busy = FALSE;
+
+  if (c->dead || (out->len > 0 && !control_send(c, out)) ||
+      c->len == sizeof(c->buf)) {
+    g_string_free(out, TRUE);
+    control_client_free(c);
+    return FALSE;
+  }
+  g_string_free(out, TRUE);
+  return TRUE;
+}
+
+static gboolean
+control_accept_cb(GIOChannel *source, GIOCondition cond, gpointer data) {
+  control_client_t *c;
+  GIOChannel *channel;
+  int fd;
+
+  if ((fd = accept(control_fd, NULL, NULL)) < 0)
+    return TRUE;
+  c = g_new0(control_client_t, 1);
+  c->fd = fd;
+  channel = g_io_channel_unix_new(fd);
+  c->watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                            control_client_cb, c);
+  g_io_channel_unref(channel);
+  control_clients = g_slist_prepend(control_clients, c);
+  return TRUE;
+}
+
+static void
+control_close(void) {
+  if (control_path != NULL)
+    unlink(control_path);
+}
+
+gboolean
+control_open(const control_ops_t *ops) {
+  struct sockaddr_un addr;
+  const char *dir = g_getenv("XDG_RUNTIME_DIR");
+  GIOChannel *channel;
+
+  if (control_fd >= 0)
+    return TRUE;
+  control_ops = ops;
+  if (dir != NULL && *dir != '\0')
+    control_path = g_strdup_printf("%s/gkrellm-volume.sock", dir);
+  else
+    control_path = g_strdup_printf("/tmp/gkrellm-volume-%u.sock",
+                                   (unsigned) getuid());
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(control_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "volume: control socket path too long: %s\n",
+            control_path);
+    return FALSE;
+  }
+  strcpy(addr.sun_path, control_path);
+
+  if ((control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return FALSE;
+  /* a socket left behind by an earlier instance */
+  unlink(control_path);
+  if (bind(control_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(control_fd, 8) < 0) {
+    fprintf(stderr, "volume: can't listen on %s: %s\n", control_path,
+            strerror(errno));
+    close(control_fd);
+    control_fd = -1;
+    return FALSE;
+  }
+  channel = g_io_channel_unix_new(control_fd);
+  g_io_add_watch(channel, G_IO_IN, control_accept_cb, NULL);
+  g_io_channel_unref(channel);
+  atexit(control_close);
+  return TRUE;
+}
+
+void
+control_changed(const char *id, int devid, int left, int right, int muted) {
+  /* kept between events and built without printf, which allocates, so
+   * telling clients about a change costs no allocation */
+  static GString *out = NULL;
+  char numbers[64];
+  GSList *l, *next;
+
+  if (control_clients == NULL)
+    return;
+  if (out == NULL)
+    out = g_string_sized_new(128);
+  snprintf(numbers, sizeof(numbers), " %d %d %d %d\n", devid, left, right,
+           muted);
+  g_string_assign(out, "event ");
+  g_string_append(out, id);
+  g_string_append(out, numbers);
+  for (l = control_clients; l != NULL; l = next) {
+    control_client_t *c = (control_client_t *) l->data;
+
+    next = l->next;
+    if (c->subscribed && !c->dead && !control_send(c, out))
+      c->dead = TRUE;
+    if (c->dead && !c->busy)
+      control_client_free(c);
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef VOLUME_CONTROL_H
+#define VOLUME_CONTROL_H
+
+#include "mixer.h"
+
+/* what the control socket needs from the plugin. Devices are addressed by
+ * mixer id and devid */
+typedef struct {
+  /* the open mixer with this id, NULL if there is none */
+  mixer_t *(*find_mixer)(const char *id);
+  /* set the volume like the slider of the device would, returns FALSE if
+   * there is no such device */
+  gboolean (*set_volume)(const char *id, int devid, int left, int right);
+  /* mute (1), unmute (0) or toggle (-1), returns the new state or -1 if the
+   * device has no slider */
+  int (*set_mute)(const char *id, int devid, int mute);
+  /* 1 if muted, 0 if not, -1 if the device has no slider */
+  int (*get_mute)(const char *id, int devid);
+  /* the volume of the slider, while muted the one unmuting restores.
+   * FALSE if the device has no slider */
+  gboolean (*get_volume)(const char *id, int devid, int *left, int *right);
+  /* current ms between reads (0 if the mixer reports changes itself) and
+   * slider changes during the last minute, FALSE if there's no such mixer */
+  gboolean (*get_stats)(const char *id, int *interval, int *changes);
+  /* applies a scene, ramping over ramp ms (-1 for the configured ramp).
+   * FALSE if there's no such scene */
+  gboolean (*apply_scene)(const char *name, int ramp);
+  /* stores the state of every slider as the scene */
+  void (*save_scene)(const char *name);
+  /* names of all scenes, free with g_strfreev */
+  gchar **(*get_scenes)(void);
+} control_ops_t;
+
+/* starts listening on $XDG_RUNTIME_DIR/gkrellm-volume.sock (or
+ * /tmp/gkrellm-volume-<uid>.sock), serving clients from the main loop */
+gboolean control_open(const control_ops_t *ops);
+
+/* tells subscribed clients about a changed device */
+void control_changed(const char *id, int devid, int left, int right,
+                     int muted);
+
+#endif /* VOLUME_CONTROL_H */
@@ -0,0 +1,68 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* libFuzzer target for the config parser, build with make fuzz. The input
+ * is copied to a buffer of exactly its size without a terminating nul, so
+ * the sanitizers catch the parser reading past a line */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config_parse.h"
+
+/* gkrellm config lines are short, longer inputs only slow the fuzzer down */
+#define FUZZ_MAX_INPUT 65536
+
+/* every string in the tree has to be there and terminated */
+static size_t walk(const volume_config_t *config) {
+  size_t n = 0;
+  guint i, j;
+
+  if (config->right_click_cmd != NULL) n += strlen(config->right_click_cmd);
+  for (i = 0; i < config->mixers->len; i++) {
+    config_mixer_t *m = &g_array_index(config->mixers, config_mixer_t, i);
+    n += strlen(m->id);
+    for (j = 0; j < m->devs->len; j++) {
+      config_dev_t *d = &g_array_index(m->devs, config_dev_t, j);
+      if (d->name != NULL) n += strlen(d->name);
+      if (d->dev < 0 || d->nr_volumes < 0 ||
+          d->nr_volumes > MIXER_MAX_CHANNELS)
+        abort();
+    }
+  }
+  for (i = 0; i < config->scenes->len; i++) {
+    config_scene_t *sc = &g_array_index(config->scenes, config_scene_t, i);
+    n += strlen(sc->name);
+    for (j = 0; j < sc->devs->len; j++)
+      n += strlen(g_array_index(sc->devs, config_scene_dev_t, j).id);
+  }
+  if (config->poll_ceiling != -1 && config->poll_ceiling < 100) abort();
+  if (config->scene_ramp < -1 || config->scene_ramp > 5000) abort();
+  return n;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  volume_config_t *config;
+  char *buf;
+
+  if (size > FUZZ_MAX_INPUT)
+    return 0;
+  buf = malloc(size ? size : 1);
+  memcpy(buf, data, size);
+  config = config_parse(buf, size);
+  walk(config);
+  config_free(config);
+  free(buf);
+  return 0;
+}
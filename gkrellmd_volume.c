@@ -0,0 +1,158 @@
+/* GKrellM Volume plugin, gkrellmd server module
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* Serves every mixer of the host to gkrellm clients, which show them through
+ * the remote mixer. Only devices that changed since the last update are
+ * served, the protocol is described in gkrellmd_volume.h. */
+
+#include <stdio.h>
+#include <string.h>
+#include <gkrellm2/gkrellmd.h>
+
+#include "mixer.h"
+#include "gkrellmd_volume.h"
+
+typedef struct {
+  char *id;
+  mixer_t *mixer;
+  /* per device, what was served last and whether that changed this update */
+  int *left, *right;
+  int *changed;
+} served_mixer_t;
+
+static served_mixer_t *served = NULL;
+static int nr_served = 0;
+
+static void
+volume_serve_init(void) {
+  mixer_idz_t *ids, *i;
+  mixer_t *mixer;
+  GArray *a = g_array_new(FALSE, TRUE, sizeof(served_mixer_t));
+  served_mixer_t sm;
+  int d;
+
+  init_mixer();
+  ids = mixer_get_id_list();
+  for (i = ids; i != NULL; i = i->next) {
+    if ((mixer = mixer_open(i->id)) == NULL)
+      continue;
+    sm.id = g_strdup(i->id);
+    sm.mixer = mixer;
+    /* every device is served */
+    for (d = 0; d < mixer_get_nr_devices(mixer); d++)
+      mixer_want_device(mixer, d);
+    sm.left = g_new0(int, mixer_get_nr_devices(mixer));
+    sm.right = g_new0(int, mixer_get_nr_devices(mixer));
+    sm.changed = g_new0(int, mixer_get_nr_devices(mixer));
+    g_array_append_val(a, sm);
+  }
+  mixer_free_idz(ids);
+  nr_served = a->len;
+  served = (served_mixer_t *) g_array_free(a, FALSE);
+}
+
+static void
+volume_update(GkrellmdMonitor *mon, gboolean first_update) {
+  served_mixer_t *sm;
+  gboolean changed = FALSE;
+  int m, d, left, right;
+
+  for (m = 0; m < nr_served; m++) {
+    sm = &served[m];
+    /* polled backends get reread for the next update */
+    if (!mixer_notifies(sm->mixer))
+      mixer_refresh(sm->mixer);
+    for (d = 0; d < mixer_get_nr_devices(sm->mixer); d++) {
+      mixer_get_device_volume(sm->mixer, d, &left, &right);
+      sm->changed[d] = left != sm->left[d] || right != sm->right[d];
+      sm->left[d] = left;
+      sm->right[d] = right;
+      changed |= sm->changed[d];
+    }
+  }
+  if (changed)
+    gkrellmd_need_serve(mon);
+}
+
+static void
+volume_serve_data(GkrellmdMonitor *mon, gboolean first_serve) {
+  served_mixer_t *sm;
+  gchar line[64];
+  int m, d;
+
+  gkrellmd_set_serve_name(mon, VOLUME_SERVE_NAME);
+  for (m = 0; m < nr_served; m++) {
+    sm = &served[m];
+    for (d = 0; d < mixer_get_nr_devices(sm->mixer); d++) {
+      if (!first_serve && !sm->changed[d])
+        continue;
+      snprintf(line, sizeof(line), "%d %d %d %d\n", m, d,
+               sm->left[d], sm->right[d]);
+      gkrellmd_serve_data(mon, line);
+    }
+  }
+}
+
+static void
+volume_serve_setup(GkrellmdMonitor *mon) {
+  served_mixer_t *sm;
+  gchar *line;
+  int m, d;
+
+  for (m = 0; m < nr_served; m++) {
+    sm = &served[m];
+    line = g_strdup_printf("mixer %d %d %s", m,
+                           mixer_get_nr_devices(sm->mixer), sm->id);
+    gkrellmd_plugin_serve_setup(mon, VOLUME_SERVE_NAME, line);
+    g_free(line);
+    for (d = 0; d < mixer_get_nr_devices(sm->mixer); d++) {
+      line = g_strdup_printf("dev %d %d %ld %s", m, d,
+                             mixer_get_device_fullscale(sm->mixer, d),
+                             mixer_get_device_name(sm->mixer, d));
+      gkrellmd_plugin_serve_setup(mon, VOLUME_SERVE_NAME, line);
+      g_free(line);
+    }
+  }
+}
+
+static void
+volume_client_input(GkrellmdClient *client, gchar *line) {
+  served_mixer_t *sm;
+  int m, d, left, right;
+  long full;
+
+  if (sscanf(line, "set %d %d %d %d", &m, &d, &left, &right) != 4 ||
+      m < 0 || m >= nr_served)
+    return;
+  sm = &served[m];
+  if (d < 0 || d >= mixer_get_nr_devices(sm->mixer))
+    return;
+  full = mixer_get_device_fullscale(sm->mixer, d);
+  /* queued, a burst of sets for one device ends up as one write */
+  mixer_set_device_volume(sm->mixer, d, CLAMP(left, 0, full),
+                          CLAMP(right, 0, full));
+}
+
+static GkrellmdMonitor volume_monitor = {
+  .name = VOLUME_SERVE_NAME,
+  .update_monitor = volume_update,
+  .serve_data = volume_serve_data,
+  .serve_setup = volume_serve_setup
+};
+
+GkrellmdMonitor *
+gkrellmd_init_plugin(void) {
+  volume_serve_init();
+  gkrellmd_client_input_connect(&volume_monitor, volume_client_input);
+  return &volume_monitor;
+}
@@ -0,0 +1,18 @@
+#ifndef VOLUME_GKRELLMD_VOLUME_H
+#define VOLUME_GKRELLMD_VOLUME_H
+
+/* The protocol between the gkrellmd volume module and the remote mixer of
+ * the plugin, all lines are sent under this serve name.
+ *
+ * Setup, once per client connection:
+ *   mixer <m> <nrdevices> <id>
+ *   dev <m> <d> <fullscale> <name>
+ * Data, on the first serve every device, afterwards only the changed ones:
+ *   <m> <d> <left> <right>
+ * From the client:
+ *   set <m> <d> <left> <right>
+ *
+ * <m> is the index of the mixer on the server, <d> the devid. */
+#define VOLUME_SERVE_NAME "volume"
+
+#endif /* VOLUME_GKRELLMD_VOLUME_H */
@@ -17,77 +17,249 @@
  |  Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#ifdef MODULES
+  /* for dladdr */
+  #define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <string.h>
+
 #include "mixer.h"
+#include "trace.h"
 
 #ifdef WIN32
   #include "win32_mixer.h"
 #else
-  #ifdef ALSA
-    #include "alsa_mixer.h"
+  /* built as modules these are only loaded when needed, see load_module */
+  #ifndef MODULES
+    #ifdef ALSA
+      #include "alsa_mixer.h"
+    #endif
+    #ifdef BLUETOOTH
+      #include "bluetooth_mixer.h"
+    #endif
+    #ifdef PULSE
+      #include "pulse_mixer.h"
+    #endif
   #endif
-  #ifdef BLUETOOTH
-    #include "bluetooth_mixer.h"
+  #ifdef REMOTE
+    #include "remote_mixer.h"
   #endif
   #include "oss_mixer.h"
 #endif
 
-#ifdef WIN32
-mixer_ops_t *win32_mixer;
-#else
-mixer_ops_t *oss_mixer;
+#ifdef MODULES
+  #include <dlfcn.h>
+  #include <gmodule.h>
 #endif
 
-#ifdef ALSA
-mixer_ops_t *alsa_mixer;
-#endif
+static void mixer_io_start(void);
 
-#ifdef BLUETOOTH
-mixer_ops_t *bluetooth_mixer;
-#endif
+void init_mixer(void) {
+  gint64 start = trace_start();
+
+  /* the backends are initialised when first used */
+  mixer_io_start();
+  trace_end("init_mixer", NULL, start);
+}
 
+/* one attempt of a backend to open id, shows up in the startup trace */
+static mixer_t *try_open(mixer_ops_t *ops, const char *backend, char *id) {
+  gint64 start = trace_start();
+  mixer_t *result = ops->mixer_open(id);
+  gchar *name;
 
-void init_mixer(void) {
+  if (start != 0) {
+    name = g_strdup_printf("%s open%s", backend, result ? "" : " (failed)");
+    trace_end(name, id, start);
+    g_free(name);
+  }
+  return result;
+}
+
+/* Every id names its backend with a scheme, "alsa:hw:0", "oss:/dev/mixer",
+ * "bt:/org/bluez/hci0/dev_..", so opening it goes straight to that backend.
+ * pulse and remote ids always had their scheme, ids from older configs
+ * without one are classified by their form. */
+typedef struct {
+  const char *scheme;
+  /* the scheme is part of the backend's own ids */
+  gboolean keep_scheme;
+  /* NULL if the backend is a module */
+  mixer_ops_t *(*init)(void);
+  /* the module is volume-<module>.so, exporting init_name */
+  const char *module;
+  const char *init_name;
+} backend_t;
+
+#ifdef MODULES
+  #define MODULE_BACKEND(init, module) NULL, module, #init
+#else
+  #define MODULE_BACKEND(init, module) init, module, #init
+#endif
+
+/* in the order their mixers are offered */
+static const backend_t backends[] = {
 #ifdef WIN32
-  win32_mixer = init_win32_mixer();
+  { "win32", TRUE, init_win32_mixer, NULL, NULL },
 #else
-  oss_mixer = init_oss_mixer();
+  #ifdef PULSE
+  /* The sound server goes first, it's what desktops actually use */
+  { "pulse", TRUE, MODULE_BACKEND(init_pulse_mixer, "pulse") },
+  #endif
+  #ifdef REMOTE
+  /* only has mixers when gkrellm is a client of gkrellmd */
+  { "remote", TRUE, init_remote_mixer, NULL, NULL },
+  #endif
+  #ifdef BLUETOOTH
+  { "bt", FALSE, MODULE_BACKEND(init_bluetooth_mixer, "bluetooth") },
+  #endif
+  #ifdef ALSA
+  { "alsa", FALSE, MODULE_BACKEND(init_alsa_mixer, "alsa") },
+  #endif
+  { "oss", FALSE, init_oss_mixer, NULL, NULL },
 #endif
+};
+#define NR_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+/* ops of the backends that were needed so far, NULL if that failed */
+G_LOCK_DEFINE_STATIC(backends);
+static mixer_ops_t *backend_ops_table[NR_BACKENDS];
+static gboolean backend_tried[NR_BACKENDS];
+
+#ifdef MODULES
+/* The modules use functions of this file, but gkrellm might have loaded us
+ * with local symbols only. Opening ourselves again makes them global. */
+static void
+export_own_symbols(void) {
+  static gboolean done = FALSE;
+  Dl_info info;
 
-#ifdef ALSA
-  alsa_mixer = init_alsa_mixer();
+  if (done)
+    return;
+  done = TRUE;
+  if (dladdr((void *) export_own_symbols, &info) && info.dli_fname != NULL)
+    g_module_make_resident(g_module_open(info.dli_fname, G_MODULE_BIND_LAZY));
+}
+
+static mixer_ops_t *
+load_module(const backend_t *b) {
+  const char *dir = g_getenv("GKRELLM_VOLUME_MODULE_DIR");
+  mixer_ops_t *(*init)(void);
+  GModule *module;
+  gchar *path;
+
+  export_own_symbols();
+  if (dir == NULL)
+    dir = MODULE_DIR;
+  path = g_strdup_printf("%s/volume-%s.so", dir, b->module);
+  module = g_module_open(path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+  g_free(path);
+  if (module == NULL) {
+    fprintf(stderr, "volume: %s\n", g_module_error());
+    return NULL;
+  }
+  if (!g_module_symbol(module, b->init_name, (gpointer *) &init)) {
+    fprintf(stderr, "volume: %s\n", g_module_error());
+    g_module_close(module);
+    return NULL;
+  }
+  /* mixers and event sources of the backend outlive any caller */
+  g_module_make_resident(module);
+  return init();
+}
 #endif
 
-#ifdef BLUETOOTH
-  bluetooth_mixer = init_bluetooth_mixer();
+/* initialises the backend, or loads its module, on first use */
+static mixer_ops_t *
+backend_ops(const backend_t *b) {
+  size_t i = b - backends;
+  gint64 start;
+
+  G_LOCK(backends);
+  if (!backend_tried[i]) {
+    start = trace_start();
+    backend_tried[i] = TRUE;
+    if (b->init != NULL)
+      backend_ops_table[i] = b->init();
+#ifdef MODULES
+    else
+      backend_ops_table[i] = load_module(b);
 #endif
+    trace_end("backend init", b->scheme, start);
+  }
+  G_UNLOCK(backends);
+  return backend_ops_table[i];
 }
-/* tries to open a mixer device, returns NULL on error or otherwise an mixer_t
- * struct */
-mixer_t *mixer_open(char *id) {
-  mixer_t *result = NULL;
+
+static const backend_t *
+find_backend(const char *scheme, size_t len) {
+  size_t i;
+
+  for (i = 0; i < NR_BACKENDS; i++)
+    if (strlen(backends[i].scheme) == len &&
+        !strncmp(backends[i].scheme, scheme, len))
+      return &backends[i];
+  return NULL;
+}
+
+/* the scheme an id without one would have had */
+static const char *
+legacy_scheme(const char *id) {
 #ifdef WIN32
-  result = win32_mixer->mixer_open(id);
+  return "win32";
 #else
-  #ifdef BLUETOOTH
-  /* Try Bluetooth first for BT devices */
-  result = bluetooth_mixer->mixer_open(id);
-  #endif
-  /* Try ALSA if BT failed or not a BT device */
+  if (!strcmp(id, "pulse")) return "pulse";
+  if (g_str_has_prefix(id, "/org/bluez/")) return "bt";
+  if (id[0] == '/') return "oss";
   #ifdef ALSA
-  if (result == NULL)
-    result = alsa_mixer->mixer_open(id);
+  return "alsa";
+  #else
+  return "oss";
   #endif
-  /* either no alsa/bluetooth mixer or they failed */
-  if (result == NULL) {
-    result = oss_mixer->mixer_open(id);
-  }
 #endif
-  return result;
 }
 
-void
-mixer_close(mixer_t *mixer) {
-  mixer->ops->mixer_close(mixer);
+/* the backend of id, or NULL if it isn't built in. *backend_id is set to
+ * the id as the backend knows it */
+static const backend_t *
+classify(const char *id, const char **backend_id) {
+  const char *colon = strchr(id, ':');
+  const backend_t *b;
+
+  *backend_id = id;
+  if (colon != NULL && (b = find_backend(id, colon - id)) != NULL) {
+    if (!b->keep_scheme)
+      *backend_id = colon + 1;
+    return b;
+  }
+  return find_backend(legacy_scheme(id), strlen(legacy_scheme(id)));
+}
+
+char *
+mixer_id_canonical(const char *id) {
+  const char *colon = strchr(id, ':');
+  const char *scheme;
+  const backend_t *b;
+
+  if (colon != NULL && find_backend(id, colon - id) != NULL)
+    return g_strdup(id);
+  scheme = legacy_scheme(id);
+  if ((b = find_backend(scheme, strlen(scheme))) == NULL || b->keep_scheme)
+    return g_strdup(id);
+  return g_strconcat(scheme, ":", id, NULL);
+}
+
+/* tries to open a mixer device, returns NULL on error or otherwise an mixer_t
+ * struct */
+static mixer_t *backend_open(char *id) {
+  const backend_t *b;
+  const char *backend_id;
+  mixer_ops_t *ops;
+
+  if ((b = classify(id, &backend_id)) == NULL || (ops = backend_ops(b)) == NULL)
+    return NULL;
+  return try_open(ops, b->scheme, (char *) backend_id);
 }
 
 /* Returns a pointer to the name of the mixer */
@@ -122,58 +294,881 @@ void  mixer_set_device_name(mixer_t *mixer, int devid, char *name) {
   mixer->dev_names[devid] = g_strdup(name);
 }
 
+const mixer_device_t *
+mixer_get_device(mixer_t *mixer, int devid) {
+  return &mixer->devices[devid];
+}
+
 /* get the full scale of a device and get/set the volume */
 long mixer_get_device_fullscale(mixer_t *mixer, int devid) {
-  return mixer->ops->mixer_device_get_fullscale(mixer, devid);
+  return mixer->devices[devid].fullscale;
+}
+
+void
+mixer_set_notify(mixer_t *mixer, mixer_notify_func func, void *data) {
+  mixer->notify = func;
+  mixer->notify_data = data;
+}
+
+gboolean
+mixer_notifies(mixer_t *mixer) {
+  return mixer->notifies;
+}
+
+long
+mixer_rescale(long value, long from, long to) {
+  if (from <= 0)
+    return 0;
+  value = CLAMP(value, 0, from);
+  /* 64 bits, a 32 bit range times another doesn't fit a long everywhere */
+  return ((gint64) value * to + from / 2) / from;
+}
+
+int
+mixer_raw_to_percent(long raw, long min, long max) {
+  return mixer_rescale(raw - min, max - min, 100);
+}
+
+long
+mixer_percent_to_raw(int percent, long min, long max) {
+  return mixer_rescale(percent, 100, max - min) + min;
+}
+
+/* per MIXER_CH_*: left (-1), center (0) or right (1), and front (-1), neither
+ * (0) or rear (1) */
+static const signed char channel_side[MIXER_CH_LAST] =
+  { 0, -1, 1, -1, 1, 0, 0, -1, 1, 0 };
+static const signed char channel_depth[MIXER_CH_LAST] =
+  { 0, -1, -1, 1, 1, -1, 0, 0, 0, 1 };
+
+void
+mixer_scale_channels(const mixer_device_t *desc, int volume,
+                     int balance, int fader, int *volumes) {
+  /* gain in percent per side (left, center, right) and per depth (front,
+   * neither, rear) */
+  int side[3], depth[3], gain[MIXER_MAX_CHANNELS];
+  int i, pos;
+
+  side[0] = balance > 0 ? 100 - balance : 100;
+  side[1] = 100;
+  side[2] = balance < 0 ? 100 + balance : 100;
+  depth[0] = fader > 0 ? 100 - fader : 100;
+  depth[1] = 100;
+  depth[2] = fader < 0 ? 100 + fader : 100;
+  for (i = 0; i < MIXER_MAX_CHANNELS; i++) {
+    pos = desc->position[i];
+    gain[i] = side[channel_side[pos] + 1] * depth[channel_depth[pos] + 1];
+  }
+  /* always all channels, a fixed count of multiplications the compiler
+   * turns into a few vector instructions. Rounded like channel_ratio, so
+   * measuring the result gives the balance back */
+  for (i = 0; i < MIXER_MAX_CHANNELS; i++)
+    volumes[i] = (volume * gain[i] + 5000) / 10000;
+}
+
+/* -100 if only a is on, 100 if only b is, rounded */
+static int
+channel_ratio(int a, int b) {
+  if (a < b)
+    return 100 - (a * 100 + b / 2) / b;
+  if (a > b)
+    return (b * 100 + a / 2) / a - 100;
+  return 0;
+}
+
+void
+mixer_measure_channels(const mixer_device_t *desc, const int *volumes,
+                       int *volume, int *balance, int *fader) {
+  /* loudest channel and number of channels per side and per depth */
+  int side[3] = { 0, 0, 0 }, depth[3] = { 0, 0, 0 };
+  int nside[3] = { 0, 0, 0 }, ndepth[3] = { 0, 0, 0 };
+  int i, s, d, max = 0;
+
+  for (i = 0; i < desc->channels; i++) {
+    s = channel_side[desc->position[i]] + 1;
+    d = channel_depth[desc->position[i]] + 1;
+    side[s] = MAX(side[s], volumes[i]);
+    depth[d] = MAX(depth[d], volumes[i]);
+    nside[s]++;
+    ndepth[d]++;
+    max = MAX(max, volumes[i]);
+  }
+  *volume = max;
+  /* a silent device says nothing about its balance */
+  if (max == 0)
+    return;
+  *balance = nside[0] && nside[2] ? channel_ratio(side[0], side[2]) : 0;
+  *fader = ndepth[0] && ndepth[2] ? channel_ratio(depth[0], depth[2]) : 0;
+}
+
+void
+mixer_channels_to_stereo(const mixer_device_t *desc, const int *volumes,
+                         int *left, int *right) {
+  int side[3] = { -1, -1, -1 };
+  int i, s;
+
+  for (i = 0; i < desc->channels; i++) {
+    s = channel_side[desc->position[i]] + 1;
+    side[s] = MAX(side[s], volumes[i]);
+  }
+  /* mono devices and the like only have centered channels */
+  *left = side[0] >= 0 ? side[0] : MAX(side[1], 0);
+  *right = side[2] >= 0 ? side[2] : MAX(side[1], 0);
+}
+
+void
+mixer_stereo_to_channels(const mixer_device_t *desc, int left, int right,
+                         int *volumes) {
+  int i, s;
+
+  for (i = 0; i < MIXER_MAX_CHANNELS; i++) {
+    s = channel_side[desc->position[i]];
+    volumes[i] = s < 0 ? left : s > 0 ? right : MAX(left, right);
+  }
+}
+
+gboolean
+mixer_device_has_rear(const mixer_device_t *desc) {
+  int i;
+
+  for (i = 0; i < desc->channels; i++)
+    if (channel_depth[desc->position[i]] > 0)
+      return TRUE;
+  return FALSE;
+}
+
+/* The io thread. It owns all mixer_t handles: every backend call happens in
+ * it, names and device descriptions are read from the mixer_t. Commands come
+ * in through a lock-free stack, volumes go out through a double buffered
+ * table per mixer guarded by a sequence counter, so neither side ever waits
+ * for the other when reading or setting a volume. */
+enum {
+  CMD_OPEN = 0,
+  CMD_CLOSE,
+  CMD_SET,
+  CMD_BATCH,
+  CMD_REFRESH,
+  CMD_WANT
+};
+
+typedef struct _mixer_cmd_t mixer_cmd_t;
+struct _mixer_cmd_t {
+  int type;
+  mixer_t *mixer;
+  char *id;
+  int devid;
+  /* CMD_BATCH: nr devices, written with what is wanted of them */
+  int nr;
+  int *devids;
+  /* synchronous commands, set by the io thread once done */
+  gboolean done;
+  mixer_t *result;
+  mixer_cmd_t *next;
+};
+
+typedef struct _mixer_state_t {
+  /* two tables of MIXER_MAX_CHANNELS entries per device */
+  int *volumes[2];
+  volatile gint front;
+  /* odd while the io thread is publishing */
+  volatile gint seq;
+  /* there is only ever one queued refresh, this one */
+  volatile gint refresh_pending;
+  mixer_cmd_t refresh;
+  /* number of queued writes per device and what they asked for, so readers
+   * don't see the old volume in between. wanted is written by the main loop
+   * only, the io thread reads it under wanted_seq like the volume tables */
+  volatile gint *pending;
+  int *wanted;
+  volatile gint wanted_seq;
+  /* one CMD_SET per device, queued at most once. It writes whatever is
+   * wanted by the time it runs, so setting a volume doesn't allocate */
+  mixer_cmd_t *sets;
+  volatile gint *set_queued;
+  /* io thread only, the last write per device and when it was done. A
+   * notification that finds the device at that volume is our own echo */
+  int *written;
+  gint64 *written_at;
+  /* MIXER_HEALTHY and so on, set by the io thread */
+  volatile gint health;
+  /* io thread only: consecutive failed calls, whether the current call
+   * failed, and the probe of an offline mixer */
+  int failures;
+  gboolean in_call, call_failed;
+  guint probe_id;
+  int probe_interval;
+  /* changes on their way to the main loop: per device, for the health, and
+   * whether there is any, see io_deliver */
+  volatile gint *notify_pending;
+  volatile gint notify_health;
+  volatile gint notify_any;
+  GSource *notify_source;
+} mixer_state_t;
+
+/* the channels of devid in one of the tables */
+#define DEVICE_VOLUMES(table, devid) (&(table)[(devid) * MIXER_MAX_CHANNELS])
+
+/* how long after a write the backend may still report it back */
+#define ECHO_WINDOW_US (G_USEC_PER_SEC / 2)
+
+/* failed calls in a row before a mixer is taken offline, and the limits of
+ * the time between two probes of an offline mixer */
+#define OFFLINE_FAILURES 3
+#define PROBE_MIN_MS 1000
+#define PROBE_MAX_MS 60000
+
+/* delivers the notifications of one mixer in the main loop */
+typedef struct {
+  GSource source;
+  mixer_t *mixer;
+} mixer_notify_source_t;
+
+static GMainContext *io_context = NULL;
+static mixer_cmd_t * volatile io_cmds = NULL;
+static GMutex io_done_mutex;
+static GCond io_done_cond;
+
+GMainContext *
+mixer_get_context(void) {
+  return io_context;
+}
+
+static void
+io_push(mixer_cmd_t *cmd) {
+  mixer_cmd_t *head;
+
+  do {
+    head = g_atomic_pointer_get(&io_cmds);
+    cmd->next = head;
+  } while (!g_atomic_pointer_compare_and_exchange(&io_cmds, head, cmd));
+  g_main_context_wakeup(io_context);
+}
+
+/* pushes a command and waits for the io thread to finish it */
+static void
+io_push_wait(mixer_cmd_t *cmd) {
+  cmd->done = FALSE;
+  io_push(cmd);
+  g_mutex_lock(&io_done_mutex);
+  while (!cmd->done)
+    g_cond_wait(&io_done_cond, &io_done_mutex);
+  g_mutex_unlock(&io_done_mutex);
+}
+
+/* io thread only */
+static void
+io_publish(mixer_t *mixer, int devid, const int *volumes) {
+  mixer_state_t *st = mixer->state;
+  int front = g_atomic_int_get(&st->front);
+  int back = !front;
+
+  g_atomic_int_inc(&st->seq);
+  memcpy(st->volumes[back], st->volumes[front],
+         sizeof(int) * MIXER_MAX_CHANNELS * mixer->nrdevices);
+  memcpy(DEVICE_VOLUMES(st->volumes[back], devid), volumes,
+         sizeof(int) * MIXER_MAX_CHANNELS);
+  g_atomic_int_set(&st->front, back);
+  g_atomic_int_inc(&st->seq);
+}
+
+/* hands a notification to the main loop. Only flags are set, so a burst of
+ * changes to a device ends up as one notification and nothing is allocated */
+static void
+io_deliver(mixer_t *mixer, int devid) {
+  mixer_state_t *st = mixer->state;
+
+  if (devid < 0)
+    g_atomic_int_set(&st->notify_health, 1);
+  else
+    g_atomic_int_set(&st->notify_pending[devid], 1);
+  g_atomic_int_set(&st->notify_any, 1);
+  g_main_context_wakeup(NULL);
+}
+
+static void
+io_set_health(mixer_t *mixer, int health) {
+  if (g_atomic_int_get(&mixer->state->health) == health)
+    return;
+  g_atomic_int_set(&mixer->state->health, health);
+  io_deliver(mixer, -1);
+}
+
+static gboolean io_probe(gpointer data);
+
+static void
+io_schedule_probe(mixer_t *mixer) {
+  mixer_state_t *st = mixer->state;
+  GSource *timeout;
+
+  if (st->probe_id != 0)
+    return;
+  timeout = g_timeout_source_new(st->probe_interval);
+  g_source_set_callback(timeout, io_probe, mixer, NULL);
+  st->probe_id = g_source_attach(timeout, io_context);
+  g_source_unref(timeout);
+}
+
+static void
+io_call_begin(mixer_t *mixer) {
+  mixer->state->call_failed = FALSE;
+  mixer->state->in_call = TRUE;
+}
+
+/* accounts for the outcome of the backend call that just returned */
+static gboolean
+io_call_done(mixer_t *mixer) {
+  mixer_state_t *st = mixer->state;
+
+  st->in_call = FALSE;
+  if (!st->call_failed) {
+    st->failures = 0;
+    st->probe_interval = PROBE_MIN_MS;
+    io_set_health(mixer, MIXER_HEALTHY);
+    return TRUE;
+  }
+  st->call_failed = FALSE;
+  if (++st->failures < OFFLINE_FAILURES) {
+    io_set_health(mixer, MIXER_DEGRADED);
+  } else {
+    io_set_health(mixer, MIXER_OFFLINE);
+    io_schedule_probe(mixer);
+  }
+  return FALSE;
+}
+
+static gboolean
+io_offline(mixer_t *mixer) {
+  return g_atomic_int_get(&mixer->state->health) == MIXER_OFFLINE;
+}
+
+/* keeps the last good volume if the read failed */
+static gboolean
+io_read_device(mixer_t *mixer, int devid, int *volumes) {
+  int left = 0, right = 0;
+
+  memset(volumes, 0, sizeof(int) * MIXER_MAX_CHANNELS);
+  io_call_begin(mixer);
+  if (mixer->ops->mixer_device_get_channels != NULL)
+    mixer->ops->mixer_device_get_channels(mixer, devid, volumes);
+  else
+    mixer->ops->mixer_device_get_volume(mixer, devid, &left, &right);
+  if (!io_call_done(mixer))
+    return FALSE;
+  if (mixer->ops->mixer_device_get_channels == NULL)
+    mixer_stereo_to_channels(&mixer->devices[devid], left, right, volumes);
+  io_publish(mixer, devid, volumes);
+  return TRUE;
+}
+
+static gboolean
+io_write_device(mixer_t *mixer, int devid, const int *volumes) {
+  int left, right;
+
+  io_call_begin(mixer);
+  if (mixer->ops->mixer_device_set_channels != NULL) {
+    mixer->ops->mixer_device_set_channels(mixer, devid, volumes);
+  } else {
+    mixer_channels_to_stereo(&mixer->devices[devid], volumes, &left, &right);
+    mixer->ops->mixer_device_set_volume(mixer, devid, left, right);
+  }
+  return io_call_done(mixer);
+}
+
+/* an offline mixer is only read from here, backing off while it stays
+ * unreachable */
+static gboolean
+io_probe(gpointer data) {
+  mixer_t *mixer = (mixer_t *) data;
+  mixer_state_t *st = mixer->state;
+  int i, volumes[MIXER_MAX_CHANNELS];
+
+  st->probe_id = 0;
+  if (!io_read_device(mixer, 0, volumes)) {
+    st->probe_interval = MIN(st->probe_interval * 2, PROBE_MAX_MS);
+    io_schedule_probe(mixer);
+    return FALSE;
+  }
+  /* back, everything might have changed meanwhile */
+  for (i = 0; i < mixer->nrdevices; i++)
+    if (io_read_device(mixer, i, volumes))
+      io_deliver(mixer, i);
+  return FALSE;
+}
+
+/* does the device sit where our last write put it */
+static gboolean
+io_is_echo(mixer_t *mixer, int devid, const int *volumes) {
+  mixer_state_t *st = mixer->state;
+
+  return st->written_at[devid] != 0 &&
+         g_get_monotonic_time() - st->written_at[devid] < ECHO_WINDOW_US &&
+         !memcmp(DEVICE_VOLUMES(st->written, devid), volumes,
+                 sizeof(int) * mixer->devices[devid].channels);
+}
+
+/* the device table of a freshly opened mixer */
+static void
+io_describe(mixer_t *mixer) {
+  mixer_device_t *d;
+  int i;
+
+  mixer->devices = g_new0(mixer_device_t, MAX(mixer->nrdevices, 1));
+  for (i = 0; i < mixer->nrdevices; i++) {
+    d = &mixer->devices[i];
+    d->fullscale = mixer->ops->mixer_device_get_fullscale(mixer, i);
+    d->kind = d->fullscale == 1 ? MIXER_SWITCH : MIXER_VOLUME;
+    d->channels = 2;
+    d->position[0] = MIXER_CH_FRONT_LEFT;
+    d->position[1] = MIXER_CH_FRONT_RIGHT;
+    d->max = d->fullscale;
+    if (mixer->ops->mixer_device_describe != NULL)
+      mixer->ops->mixer_device_describe(mixer, i, d);
+    d->channels = CLAMP(d->channels, 1, MIXER_MAX_CHANNELS);
+    /* a single channel is neither left nor right */
+    if (d->channels == 1)
+      d->position[0] = MIXER_CH_MONO;
+  }
+}
+
+static mixer_state_t *
+mixer_state_new(mixer_t *mixer) {
+  mixer_state_t *st = g_new0(mixer_state_t, 1);
+  int i, n = mixer->nrdevices > 0 ? mixer->nrdevices : 1;
+
+  st->volumes[0] = g_new0(int, n * MIXER_MAX_CHANNELS);
+  st->volumes[1] = g_new0(int, n * MIXER_MAX_CHANNELS);
+  st->pending = g_new0(gint, n);
+  st->wanted = g_new0(int, n * MIXER_MAX_CHANNELS);
+  st->written = g_new0(int, n * MIXER_MAX_CHANNELS);
+  st->written_at = g_new0(gint64, n);
+  st->notify_pending = g_new0(gint, n);
+  st->sets = g_new0(mixer_cmd_t, n);
+  st->set_queued = g_new0(gint, n);
+  for (i = 0; i < n; i++) {
+    st->sets[i].type = CMD_SET;
+    st->sets[i].mixer = mixer;
+    st->sets[i].devid = i;
+  }
+  st->refresh.type = CMD_REFRESH;
+  st->refresh.mixer = mixer;
+  st->probe_interval = PROBE_MIN_MS;
+  return st;
+}
+
+static void
+mixer_state_free(mixer_state_t *st) {
+  g_free(st->volumes[0]);
+  g_free(st->volumes[1]);
+  g_free((gpointer) st->pending);
+  g_free(st->wanted);
+  g_free(st->written);
+  g_free(st->written_at);
+  g_free((gpointer) st->notify_pending);
+  g_free(st->sets);
+  g_free((gpointer) st->set_queued);
+  g_free(st);
+}
+
+/* what the main loop last asked of devid */
+static void
+io_read_wanted(mixer_state_t *st, int devid, int *volumes) {
+  int seq;
+
+  do {
+    seq = g_atomic_int_get(&st->wanted_seq);
+    memcpy(volumes, DEVICE_VOLUMES(st->wanted, devid),
+           sizeof(int) * MIXER_MAX_CHANNELS);
+  } while ((seq & 1) || seq != g_atomic_int_get(&st->wanted_seq));
+}
+
+/* one queued write, an offline mixer isn't bothered until a probe finds it
+ * again */
+static void
+io_set(mixer_t *mixer, int devid, const int *volumes) {
+  mixer_state_t *st = mixer->state;
+  int read[MIXER_MAX_CHANNELS];
+
+  if (!io_offline(mixer) && io_write_device(mixer, devid, volumes)) {
+    memcpy(DEVICE_VOLUMES(st->written, devid), volumes,
+           sizeof(int) * MIXER_MAX_CHANNELS);
+    st->written_at[devid] = g_get_monotonic_time();
+    /* the backend reports what it made of the write itself, others are
+     * read back */
+    if (mixer->notifies)
+      io_publish(mixer, devid, volumes);
+    else
+      io_read_device(mixer, devid, read);
+  }
+  g_atomic_int_add(&st->pending[devid], -1);
+}
+
+static void
+io_run(mixer_cmd_t *cmd) {
+  mixer_t *mixer = cmd->mixer;
+  int i, volumes[MIXER_MAX_CHANNELS];
+  gboolean batched;
+
+  switch (cmd->type) {
+    case CMD_OPEN:
+      mixer = cmd->result = backend_open(cmd->id);
+      if (mixer != NULL) {
+        io_describe(mixer);
+        mixer->state = mixer_state_new(mixer);
+        for (i = 0; i < mixer->nrdevices; i++)
+          io_read_device(mixer, i, volumes);
+      }
+      break;
+    case CMD_CLOSE:
+      if (mixer->state->probe_id != 0)
+        g_source_destroy(g_main_context_find_source_by_id(io_context,
+                                               mixer->state->probe_id));
+      mixer->ops->mixer_close(mixer);
+      break;
+    case CMD_SET:
+      /* cleared first, a set from now on queues the command again. While
+       * dragging only the last position gets written */
+      g_atomic_int_set(&mixer->state->set_queued[cmd->devid], 0);
+      io_read_wanted(mixer->state, cmd->devid, volumes);
+      io_set(mixer, cmd->devid, volumes);
+      break;
+    case CMD_BATCH:
+      batched = !io_offline(mixer) && mixer->ops->mixer_batch_begin != NULL;
+      if (batched)
+        mixer->ops->mixer_batch_begin(mixer);
+      /* like CMD_SET the newest volume, a set queued before the batch may
+       * have taken over a later one meanwhile */
+      for (i = 0; i < cmd->nr; i++) {
+        io_read_wanted(mixer->state, cmd->devids[i], volumes);
+        io_set(mixer, cmd->devids[i], volumes);
+      }
+      if (batched)
+        mixer->ops->mixer_batch_end(mixer);
+      break;
+    case CMD_REFRESH:
+      g_atomic_int_set(&mixer->state->refresh_pending, 0);
+      for (i = 0; i < mixer->nrdevices && !io_offline(mixer); i++)
+        io_read_device(mixer, i, volumes);
+      break;
+    case CMD_WANT:
+      mixer->ops->mixer_device_want(mixer, cmd->devid);
+      /* reports the volume if it wasn't loaded before */
+      mixer_notify(mixer, cmd->devid);
+      break;
+  }
+}
+
+static gboolean
+io_source_prepare(GSource *source, gint *timeout) {
+  *timeout = -1;
+  return g_atomic_pointer_get(&io_cmds) != NULL;
+}
+
+static gboolean
+io_source_check(GSource *source) {
+  return g_atomic_pointer_get(&io_cmds) != NULL;
+}
+
+static gboolean
+io_source_dispatch(GSource *source, GSourceFunc callback, gpointer data) {
+  mixer_cmd_t *cmds, *cmd, *next, *batch = NULL;
+
+  /* take everything at once, the stack is newest first */
+  do {
+    cmds = g_atomic_pointer_get(&io_cmds);
+  } while (!g_atomic_pointer_compare_and_exchange(&io_cmds, cmds, NULL));
+  for (cmd = cmds; cmd != NULL; cmd = next) {
+    next = cmd->next;
+    cmd->next = batch;
+    batch = cmd;
+  }
+
+  for (cmd = batch; cmd != NULL; cmd = next) {
+    next = cmd->next;
+    io_run(cmd);
+    if (cmd->type == CMD_OPEN || cmd->type == CMD_CLOSE) {
+      /* the waiting thread owns cmd, don't touch it after this */
+      g_mutex_lock(&io_done_mutex);
+      cmd->done = TRUE;
+      g_cond_broadcast(&io_done_cond);
+      g_mutex_unlock(&io_done_mutex);
+    } else if (cmd->type != CMD_REFRESH && cmd->type != CMD_SET) {
+      /* refreshes and sets live in the mixer state */
+      g_free(cmd);
+    }
+  }
+  return TRUE;
+}
+
+static GSourceFuncs io_source_funcs = {
+  io_source_prepare,
+  io_source_check,
+  io_source_dispatch,
+  NULL
+};
+
+static gpointer
+io_thread(gpointer data) {
+  GMainLoop *loop = g_main_loop_new(io_context, FALSE);
+
+  g_main_context_push_thread_default(io_context);
+  g_main_loop_run(loop);
+  return NULL;
+}
+
+static void
+mixer_io_start(void) {
+  GSource *source;
+
+  if (io_context != NULL)
+    return;
+  io_context = g_main_context_new();
+  source = g_source_new(&io_source_funcs, sizeof(GSource));
+  g_source_attach(source, io_context);
+  g_source_unref(source);
+  g_thread_new("volume-io", io_thread, NULL);
+}
+
+static gboolean
+notify_source_prepare(GSource *source, gint *timeout) {
+  mixer_notify_source_t *ns = (mixer_notify_source_t *) source;
+
+  *timeout = -1;
+  return g_atomic_int_get(&ns->mixer->state->notify_any);
+}
+
+static gboolean
+notify_source_check(GSource *source) {
+  mixer_notify_source_t *ns = (mixer_notify_source_t *) source;
+
+  return g_atomic_int_get(&ns->mixer->state->notify_any);
+}
+
+static gboolean
+notify_source_dispatch(GSource *source, GSourceFunc callback, gpointer data) {
+  mixer_t *mixer = ((mixer_notify_source_t *) source)->mixer;
+  mixer_state_t *st = mixer->state;
+  int i;
+
+  /* cleared first, a flag set meanwhile makes the source run again */
+  g_atomic_int_set(&st->notify_any, 0);
+  if (g_atomic_int_compare_and_exchange(&st->notify_health, 1, 0) &&
+      mixer->notify != NULL)
+    mixer->notify(mixer, -1, mixer->notify_data);
+  for (i = 0; i < mixer->nrdevices; i++)
+    if (g_atomic_int_compare_and_exchange(&st->notify_pending[i], 1, 0) &&
+        mixer->notify != NULL)
+      mixer->notify(mixer, i, mixer->notify_data);
+  return TRUE;
+}
+
+static GSourceFuncs notify_source_funcs = {
+  notify_source_prepare,
+  notify_source_check,
+  notify_source_dispatch,
+  NULL
+};
+
+mixer_t *
+mixer_open(char *id) {
+  mixer_cmd_t cmd;
+  GSource *source;
+  gint64 start = trace_start();
+
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.type = CMD_OPEN;
+  cmd.id = id;
+  io_push_wait(&cmd);
+  trace_end("mixer_open", id, start);
+  if (cmd.result != NULL) {
+    source = g_source_new(&notify_source_funcs,
+                          sizeof(mixer_notify_source_t));
+    ((mixer_notify_source_t *) source)->mixer = cmd.result;
+    g_source_attach(source, NULL);
+    cmd.result->state->notify_source = source;
+  }
+  return cmd.result;
+}
+
+void
+mixer_close(mixer_t *mixer) {
+  mixer_cmd_t cmd;
+  mixer_state_t *st = mixer->state;
+  mixer_device_t *devices = mixer->devices;
+
+  /* notifications still on their way are dropped with the source */
+  g_source_destroy(st->notify_source);
+  g_source_unref(st->notify_source);
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.type = CMD_CLOSE;
+  cmd.mixer = mixer;
+  io_push_wait(&cmd);
+  /* the backend freed the mixer itself */
+  mixer_state_free(st);
+  g_free(devices);
+}
+
+void
+mixer_get_device_channels(mixer_t *mixer, int devid, int *volumes) {
+  mixer_state_t *st = mixer->state;
+  int seq, front;
+
+  if (g_atomic_int_get(&st->pending[devid]) > 0) {
+    memcpy(volumes, DEVICE_VOLUMES(st->wanted, devid),
+           sizeof(int) * MIXER_MAX_CHANNELS);
+    return;
+  }
+  do {
+    seq = g_atomic_int_get(&st->seq);
+    front = g_atomic_int_get(&st->front);
+    memcpy(volumes, DEVICE_VOLUMES(st->volumes[front], devid),
+           sizeof(int) * MIXER_MAX_CHANNELS);
+  } while ((seq & 1) || seq != g_atomic_int_get(&st->seq));
 }
+
 void
 mixer_get_device_volume(mixer_t *mixer, int devid, int *left, int *right) {
-  mixer->ops->mixer_device_get_volume(mixer, devid, left, right);
+  int volumes[MIXER_MAX_CHANNELS];
+
+  mixer_get_device_channels(mixer, devid, volumes);
+  mixer_channels_to_stereo(&mixer->devices[devid], volumes, left, right);
+}
+
+/* main loop only */
+static void
+mixer_write_wanted(mixer_state_t *st, int devid, const int *volumes) {
+  g_atomic_int_inc(&st->wanted_seq);
+  memcpy(DEVICE_VOLUMES(st->wanted, devid), volumes,
+         sizeof(int) * MIXER_MAX_CHANNELS);
+  g_atomic_int_inc(&st->wanted_seq);
+}
+
+void
+mixer_set_device_channels(mixer_t *mixer, int devid, const int *volumes) {
+  mixer_state_t *st = mixer->state;
+
+  mixer_write_wanted(st, devid, volumes);
+  /* a queued set picks the new volume up */
+  if (!g_atomic_int_compare_and_exchange(&st->set_queued[devid], 0, 1))
+    return;
+  g_atomic_int_inc(&st->pending[devid]);
+  io_push(&st->sets[devid]);
+}
+
+void
+mixer_set_devices_channels(mixer_t *mixer, int n, const int *devids,
+                           const int *volumes) {
+  mixer_state_t *st = mixer->state;
+  mixer_cmd_t *cmd;
+  int i;
+
+  if (n <= 0)
+    return;
+  /* the devids live right behind the command, freed with it */
+  cmd = g_malloc0(sizeof(mixer_cmd_t) + n * sizeof(int));
+  cmd->devids = (int *) (cmd + 1);
+  memcpy(cmd->devids, devids, n * sizeof(int));
+  for (i = 0; i < n; i++) {
+    mixer_write_wanted(st, devids[i], DEVICE_VOLUMES(volumes, i));
+    g_atomic_int_inc(&st->pending[devids[i]]);
+  }
+
+  cmd->type = CMD_BATCH;
+  cmd->mixer = mixer;
+  cmd->nr = n;
+  io_push(cmd);
 }
 
 void
 mixer_set_device_volume(mixer_t *mixer, int devid,int left,int right) {
-  mixer->ops->mixer_device_set_volume(mixer, devid, left, right);
+  int volumes[MIXER_MAX_CHANNELS];
+
+  mixer_stereo_to_channels(&mixer->devices[devid], left, right, volumes);
+  mixer_set_device_channels(mixer, devid, volumes);
+}
+
+void
+mixer_refresh(mixer_t *mixer) {
+  /* one queued refresh is enough, so the command can be reused and polling
+   * doesn't allocate */
+  if (!g_atomic_int_compare_and_exchange(&mixer->state->refresh_pending, 0, 1))
+    return;
+  io_push(&mixer->state->refresh);
+}
+
+void
+mixer_want_device(mixer_t *mixer, int devid) {
+  mixer_cmd_t *cmd;
+
+  if (mixer->ops->mixer_device_want == NULL)
+    return;
+  cmd = g_new0(mixer_cmd_t, 1);
+  cmd->type = CMD_WANT;
+  cmd->mixer = mixer;
+  cmd->devid = devid;
+  io_push(cmd);
+}
+
+void
+mixer_notify(mixer_t *mixer, int devid) {
+  mixer_state_t *st = mixer->state;
+  int volumes[MIXER_MAX_CHANNELS], old[MIXER_MAX_CHANNELS];
+
+  /* events while still opening are covered by the initial read */
+  if (st == NULL)
+    return;
+  /* only this thread publishes, so the front table is stable here */
+  memcpy(old, DEVICE_VOLUMES(st->volumes[st->front], devid), sizeof(old));
+  if (!io_read_device(mixer, devid, volumes))
+    return;
+  /* nothing changed (another device on the same control did), it's the echo
+   * of our own write, or a write is still queued: the slider already shows
+   * it */
+  if (!memcmp(volumes, old, sizeof(int) * mixer->devices[devid].channels) ||
+      io_is_echo(mixer, devid, volumes) ||
+      g_atomic_int_get(&st->pending[devid]) > 0)
+    return;
+  io_deliver(mixer, devid);
+}
+
+void
+mixer_failed(mixer_t *mixer) {
+  /* failures while opening just make the open fail */
+  if (mixer->state == NULL)
+    return;
+  mixer->state->call_failed = TRUE;
+  /* reported from an event handler, not from within a call */
+  if (!mixer->state->in_call)
+    io_call_done(mixer);
+}
+
+int
+mixer_get_health(mixer_t *mixer) {
+  return g_atomic_int_get(&mixer->state->health);
 }
 
 /* get an linked list of usable mixer devices */
 mixer_idz_t *
 mixer_get_id_list(void) {
-  mixer_idz_t *result = NULL;
-#ifdef WIN32
-  result = win32_mixer->mixer_get_id_list();
-#else
-  #ifdef BLUETOOTH
-  /* Get Bluetooth devices */
-  result = bluetooth_mixer->mixer_get_id_list();
-  #endif
-  #ifdef ALSA
-  /* Add ALSA devices */
-  mixer_idz_t *alsa_list = alsa_mixer->mixer_get_id_list();
-  if (alsa_list != NULL) {
-    if (result == NULL) {
-      result = alsa_list;
-    } else {
-      /* Append ALSA list to result */
-      mixer_idz_t *tmp = result;
-      while (tmp->next != NULL) tmp = tmp->next;
-      tmp->next = alsa_list;
-    }
-  }
-  #endif
-  /* Add OSS devices */
-  mixer_idz_t *oss_list = oss_mixer->mixer_get_id_list();
-  if (oss_list != NULL) {
-    if (result == NULL) {
-      result = oss_list;
-    } else {
-      /* Append OSS list to result */
-      mixer_idz_t *tmp = result;
-      while (tmp->next != NULL) tmp = tmp->next;
-      tmp->next = oss_list;
+  mixer_idz_t *result = NULL, *list, *l;
+  mixer_ops_t *ops;
+  gchar *id;
+  size_t i;
+
+  for (i = 0; i < NR_BACKENDS; i++) {
+    if ((ops = backend_ops(&backends[i])) == NULL)
+      continue;
+    list = ops->mixer_get_id_list();
+    for (l = list; l != NULL; l = l->next) {
+      if (backends[i].keep_scheme) {
+        result = mixer_id_list_add(l->id, result);
+      } else {
+        id = g_strconcat(backends[i].scheme, ":", l->id, NULL);
+        result = mixer_id_list_add(id, result);
+        g_free(id);
+      }
     }
+    mixer_free_idz(list);
   }
-#endif
   return result;
 }
 
@@ -28,6 +28,51 @@ struct _mixer_idz_t {
 };
 
 typedef struct _mixer_t mixer_t; 
+/* called when a device changed behind our back, devid is -1 when the health
+ * of the mixer changed */
+typedef void (*mixer_notify_func)(mixer_t *mixer, int devid, void *data);
+
+/* what a device is, described once when its mixer is opened */
+enum {
+  MIXER_VOLUME = 0,
+  /* on (1) or off (0) */
+  MIXER_SWITCH
+};
+/* where a channel sits, in the order ALSA numbers them after MONO */
+enum {
+  MIXER_CH_MONO = 0,
+  MIXER_CH_FRONT_LEFT,
+  MIXER_CH_FRONT_RIGHT,
+  MIXER_CH_REAR_LEFT,
+  MIXER_CH_REAR_RIGHT,
+  MIXER_CH_FRONT_CENTER,
+  MIXER_CH_LFE,
+  MIXER_CH_SIDE_LEFT,
+  MIXER_CH_SIDE_RIGHT,
+  MIXER_CH_REAR_CENTER,
+  MIXER_CH_LAST
+};
+/* channels of a device beyond this are driven like the last one */
+#define MIXER_MAX_CHANNELS 8
+
+/* device flags */
+#define MIXER_DEVICE_CAPTURE (1 << 0)
+/* the backend knows the dB scale of the device */
+#define MIXER_DEVICE_DB (1 << 1)
+
+typedef struct {
+  /* volumes go from 0 to fullscale */
+  long fullscale;
+  /* 1 for mono devices, up to MIXER_MAX_CHANNELS */
+  int channels;
+  /* MIXER_CH_* per channel */
+  unsigned char position[MIXER_MAX_CHANNELS];
+  int kind;
+  /* the hardware range behind 0..fullscale, 0..fullscale if unknown */
+  long min, max;
+  int flags;
+} mixer_device_t;
+
 typedef struct {
   mixer_idz_t *(*mixer_get_id_list)(void);
   mixer_t *(*mixer_open)(char *id);
@@ -37,6 +82,22 @@ typedef struct {
                                   int *left, int *right);
   void    (*mixer_device_set_volume)(mixer_t *mixer, int devid, 
                                      int left, int right);
+  /* optional, the device is going to be used. Backends that only load what
+   * is used until then implement it */
+  void (*mixer_device_want)(mixer_t *mixer, int devid);
+  /* optional, fills in what it knows beyond the full scale. desc comes with
+   * defaults: a stereo volume, or a switch if the full scale is 1 */
+  void (*mixer_device_describe)(mixer_t *mixer, int devid,
+                                mixer_device_t *desc);
+  /* optional, all channels of a device at once, as many as it described.
+   * Without them the channels are folded into the left/right calls */
+  void (*mixer_device_get_channels)(mixer_t *mixer, int devid, int *volumes);
+  void (*mixer_device_set_channels)(mixer_t *mixer, int devid,
+                                    const int *volumes);
+  /* optional, around the writes of mixer_set_devices_channels, so they can
+   * go to the hardware or server at once */
+  void (*mixer_batch_begin)(mixer_t *mixer);
+  void (*mixer_batch_end)(mixer_t *mixer);
 } mixer_ops_t;
 
 struct _mixer_t {
@@ -50,9 +111,26 @@ struct _mixer_t {
 
   mixer_ops_t *ops;
   void *priv;
+
+  /* per device, filled in by mixer_open and constant after that */
+  mixer_device_t *devices;
+
+  mixer_notify_func notify;
+  void *notify_data;
+  /* set by backends that call mixer_notify for every change, those don't
+   * need to be polled */
+  int notifies;
+
+  /* published volumes and queued writes, private to mixer.c */
+  struct _mixer_state_t *state;
 }; 
 
+/* All backend I/O happens in a separate io thread, so a slow backend never
+ * blocks the caller. Volumes are read from a table the io thread publishes,
+ * volume changes are queued. Opening and closing wait for the io thread. */
 void init_mixer(void);
+/* main context of the io thread, backends attach their event sources to it */
+GMainContext *mixer_get_context(void);
 /* tries to open a mixer device, returns NULL on error or otherwise an mixer_t
  * struct */
 mixer_t *mixer_open(char *id);
@@ -73,13 +151,88 @@ char *mixer_get_device_real_name(mixer_t *mixer,int devid);
 char *mixer_get_device_name(mixer_t *mixer,int devid);
 void  mixer_set_device_name(mixer_t *mixer,int devid,char *name);
 
+/* the description of a device, without a call into the backend */
+const mixer_device_t *mixer_get_device(mixer_t *mixer, int devid);
 /* get the full scale of a device and get/set the volume */
 long   mixer_get_device_fullscale(mixer_t *mixer,int devid);
 void  mixer_get_device_volume(mixer_t *mixer, int devid,int *left,int *right);
 void mixer_set_device_volume(mixer_t *mixer, int devid,int left,int right);
+/* the same for every channel, volumes holds MIXER_MAX_CHANNELS entries of
+ * which the first mixer_get_device(mixer, devid)->channels are used. The
+ * left/right calls above fold the channels on the left side, center and
+ * right side into two */
+void mixer_get_device_channels(mixer_t *mixer, int devid, int *volumes);
+void mixer_set_device_channels(mixer_t *mixer, int devid, const int *volumes);
+/* sets n devices of the mixer in one batch, volumes holds MIXER_MAX_CHANNELS
+ * entries per device */
+void mixer_set_devices_channels(mixer_t *mixer, int n, const int *devids,
+                                const int *volumes);
+
+/* Integer conversions shared by the backends and the plugin, rounded to the
+ * nearest step and clamped to the range. Percent -> raw -> percent gives the
+ * same percent back if the range has at least 100 steps, raw -> percent ->
+ * raw the same raw value if it has at most 100, so rereading what was just
+ * written never looks like a change */
+/* value in [0..from] to [0..to] */
+long mixer_rescale(long value, long from, long to);
+int mixer_raw_to_percent(long raw, long min, long max);
+long mixer_percent_to_raw(int percent, long min, long max);
+
+/* Channel arithmetic, without any calls into the mixer. balance goes from
+ * -100 (left only) to 100 (right only), fader from -100 (front only) to 100
+ * (rear only) */
+/* sets every channel of the device for volume, balance and fader */
+void mixer_scale_channels(const mixer_device_t *desc, int volume,
+                          int balance, int fader, int *volumes);
+/* the other way around: the loudest channel, balance and fader */
+void mixer_measure_channels(const mixer_device_t *desc, const int *volumes,
+                            int *volume, int *balance, int *fader);
+/* left and right from the channels and back */
+void mixer_channels_to_stereo(const mixer_device_t *desc, const int *volumes,
+                              int *left, int *right);
+void mixer_stereo_to_channels(const mixer_device_t *desc, int left,
+                              int right, int *volumes);
+/* TRUE if the device has channels behind the listener */
+gboolean mixer_device_has_rear(const mixer_device_t *desc);
+
+/* has the io thread reread all devices of the mixer, for backends that don't
+ * report changes themselves */
+void mixer_refresh(mixer_t *mixer);
+/* tells the backend a device is going to be shown. Until then it may not
+ * have loaded the device and read it as 0 */
+void mixer_want_device(mixer_t *mixer, int devid);
+
+/* get notified about changes of the devices of a mixer. Only backends that
+ * are event driven call it, others have to be polled. The notification is
+ * delivered in the main loop, several changes of a device in between come
+ * as one. func must not close the mixer */
+void mixer_set_notify(mixer_t *mixer, mixer_notify_func func, void *data);
+/* for use by the backends, from the io thread. Rereads the device, the
+ * notification is dropped when the volume didn't change or is the echo of
+ * one of our own writes */
+void mixer_notify(mixer_t *mixer, int devid);
+/* TRUE if the backend reports all changes itself */
+gboolean mixer_notifies(mixer_t *mixer);
+
+/* Health of a mixer. A failed call makes it degraded, a few in a row take it
+ * offline: then volumes aren't read or written anymore, it's only probed
+ * with a growing interval until it answers again */
+enum {
+  MIXER_HEALTHY = 0,
+  MIXER_DEGRADED,
+  MIXER_OFFLINE
+};
+int mixer_get_health(mixer_t *mixer);
+/* for use by the backends, from the io thread: the current call (or event
+ * handling) failed */
+void mixer_failed(mixer_t *mixer);
 
-/* get an linked list of usable mixer devices */
+/* get an linked list of usable mixer devices, their ids start with the
+ * scheme of their backend ("alsa:hw:0") */
 mixer_idz_t *mixer_get_id_list();
+/* the id with its backend scheme, for ids from older configs that have
+ * none. Free with g_free */
+char *mixer_id_canonical(const char *id);
 mixer_idz_t *mixer_id_list_add(char *id,mixer_idz_t *list);
 void mixer_free_idz(mixer_idz_t *idz);
 
@@ -65,7 +65,7 @@ oss_mixer_open(char *id) {
   }
 #endif
 
-  result = malloc(sizeof(mixer_t));
+  result = calloc(1, sizeof(mixer_t));
 #ifdef SOUND_MIXER_INFO
   result->name = strdup(minfo.name);
 #else
@@ -121,10 +121,25 @@ oss_mixer_device_get_fullscale(mixer_t *mixer,int devid) {
   return 100;
 }
 
+static void
+oss_mixer_device_describe(mixer_t *mixer, int devid, mixer_device_t *desc) {
+  int dev = OSSMIXER(mixer)->table[devid];
+  int stereo;
+
+  if (ioctl(OSSMIXER(mixer)->fd,SOUND_MIXER_READ_STEREODEVS,&stereo) >= 0 &&
+      !(stereo & (1 << dev)))
+    desc->channels = 1;
+  if (dev == SOUND_MIXER_RECLEV || dev == SOUND_MIXER_IGAIN)
+    desc->flags |= MIXER_DEVICE_CAPTURE;
+}
+
 static void 
 oss_mixer_device_get_volume(mixer_t *mixer, int devid,int *left,int *right) {
   long amount;
-  ioctl(OSSMIXER(mixer)->fd,MIXER_READ(OSSMIXER(mixer)->table[devid]),&amount);
+  if (ioctl(OSSMIXER(mixer)->fd,MIXER_READ(OSSMIXER(mixer)->table[devid]),&amount) < 0) {
+    mixer_failed(mixer);
+    return;
+  }
   *left = amount & 0xff;
   *right = amount >> 8;
 }
@@ -132,7 +147,8 @@ oss_mixer_device_get_volume(mixer_t *mixer, int devid,int *left,int *right) {
 static void  
 oss_mixer_device_set_volume(mixer_t *mixer, int devid,int left,int right) {
   long amount = (right << 8) + (left & 0xff);
-  ioctl(OSSMIXER(mixer)->fd,MIXER_WRITE(OSSMIXER(mixer)->table[devid]),&amount);
+  if (ioctl(OSSMIXER(mixer)->fd,MIXER_WRITE(OSSMIXER(mixer)->table[devid]),&amount) < 0)
+    mixer_failed(mixer);
 }
 
 static mixer_idz_t *
@@ -163,7 +179,8 @@ static mixer_ops_t oss_mixer_ops = {
   .mixer_close = oss_mixer_close,
   .mixer_device_get_fullscale = oss_mixer_device_get_fullscale,
   .mixer_device_get_volume = oss_mixer_device_get_volume,
-  .mixer_device_set_volume = oss_mixer_device_set_volume
+  .mixer_device_set_volume = oss_mixer_device_set_volume,
+  .mixer_device_describe = oss_mixer_device_describe
 };
 
 static mixer_ops_t *
@@ -0,0 +1,620 @@
+/* GKrellM Volume plugin - PulseAudio/PipeWire mixer support
+ |  Copyright (C) 2025
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* Talks to the sound server through libpulse, which PipeWire implements as
+ * well. The mixer id is "pulse" for the default server or "pulse:<server>"
+ * for a specific one. Every sink and every source (except monitors) is a
+ * device. Volumes are kept up to date through the server's subscription
+ * events, so reading a volume never talks to the server. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pulse/pulseaudio.h>
+#include <pulse/thread-mainloop.h>
+
+#include "mixer.h"
+#include "pulse_mixer.h"
+
+#define PULSEMIXER(x) ((pulse_mixer_t *)x->priv)
+#define PULSE_ID "pulse"
+
+static mixer_ops_t *get_mixer_ops(void);
+static void pulse_mixer_close(mixer_t *mixer);
+
+/* state while opening, the lists are filled from the mainloop thread */
+typedef struct {
+  pa_threaded_mainloop *loop;
+  GArray *devices;
+  char *name;
+} pulse_open_t;
+
+static void
+pulse_error(const char *fmt, ...) {
+  va_list va;
+
+  va_start(va, fmt);
+  fprintf(stderr, "gkrellm-volume pulse: ");
+  vfprintf(stderr, fmt, va);
+  fprintf(stderr, "\n");
+  va_end(va);
+}
+
+static int
+to_percent(pa_volume_t v) {
+  return mixer_raw_to_percent(v, PA_VOLUME_MUTED, PA_VOLUME_NORM);
+}
+
+static pa_volume_t
+from_percent(int p) {
+  return mixer_percent_to_raw(p, PA_VOLUME_MUTED, PA_VOLUME_NORM);
+}
+
+/* waits for an operation to finish, must be called with the loop locked */
+static void
+pulse_wait(pa_threaded_mainloop *loop, pa_operation *op) {
+  if (op == NULL)
+    return;
+  while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
+    pa_threaded_mainloop_wait(loop);
+  pa_operation_unref(op);
+}
+
+static void
+context_state_cb(pa_context *c, void *data) {
+  pa_threaded_mainloop_signal((pa_threaded_mainloop *) data, 0);
+}
+
+static void
+add_open_device(pulse_open_t *o, int is_source, uint32_t index,
+                const char *name, const char *description,
+                const pa_cvolume *volume, const pa_channel_map *map,
+                int mute) {
+  pulse_device_t d;
+
+  d.is_source = is_source;
+  d.index = index;
+  d.name = g_strdup(name);
+  d.description = g_strdup(description);
+  d.changed = 0;
+  d.volume = *volume;
+  d.map = *map;
+  d.mute = mute;
+  g_array_append_val(o->devices, d);
+}
+
+static void
+open_sink_cb(pa_context *c, const pa_sink_info *info, int eol, void *data) {
+  pulse_open_t *o = (pulse_open_t *) data;
+
+  if (eol) {
+    pa_threaded_mainloop_signal(o->loop, 0);
+    return;
+  }
+  add_open_device(o, FALSE, info->index, info->name, info->description,
+                  &info->volume, &info->channel_map, info->mute);
+}
+
+static void
+open_source_cb(pa_context *c, const pa_source_info *info, int eol,
+               void *data) {
+  pulse_open_t *o = (pulse_open_t *) data;
+
+  if (eol) {
+    pa_threaded_mainloop_signal(o->loop, 0);
+    return;
+  }
+  /* monitors just mirror a sink */
+  if (info->monitor_of_sink != PA_INVALID_INDEX)
+    return;
+  add_open_device(o, TRUE, info->index, info->name, info->description,
+                  &info->volume, &info->channel_map, info->mute);
+}
+
+static void
+open_server_cb(pa_context *c, const pa_server_info *info, void *data) {
+  pulse_open_t *o = (pulse_open_t *) data;
+
+  o->name = g_strdup(info != NULL ? info->server_name : "PulseAudio");
+  pa_threaded_mainloop_signal(o->loop, 0);
+}
+
+/* Reports changed devices from the mixer io thread. The subscription
+ * callbacks run in the pulse mainloop thread. */
+static gboolean
+pulse_notify_idle(gpointer data) {
+  mixer_t *mixer = (mixer_t *) data;
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  int *changed = g_newa(int, mixer->nrdevices);
+  int i;
+
+  pa_threaded_mainloop_lock(pm->loop);
+  for (i = 0; i < mixer->nrdevices; i++) {
+    changed[i] = pm->devices[i].changed;
+    pm->devices[i].changed = 0;
+  }
+  pm->notify_id = 0;
+  pa_threaded_mainloop_unlock(pm->loop);
+
+  for (i = 0; i < mixer->nrdevices; i++)
+    if (changed[i])
+      mixer_notify(mixer, i);
+  return FALSE;
+}
+
+/* called with the loop locked */
+static void
+pulse_device_changed(mixer_t *mixer, pulse_device_t *d) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+
+  d->changed = 1;
+  if (pm->notify_id == 0) {
+    GSource *idle = g_idle_source_new();
+
+    g_source_set_callback(idle, pulse_notify_idle, mixer, NULL);
+    pm->notify_id = g_source_attach(idle, mixer_get_context());
+    g_source_unref(idle);
+  }
+}
+
+/* a sink/source came or changed, matched by index or by name if it was gone
+ * and came back */
+static void
+pulse_update_device(mixer_t *mixer, int is_source, uint32_t index,
+                    const char *name, const pa_cvolume *volume,
+                    const pa_channel_map *map, int mute) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  pulse_device_t *d;
+  int i;
+
+  for (i = 0; i < mixer->nrdevices; i++) {
+    d = &pm->devices[i];
+    if (d->is_source != is_source)
+      continue;
+    if (d->index == index ||
+        (d->index == PA_INVALID_INDEX && !strcmp(d->name, name))) {
+      d->index = index;
+      d->volume = *volume;
+      d->map = *map;
+      d->mute = mute;
+      pulse_device_changed(mixer, d);
+      return;
+    }
+  }
+}
+
+/* the eol wakes up pulse_reconnect, nobody waits for the lookups of the
+ * subscription */
+static void
+update_sink_cb(pa_context *c, const pa_sink_info *info, int eol, void *data) {
+  if (eol || info == NULL) {
+    pa_threaded_mainloop_signal(PULSEMIXER(((mixer_t *) data))->loop, 0);
+    return;
+  }
+  pulse_update_device((mixer_t *) data, FALSE, info->index, info->name,
+                      &info->volume, &info->channel_map, info->mute);
+}
+
+static void
+update_source_cb(pa_context *c, const pa_source_info *info, int eol,
+                 void *data) {
+  if (eol || info == NULL) {
+    pa_threaded_mainloop_signal(PULSEMIXER(((mixer_t *) data))->loop, 0);
+    return;
+  }
+  pulse_update_device((mixer_t *) data, TRUE, info->index, info->name,
+                      &info->volume, &info->channel_map, info->mute);
+}
+
+static void
+subscribe_cb(pa_context *c, pa_subscription_event_type_t t, uint32_t index,
+             void *data) {
+  mixer_t *mixer = (mixer_t *) data;
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  int facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+  int type = t & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+  int is_source, i;
+  pa_operation *op;
+
+  if (facility == PA_SUBSCRIPTION_EVENT_SINK)
+    is_source = FALSE;
+  else if (facility == PA_SUBSCRIPTION_EVENT_SOURCE)
+    is_source = TRUE;
+  else
+    return;
+
+  if (type == PA_SUBSCRIPTION_EVENT_REMOVE) {
+    for (i = 0; i < mixer->nrdevices; i++) {
+      pulse_device_t *d = &pm->devices[i];
+      if (d->is_source == is_source && d->index == index) {
+        d->index = PA_INVALID_INDEX;
+        pulse_device_changed(mixer, d);
+      }
+    }
+    return;
+  }
+
+  if (is_source)
+    op = pa_context_get_source_info_by_index(c, index, update_source_cb,
+                                             mixer);
+  else
+    op = pa_context_get_sink_info_by_index(c, index, update_sink_cb, mixer);
+  if (op != NULL)
+    pa_operation_unref(op);
+}
+
+/* a new context on the running loop, connected and ready. Called with the
+ * loop locked, NULL if the server can't be reached. Quiet without an id */
+static pa_context *
+pulse_connect(pa_threaded_mainloop *loop, const char *server, const char *id) {
+  pa_context *context;
+  pa_context_state_t state;
+
+  context = pa_context_new(pa_threaded_mainloop_get_api(loop),
+                           "gkrellm-volume");
+  if (context == NULL)
+    return NULL;
+  pa_context_set_state_callback(context, context_state_cb, loop);
+  if (pa_context_connect(context, server, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0)
+    goto fail;
+  while ((state = pa_context_get_state(context)) != PA_CONTEXT_READY) {
+    if (state == PA_CONTEXT_FAILED || state == PA_CONTEXT_TERMINATED)
+      goto fail;
+    pa_threaded_mainloop_wait(loop);
+  }
+  return context;
+
+fail:
+  if (id != NULL)
+    pulse_error("Connection to %s failed: %s", id,
+                pa_strerror(pa_context_errno(context)));
+  pa_context_set_state_callback(context, NULL, NULL);
+  pa_context_disconnect(context);
+  pa_context_unref(context);
+  return NULL;
+}
+
+/* called with the loop locked */
+static gboolean
+pulse_subscribe(mixer_t *mixer) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  pa_operation *op;
+
+  pa_context_set_subscribe_callback(pm->context, subscribe_cb, mixer);
+  op = pa_context_subscribe(pm->context,
+         PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE, NULL, NULL);
+  /* the context may have died since it was ready */
+  if (op == NULL)
+    return FALSE;
+  pa_operation_unref(op);
+  return TRUE;
+}
+
+/* The server went away, a restart of PulseAudio or PipeWire say. Replaces
+ * the dead context and matches the devices again by name, the way
+ * pulse_update_device does for a device that comes back. Called with the
+ * loop locked from a read, so the probes of an offline mixer retry it.
+ * TRUE once the new context is ready and subscribed */
+static gboolean
+pulse_reconnect(mixer_t *mixer) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  pa_context *context;
+  int i;
+
+  if ((context = pulse_connect(pm->loop, pm->server, NULL)) == NULL)
+    return FALSE;
+  pa_context_set_state_callback(pm->context, NULL, NULL);
+  pa_context_set_subscribe_callback(pm->context, NULL, NULL);
+  pa_context_disconnect(pm->context);
+  pa_context_unref(pm->context);
+  pm->context = context;
+
+  if (!pulse_subscribe(mixer)) {
+    /* terminated, the next read tries again */
+    pa_context_disconnect(context);
+    return FALSE;
+  }
+  /* indexes are the new server's, whatever doesn't come back reads as 0 */
+  for (i = 0; i < mixer->nrdevices; i++)
+    if (pm->devices[i].index != PA_INVALID_INDEX) {
+      pm->devices[i].index = PA_INVALID_INDEX;
+      pulse_device_changed(mixer, &pm->devices[i]);
+    }
+  pulse_wait(pm->loop,
+             pa_context_get_sink_info_list(context, update_sink_cb, mixer));
+  pulse_wait(pm->loop,
+             pa_context_get_source_info_list(context, update_source_cb,
+                                             mixer));
+  return TRUE;
+}
+
+static mixer_t *
+pulse_mixer_open(char *id) {
+  mixer_t *result;
+  pulse_mixer_t *pm;
+  pulse_open_t o;
+  pa_threaded_mainloop *loop;
+  pa_context *context;
+  const char *server = NULL;
+  int i;
+
+  if (strcmp(id, PULSE_ID) != 0) {
+    if (strncmp(id, PULSE_ID ":", strlen(PULSE_ID ":")) != 0)
+      return NULL;
+    server = id + strlen(PULSE_ID ":");
+  }
+
+  if ((loop = pa_threaded_mainloop_new()) == NULL)
+    return NULL;
+
+  pa_threaded_mainloop_lock(loop);
+  if (pa_threaded_mainloop_start(loop) < 0 ||
+      (context = pulse_connect(loop, server, id)) == NULL) {
+    pa_threaded_mainloop_unlock(loop);
+    pa_threaded_mainloop_stop(loop);
+    pa_threaded_mainloop_free(loop);
+    return NULL;
+  }
+
+  o.loop = loop;
+  o.devices = g_array_new(FALSE, FALSE, sizeof(pulse_device_t));
+  o.name = NULL;
+  pulse_wait(loop, pa_context_get_server_info(context, open_server_cb, &o));
+  pulse_wait(loop, pa_context_get_sink_info_list(context, open_sink_cb, &o));
+  pulse_wait(loop,
+             pa_context_get_source_info_list(context, open_source_cb, &o));
+
+  result = g_new0(mixer_t, 1);
+  pm = g_new0(pulse_mixer_t, 1);
+  result->priv = pm;
+  result->ops = get_mixer_ops();
+  result->notifies = 1;
+  result->name = o.name != NULL ? o.name : g_strdup("PulseAudio");
+  result->nrdevices = o.devices->len;
+  result->dev_names = g_new0(gchar *, result->nrdevices);
+  result->dev_realnames = g_new0(gchar *, result->nrdevices);
+
+  pm->loop = loop;
+  pm->context = context;
+  pm->server = g_strdup(server);
+  pm->devices = (pulse_device_t *) g_array_free(o.devices, FALSE);
+  for (i = 0; i < result->nrdevices; i++) {
+    /* handed over to the mixer */
+    result->dev_realnames[i] = pm->devices[i].description;
+    pm->devices[i].description = NULL;
+  }
+
+  if (!pulse_subscribe(result)) {
+    pulse_error("Subscribing to %s failed: %s", id,
+                pa_strerror(pa_context_errno(context)));
+    pa_threaded_mainloop_unlock(loop);
+    pulse_mixer_close(result);
+    return NULL;
+  }
+  pa_threaded_mainloop_unlock(loop);
+
+  return result;
+}
+
+static void
+pulse_mixer_close(mixer_t *mixer) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  int i;
+
+  /* no callbacks after this */
+  pa_threaded_mainloop_stop(pm->loop);
+  pa_context_disconnect(pm->context);
+  pa_context_unref(pm->context);
+  pa_threaded_mainloop_free(pm->loop);
+  if (pm->notify_id != 0)
+    g_source_destroy(g_main_context_find_source_by_id(mixer_get_context(),
+                                                      pm->notify_id));
+
+  for (i = 0; i < mixer->nrdevices; i++) {
+    g_free(pm->devices[i].name);
+    g_free(mixer->dev_names[i]);
+    g_free(mixer->dev_realnames[i]);
+  }
+  g_free(pm->devices);
+  g_free(pm->server);
+  g_free(pm);
+  g_free(mixer->name);
+  g_free(mixer->dev_names);
+  g_free(mixer->dev_realnames);
+  g_free(mixer);
+}
+
+static long
+pulse_mixer_device_get_fullscale(mixer_t *mixer, int devid) {
+  return 100;
+}
+
+/* the pulse channel positions we know, others count as centered */
+static unsigned char
+pulse_position(pa_channel_position_t p) {
+  switch (p) {
+    case PA_CHANNEL_POSITION_FRONT_LEFT: return MIXER_CH_FRONT_LEFT;
+    case PA_CHANNEL_POSITION_FRONT_RIGHT: return MIXER_CH_FRONT_RIGHT;
+    case PA_CHANNEL_POSITION_REAR_LEFT: return MIXER_CH_REAR_LEFT;
+    case PA_CHANNEL_POSITION_REAR_RIGHT: return MIXER_CH_REAR_RIGHT;
+    case PA_CHANNEL_POSITION_FRONT_CENTER: return MIXER_CH_FRONT_CENTER;
+    case PA_CHANNEL_POSITION_LFE: return MIXER_CH_LFE;
+    case PA_CHANNEL_POSITION_SIDE_LEFT: return MIXER_CH_SIDE_LEFT;
+    case PA_CHANNEL_POSITION_SIDE_RIGHT: return MIXER_CH_SIDE_RIGHT;
+    case PA_CHANNEL_POSITION_REAR_CENTER: return MIXER_CH_REAR_CENTER;
+    default: return MIXER_CH_MONO;
+  }
+}
+
+/* pulse volumes always have a dB scale, in software if not in hardware */
+static void
+pulse_mixer_device_describe(mixer_t *mixer, int devid, mixer_device_t *desc) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  pulse_device_t *d = &pm->devices[devid];
+  int i;
+
+  pa_threaded_mainloop_lock(pm->loop);
+  desc->channels = MIN(d->map.channels, MIXER_MAX_CHANNELS);
+  for (i = 0; i < desc->channels; i++)
+    desc->position[i] = pulse_position(d->map.map[i]);
+  if (d->is_source)
+    desc->flags |= MIXER_DEVICE_CAPTURE;
+  pa_threaded_mainloop_unlock(pm->loop);
+  desc->min = PA_VOLUME_MUTED;
+  desc->max = PA_VOLUME_NORM;
+  desc->flags |= MIXER_DEVICE_DB;
+}
+
+static void
+pulse_mixer_device_get_channels(mixer_t *mixer, int devid, int *volumes) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  pulse_device_t *d = &pm->devices[devid];
+  pa_context_state_t state;
+  int i;
+
+  pa_threaded_mainloop_lock(pm->loop);
+  /* the cache is worthless once the server is gone, until a new one is
+   * reached */
+  state = pa_context_get_state(pm->context);
+  if (state == PA_CONTEXT_FAILED || state == PA_CONTEXT_TERMINATED) {
+    if (!pulse_reconnect(mixer))
+      mixer_failed(mixer);
+  } else if (state != PA_CONTEXT_READY) {
+    mixer_failed(mixer);
+  }
+  for (i = 0; i < MIXER_MAX_CHANNELS; i++)
+    volumes[i] = d->index == PA_INVALID_INDEX || d->mute ||
+                 i >= d->volume.channels ? 0 : to_percent(d->volume.values[i]);
+  pa_threaded_mainloop_unlock(pm->loop);
+}
+
+static void
+pulse_mixer_device_get_volume(mixer_t *mixer, int devid,
+                              int *left, int *right) {
+  int volumes[MIXER_MAX_CHANNELS];
+
+  pulse_mixer_device_get_channels(mixer, devid, volumes);
+  mixer_channels_to_stereo(mixer_get_device(mixer, devid), volumes,
+                           left, right);
+}
+
+/* all channels in one request, channels beyond the description follow its
+ * last one */
+static void
+pulse_mixer_device_set_channels(mixer_t *mixer, int devid,
+                                const int *volumes) {
+  pulse_mixer_t *pm = PULSEMIXER(mixer);
+  pulse_device_t *d = &pm->devices[devid];
+  int last = mixer_get_device(mixer, devid)->channels - 1;
+  gboolean audible = FALSE;
+  pa_cvolume volume;
+  pa_operation *op;
+  int i;
+
+  pa_threaded_mainloop_lock(pm->loop);
+  if (d->index == PA_INVALID_INDEX) {
+    pa_threaded_mainloop_unlock(pm->loop);
+    return;
+  }
+
+  volume = d->volume;
+  for (i = 0; i < volume.channels; i++) {
+    volume.values[i] = from_percent(volumes[MIN(i, last)]);
+    audible |= volume.values[i] != PA_VOLUME_MUTED;
+  }
+
+  /* fire and forget, the change event updates the cache again */
+  if (d->is_source)
+    op = pa_context_set_source_volume_by_index(pm->context, d->index,
+                                               &volume, NULL, NULL);
+  else
+    op = pa_context_set_sink_volume_by_index(pm->context, d->index,
+                                             &volume, NULL, NULL);
+  if (op != NULL)
+    pa_operation_unref(op);
+  else
+    mixer_failed(mixer);
+
+  if (d->mute && audible) {
+    if (d->is_source)
+      op = pa_context_set_source_mute_by_index(pm->context, d->index, 0,
+                                               NULL, NULL);
+    else
+      op = pa_context_set_sink_mute_by_index(pm->context, d->index, 0,
+                                             NULL, NULL);
+    if (op != NULL)
+      pa_operation_unref(op);
+    d->mute = 0;
+  }
+  d->volume = volume;
+  pa_threaded_mainloop_unlock(pm->loop);
+}
+
+static void
+pulse_mixer_device_set_volume(mixer_t *mixer, int devid,
+                              int left, int right) {
+  int volumes[MIXER_MAX_CHANNELS];
+
+  mixer_stereo_to_channels(mixer_get_device(mixer, devid), left, right,
+                           volumes);
+  pulse_mixer_device_set_channels(mixer, devid, volumes);
+}
+
+/* the mainloop lock is recursive, held over a batch every write of it goes
+ * out with the same wakeup of the mainloop */
+static void
+pulse_mixer_batch_begin(mixer_t *mixer) {
+  pa_threaded_mainloop_lock(PULSEMIXER(mixer)->loop);
+}
+
+static void
+pulse_mixer_batch_end(mixer_t *mixer) {
+  pa_threaded_mainloop_unlock(PULSEMIXER(mixer)->loop);
+}
+
+static mixer_idz_t *
+pulse_mixer_get_id_list(void) {
+  mixer_t *mixer;
+
+  /* only offer it when a server is running */
+  if ((mixer = pulse_mixer_open(PULSE_ID)) == NULL)
+    return NULL;
+  pulse_mixer_close(mixer);
+  return mixer_id_list_add(PULSE_ID, NULL);
+}
+
+static mixer_ops_t pulse_mixer_ops = {
+  .mixer_get_id_list = pulse_mixer_get_id_list,
+  .mixer_open = pulse_mixer_open,
+  .mixer_close = pulse_mixer_close,
+  .mixer_device_get_fullscale = pulse_mixer_device_get_fullscale,
+  .mixer_device_get_volume = pulse_mixer_device_get_volume,
+  .mixer_device_set_volume = pulse_mixer_device_set_volume,
+  .mixer_device_describe = pulse_mixer_device_describe,
+  .mixer_device_get_channels = pulse_mixer_device_get_channels,
+  .mixer_device_set_channels = pulse_mixer_device_set_channels,
+  .mixer_batch_begin = pulse_mixer_batch_begin,
+  .mixer_batch_end = pulse_mixer_batch_end
+};
+
+static mixer_ops_t *
+get_mixer_ops(void) {
+  return &pulse_mixer_ops;
+}
+
+mixer_ops_t *
+init_pulse_mixer(void) {
+  return get_mixer_ops();
+}
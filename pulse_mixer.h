@@ -0,0 +1,34 @@
+#ifndef VOLUME_PULSE_MIXER_H
+#define VOLUME_PULSE_MIXER_H
+
+#include <pulse/pulseaudio.h>
+#include <pulse/thread-mainloop.h>
+#include "mixer.h"
+
+/* a sink or source exposed as device */
+typedef struct {
+  int is_source;
+  /* PA_INVALID_INDEX while the sink/source is gone */
+  uint32_t index;
+  char *name;
+  char *description;
+  pa_cvolume volume;
+  pa_channel_map map;
+  int mute;
+  int changed;
+} pulse_device_t;
+
+typedef struct {
+  pa_threaded_mainloop *loop;
+  pa_context *context;
+  /* what to connect to again when the server goes away, NULL for the
+   * default one */
+  char *server;
+  pulse_device_t *devices;
+  /* idle source reporting changes in the io thread, 0 if none pending */
+  guint notify_id;
+} pulse_mixer_t;
+
+mixer_ops_t *init_pulse_mixer(void);
+
+#endif /* VOLUME_PULSE_MIXER_H */
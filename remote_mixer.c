@@ -0,0 +1,317 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* Mixers of the host gkrellmd runs on. The state comes in as serve data in
+ * the main loop and is cached here, the backend calls run in the mixer io
+ * thread and only touch the cache. Set requests are collected and sent from
+ * the main loop, at most one per device and main loop iteration. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "mixer.h"
+#include "remote_mixer.h"
+#include "gkrellmd_volume.h"
+
+#define REMOTEMIXER(x) ((remote_mixer_t *)x->priv)
+
+static mixer_ops_t *get_mixer_ops(void);
+
+/* guards the array and the devices, the io thread walks them while the
+ * main loop adds setup lines */
+G_LOCK_DEFINE_STATIC(remote);
+/* remote_mixer_t by server index, filled from the setup lines. Entries are
+ * never removed, so a remote_mixer_t stays valid without the lock */
+static GPtrArray *remote_mixers = NULL;
+static guint send_id = 0;
+static guint notify_id = 0;
+
+/* both with the lock held */
+static remote_mixer_t *
+remote_get(int m) {
+  if (remote_mixers == NULL || m < 0 || m >= (int) remote_mixers->len)
+    return NULL;
+  return (remote_mixer_t *) g_ptr_array_index(remote_mixers, m);
+}
+
+static remote_device_t *
+remote_get_device(int m, int d) {
+  remote_mixer_t *rm = remote_get(m);
+
+  if (rm == NULL || d < 0 || d >= rm->nrdevices)
+    return NULL;
+  return &rm->devices[d];
+}
+
+/* main loop */
+static void
+remote_setup(gchar *line) {
+  remote_mixer_t *rm;
+  remote_device_t *dev;
+  char name[256];
+  int m, d, n;
+  long full;
+
+  G_LOCK(remote);
+  if (remote_mixers == NULL)
+    remote_mixers = g_ptr_array_new();
+  if (sscanf(line, "mixer %d %d %255[^\n]", &m, &n, name) == 3) {
+    if (m == (int) remote_mixers->len && n >= 0) {
+      rm = g_new0(remote_mixer_t, 1);
+      rm->id = g_strdup(name);
+      rm->nrdevices = n;
+      rm->devices = g_new0(remote_device_t, n);
+      g_ptr_array_add(remote_mixers, rm);
+    }
+  } else if (sscanf(line, "dev %d %d %ld %255[^\n]", &m, &d, &full,
+                    name) == 4) {
+    if ((dev = remote_get_device(m, d)) != NULL) {
+      g_free(dev->name);
+      dev->name = g_strdup(name);
+      dev->fullscale = full;
+    }
+  }
+  G_UNLOCK(remote);
+}
+
+/* io thread, reports what the serve data changed */
+static gboolean
+remote_notify_idle(gpointer data) {
+  remote_mixer_t *rm;
+  mixer_t *mixer;
+  int i, d, changed;
+
+  G_LOCK(remote);
+  notify_id = 0;
+  G_UNLOCK(remote);
+  /* not locked around mixer_notify, which reads the volume back */
+  for (i = 0; ; i++) {
+    G_LOCK(remote);
+    rm = remote_get(i);
+    G_UNLOCK(remote);
+    if (rm == NULL)
+      break;
+    for (d = 0; d < rm->nrdevices; d++) {
+      G_LOCK(remote);
+      changed = rm->devices[d].changed;
+      rm->devices[d].changed = 0;
+      mixer = rm->mixer;
+      G_UNLOCK(remote);
+      /* mixers are opened and closed in this thread too */
+      if (changed && mixer != NULL)
+        mixer_notify(mixer, d);
+    }
+  }
+  return FALSE;
+}
+
+/* main loop */
+static void
+remote_data(gchar *line) {
+  remote_device_t *dev;
+  int m, d, left, right;
+
+  if (sscanf(line, "%d %d %d %d", &m, &d, &left, &right) != 4)
+    return;
+  G_LOCK(remote);
+  if ((dev = remote_get_device(m, d)) != NULL &&
+      (dev->left != left || dev->right != right)) {
+    dev->left = left;
+    dev->right = right;
+    /* a set request still on its way wins */
+    if (!dev->want)
+      dev->changed = 1;
+    if (notify_id == 0) {
+      GSource *idle = g_idle_source_new();
+
+      g_source_set_callback(idle, remote_notify_idle, NULL, NULL);
+      notify_id = g_source_attach(idle, mixer_get_context());
+      g_source_unref(idle);
+    }
+  }
+  G_UNLOCK(remote);
+}
+
+/* main loop, sends the latest request of every device */
+static gboolean
+remote_send_idle(gpointer data) {
+  remote_mixer_t *rm;
+  remote_device_t *dev;
+  GString *lines = g_string_new(NULL);
+  gchar **l, **split;
+  guint i;
+  int d;
+
+  G_LOCK(remote);
+  send_id = 0;
+  for (i = 0; i < remote_mixers->len; i++) {
+    rm = (remote_mixer_t *) g_ptr_array_index(remote_mixers, i);
+    for (d = 0; d < rm->nrdevices; d++) {
+      dev = &rm->devices[d];
+      if (!dev->want)
+        continue;
+      g_string_append_printf(lines, "set %u %d %d %d\n", i, d,
+                             dev->want_left, dev->want_right);
+      /* assume it worked until the server says otherwise */
+      dev->left = dev->want_left;
+      dev->right = dev->want_right;
+      dev->want = 0;
+    }
+  }
+  G_UNLOCK(remote);
+
+  split = g_strsplit(lines->str, "\n", 0);
+  for (l = split; *l != NULL; l++)
+    if (**l != '\0')
+      gkrellm_client_send_to_server(VOLUME_SERVE_NAME, *l);
+  g_strfreev(split);
+  g_string_free(lines, TRUE);
+  return FALSE;
+}
+
+static mixer_t *
+remote_mixer_open(char *id) {
+  remote_mixer_t *rm = NULL;
+  mixer_t *result;
+  int i, d;
+
+  if (strncmp(id, REMOTE_ID_PREFIX, strlen(REMOTE_ID_PREFIX)))
+    return NULL;
+  id += strlen(REMOTE_ID_PREFIX);
+  G_LOCK(remote);
+  for (i = 0; (rm = remote_get(i)) != NULL; i++)
+    if (!strcmp(rm->id, id))
+      break;
+  G_UNLOCK(remote);
+  if (rm == NULL || rm->mixer != NULL)
+    return NULL;
+
+  result = g_new0(mixer_t, 1);
+  result->priv = rm;
+  result->ops = get_mixer_ops();
+  result->notifies = 1;
+  result->name = g_strdup_printf("%s (remote)", rm->id);
+  result->nrdevices = rm->nrdevices;
+  result->dev_names = g_new0(gchar *, rm->nrdevices);
+  result->dev_realnames = g_new0(gchar *, rm->nrdevices);
+  G_LOCK(remote);
+  for (d = 0; d < rm->nrdevices; d++)
+    result->dev_realnames[d] = g_strdup(rm->devices[d].name != NULL ?
+                                        rm->devices[d].name : "?");
+  rm->mixer = result;
+  G_UNLOCK(remote);
+  return result;
+}
+
+static void
+remote_mixer_close(mixer_t *mixer) {
+  remote_mixer_t *rm = REMOTEMIXER(mixer);
+  int i;
+
+  G_LOCK(remote);
+  rm->mixer = NULL;
+  G_UNLOCK(remote);
+  for (i = 0; i < mixer->nrdevices; i++) {
+    g_free(mixer->dev_names[i]);
+    g_free(mixer->dev_realnames[i]);
+  }
+  g_free(mixer->name);
+  g_free(mixer->dev_names);
+  g_free(mixer->dev_realnames);
+  g_free(mixer);
+}
+
+static long
+remote_mixer_device_get_fullscale(mixer_t *mixer, int devid) {
+  long result;
+
+  G_LOCK(remote);
+  result = REMOTEMIXER(mixer)->devices[devid].fullscale;
+  G_UNLOCK(remote);
+  return result;
+}
+
+static void
+remote_mixer_device_get_volume(mixer_t *mixer, int devid,
+                               int *left, int *right) {
+  remote_device_t *dev = &REMOTEMIXER(mixer)->devices[devid];
+
+  G_LOCK(remote);
+  if (dev->want) {
+    *left = dev->want_left;
+    *right = dev->want_right;
+  } else {
+    *left = dev->left;
+    *right = dev->right;
+  }
+  G_UNLOCK(remote);
+}
+
+static void
+remote_mixer_device_set_volume(mixer_t *mixer, int devid,
+                               int left, int right) {
+  remote_device_t *dev = &REMOTEMIXER(mixer)->devices[devid];
+
+  G_LOCK(remote);
+  dev->want_left = left;
+  dev->want_right = right;
+  dev->want = 1;
+  if (send_id == 0)
+    send_id = g_idle_add(remote_send_idle, NULL);
+  G_UNLOCK(remote);
+}
+
+static mixer_idz_t *
+remote_mixer_get_id_list(void) {
+  mixer_idz_t *result = NULL;
+  remote_mixer_t *rm;
+  char *id;
+  int i;
+
+  G_LOCK(remote);
+  for (i = 0; (rm = remote_get(i)) != NULL; i++) {
+    id = g_strconcat(REMOTE_ID_PREFIX, rm->id, NULL);
+    result = mixer_id_list_add(id, result);
+    g_free(id);
+  }
+  G_UNLOCK(remote);
+  return result;
+}
+
+void
+remote_mixer_connect(GkrellmMonitor *mon) {
+  gkrellm_client_plugin_get_setup(VOLUME_SERVE_NAME, remote_setup);
+  gkrellm_client_plugin_serve_data_connect(mon, VOLUME_SERVE_NAME,
+                                           remote_data);
+}
+
+static mixer_ops_t remote_mixer_ops = {
+  .mixer_get_id_list = remote_mixer_get_id_list,
+  .mixer_open = remote_mixer_open,
+  .mixer_close = remote_mixer_close,
+  .mixer_device_get_fullscale = remote_mixer_device_get_fullscale,
+  .mixer_device_get_volume = remote_mixer_device_get_volume,
+  .mixer_device_set_volume = remote_mixer_device_set_volume
+};
+
+static mixer_ops_t *
+get_mixer_ops(void) {
+  return &remote_mixer_ops;
+}
+
+mixer_ops_t *
+init_remote_mixer(void) {
+  return get_mixer_ops();
+}
@@ -0,0 +1,36 @@
+#ifndef VOLUME_REMOTE_MIXER_H
+#define VOLUME_REMOTE_MIXER_H
+
+#include <gkrellm2/gkrellm.h>
+#include "mixer.h"
+
+/* the mixers served by the volume module of gkrellmd, see gkrellmd_volume.c.
+ * Ids are "remote:<id on the server>" */
+#define REMOTE_ID_PREFIX "remote:"
+
+/* a device as served by gkrellmd */
+typedef struct {
+  char *name;
+  long fullscale;
+  int left, right;
+  /* a set request waits to be sent */
+  int want_left, want_right;
+  int want;
+  /* changed since the frontend was last notified */
+  int changed;
+} remote_device_t;
+
+typedef struct {
+  char *id;
+  int nrdevices;
+  remote_device_t *devices;
+  /* the open mixer_t for this server mixer, NULL if it isn't open */
+  mixer_t *mixer;
+} remote_mixer_t;
+
+mixer_ops_t *init_remote_mixer(void);
+
+/* hooks the remote mixers up to gkrellmd, only in gkrellm client mode */
+void remote_mixer_connect(GkrellmMonitor *mon);
+
+#endif /* VOLUME_REMOTE_MIXER_H */
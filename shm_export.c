@@ -0,0 +1,94 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "shm_export.h"
+
+static volume_shm_t *shm = NULL;
+static char shm_name[64];
+
+static void
+shm_export_close(void) {
+  if (shm == NULL)
+    return;
+  munmap(shm, sizeof(volume_shm_t));
+  shm_unlink(shm_name);
+  shm = NULL;
+}
+
+gboolean
+shm_export_open(void) {
+  void *p;
+  int fd;
+
+  if (shm != NULL)
+    return TRUE;
+  snprintf(shm_name, sizeof(shm_name), VOLUME_SHM_NAME_FMT,
+           (unsigned) getuid());
+  if ((fd = shm_open(shm_name, O_RDWR | O_CREAT, 0600)) < 0) {
+    fprintf(stderr, "volume: can't create %s: %s\n", shm_name,
+            strerror(errno));
+    return FALSE;
+  }
+  if (ftruncate(fd, sizeof(volume_shm_t)) < 0) {
+    fprintf(stderr, "volume: can't size %s: %s\n", shm_name, strerror(errno));
+    close(fd);
+    return FALSE;
+  }
+  p = mmap(NULL, sizeof(volume_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+           fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return FALSE;
+  shm = (volume_shm_t *) p;
+
+  /* a region left behind by an earlier instance is reset, readers that
+   * still have it mapped see the counter move on */
+  __atomic_store_n(&shm->seq, (shm->seq | 1) + 1, __ATOMIC_RELEASE);
+  shm->nr_sliders = 0;
+  shm->pid = getpid();
+  shm->version = VOLUME_SHM_VERSION;
+  shm->magic = VOLUME_SHM_MAGIC;
+  atexit(shm_export_close);
+  return TRUE;
+}
+
+void
+shm_export_publish(const volume_shm_slider_t *sliders, int nr) {
+  uint32_t seq;
+
+  if (shm == NULL)
+    return;
+  if (nr > VOLUME_SHM_MAX_SLIDERS)
+    nr = VOLUME_SHM_MAX_SLIDERS;
+  if (shm->nr_sliders == (uint32_t) nr &&
+      !memcmp(shm->sliders, sliders, nr * sizeof(volume_shm_slider_t)))
+    return;
+
+  seq = shm->seq;
+  __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(shm->sliders, sliders, nr * sizeof(volume_shm_slider_t));
+  shm->nr_sliders = nr;
+  __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
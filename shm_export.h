@@ -0,0 +1,14 @@
+#ifndef VOLUME_SHM_EXPORT_H
+#define VOLUME_SHM_EXPORT_H
+
+#include "volume_shm.h"
+
+/* creates the shared memory region, returns FALSE if that failed. The region
+ * is removed again at exit */
+gboolean shm_export_open(void);
+
+/* replaces the published sliders, only touches the region if something
+ * changed */
+void shm_export_publish(const volume_shm_slider_t *sliders, int nr);
+
+#endif /* VOLUME_SHM_EXPORT_H */
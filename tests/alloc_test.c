@@ -0,0 +1,190 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* The update tick must not allocate. This runs the plugin's update function
+ * the way gkrellm does, against a fake backend that takes the place of OSS,
+ * and counts every malloc, calloc and realloc of the process meanwhile, the
+ * io thread's included. volume.c is included for its static state.
+ *
+ * After a warm up, which may allocate once (first notification, first
+ * control event), it runs TICKS idle ticks, TICKS changes of the hardware
+ * behind our back, TICKS slider moves by the user and TICKS idle ticks
+ * again. Any allocation in between fails the test. */
+
+#include "volume.c"
+#include "fake_mixer.h"
+
+#define TICKS 200
+/* two mixers with two sliders each */
+#define SLIDERS 4
+
+/* glibc's allocator behind the hooks below. They are found before libc's
+ * by every library of the process, glib included */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static volatile gint counting = 0;
+static volatile gint allocations = 0;
+
+void *malloc(size_t size) {
+  if (g_atomic_int_get(&counting)) g_atomic_int_inc(&allocations);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  if (g_atomic_int_get(&counting)) g_atomic_int_inc(&allocations);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (g_atomic_int_get(&counting)) g_atomic_int_inc(&allocations);
+  return __libc_realloc(ptr, size);
+}
+
+static int ticks = 0;
+
+/* one gkrellm update: what the main loop has, then the plugin's update */
+static void tick(void) {
+  while (g_main_context_iteration(NULL, FALSE));
+  update_volume_plugin();
+  ticks++;
+}
+
+static GkrellmPanel fake_panel;
+static GkrellmKrell fake_krell;
+
+/* the sliders as create_volume_plugin leaves them, minus the drawing */
+static void setup(void) {
+  const char *lines[] = {
+    "ADDMIXER oss:poll", "ADDDEV 0", "SHOWBALANCE", "ADDDEV 1",
+    "ADDMIXER oss:events", "ADDDEV 0", "SHOWBALANCE", "ADDDEV 1",
+  };
+  volume_config_t *config;
+  Mixer *m;
+  Slider *s;
+  guint i;
+
+  init_mixer();
+  for (i = 0; i < G_N_ELEMENTS(lines); i++)
+    load_volume_plugin_config((gchar *) lines[i]);
+  config = config_parser_finish(config_parser);
+  config_parser = NULL;
+  volume_apply_config(config);
+  config_free(config);
+  for (m = Mixerz; m != NULL; m = m->next)
+    for (s = m->Sliderz; s != NULL; s = s->next) {
+      s->panel = &fake_panel;
+      s->krell = &fake_krell;
+    }
+  fake_attach_events();
+}
+
+static int nr_sliders(void) {
+  Mixer *m;
+  Slider *s;
+  int n = 0;
+  for (m = Mixerz; m != NULL; m = m->next)
+    for (s = m->Sliderz; s != NULL; s = s->next) n++;
+  return n;
+}
+
+/* TRUE if every slider shows left and right */
+static gboolean sliders_at(int left, int right) {
+  Mixer *m;
+  Slider *s;
+  int l, r;
+  for (m = Mixerz; m != NULL; m = m->next)
+    for (s = m->Sliderz; s != NULL; s = s->next) {
+      mixer_channels_to_stereo(s->desc, s->saved, &l, &r);
+      if (l != left || r != right) return FALSE;
+    }
+  return TRUE;
+}
+
+static void idle_ticks(int n) {
+  while (n-- > 0) tick();
+}
+
+/* the hardware moves n times, each time ticks go on until every slider
+ * shows it. The event mixer reports right away, the polled one is read on
+ * one of the next ticks and then on every tick while it keeps changing */
+static gboolean changing_ticks(int n, int first) {
+  int i, t, v;
+  for (i = 0; i < n; i++) {
+    v = (first + i) % 101;
+    fake_change(v);
+    for (t = 0; !sliders_at(v, 100 - v); t++) {
+      if (t == 100) return FALSE;
+      g_usleep(1000);
+      tick();
+    }
+  }
+  return TRUE;
+}
+
+/* the user drags every slider, a step per tick */
+static gboolean moving_ticks(int n) {
+  Mixer *m;
+  Slider *s;
+  gint writes;
+  int i;
+  for (i = 0; i < n; i++) {
+    writes = g_atomic_int_get(&fake_writes);
+    for (m = Mixerz; m != NULL; m = m->next)
+      for (s = m->Sliderz; s != NULL; s = s->next)
+        volume_set_volume(s, i % 101);
+    tick();
+    if (!fake_wait_for(&fake_writes, writes)) return FALSE;
+  }
+  return TRUE;
+}
+
+int main(void) {
+  gboolean ok;
+  int n, idle;
+
+  setup();
+  if ((n = nr_sliders()) != SLIDERS) {
+    fprintf(stderr, "alloc_test: %d sliders instead of %d\n", n, SLIDERS);
+    return 1;
+  }
+  /* warm up, whatever is allocated once happens here */
+  ok = changing_ticks(3, 50) && moving_ticks(3);
+  idle_ticks(TICKS);
+  if (!ok) {
+    fprintf(stderr, "alloc_test: the io thread didn't follow\n");
+    return 1;
+  }
+
+  n = ticks;
+  g_atomic_int_set(&counting, 1);
+  idle_ticks(TICKS);
+  idle = g_atomic_int_get(&allocations);
+  ok = changing_ticks(TICKS, 0);
+  if (ok) ok = moving_ticks(TICKS);
+  idle_ticks(TICKS);
+  g_atomic_int_set(&counting, 0);
+
+  if (!ok) {
+    fprintf(stderr, "alloc_test: the io thread didn't follow\n");
+    return 1;
+  }
+  if (g_atomic_int_get(&allocations) > 0) {
+    fprintf(stderr, "alloc_test: %d allocations, %d of them idle\n",
+            g_atomic_int_get(&allocations), idle);
+    return 1;
+  }
+  printf("alloc_test: ok, %d ticks without allocation\n", ticks - n);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* the round trips promised in mixer.h, for every percent and raw value of
+ * the ranges backends actually have */
+
+#include <stdio.h>
+
+#include "mixer.h"
+
+static const long ranges[][2] = {
+  { 0, 31 },          /* OSS style and most ALSA playback elements */
+  { 0, 100 },
+  { 0, 255 },
+  { 0, 65536 },       /* pulse, PA_VOLUME_NORM */
+  { -31, 0 },
+  { -128, 127 },
+  { -6400, 0 },       /* dB in hundredths */
+  { -10239, 400 },
+  { -65536, -1 },
+};
+
+static int failures;
+
+static void fail(const char *what, long min, long max, long in, long out) {
+  if (failures++ < 20)
+    fprintf(stderr, "%s: [%ld..%ld] %ld came back as %ld\n",
+            what, min, max, in, out);
+}
+
+static void check_range(long min, long max) {
+  long raw, back;
+  int percent;
+
+  if (mixer_percent_to_raw(0, min, max) != min)
+    fail("percent 0", min, max, 0, mixer_percent_to_raw(0, min, max));
+  if (mixer_percent_to_raw(100, min, max) != max)
+    fail("percent 100", min, max, 100, mixer_percent_to_raw(100, min, max));
+
+  for (percent = 0; percent <= 100; percent++) {
+    raw = mixer_percent_to_raw(percent, min, max);
+    if (raw < min || raw > max) fail("percent out of range", min, max,
+                                     percent, raw);
+    back = mixer_raw_to_percent(raw, min, max);
+    if (max - min >= 100 && back != percent)
+      fail("percent->raw->percent", min, max, percent, back);
+  }
+  for (raw = min; raw <= max; raw++) {
+    percent = mixer_raw_to_percent(raw, min, max);
+    if (percent < 0 || percent > 100) fail("raw out of range", min, max,
+                                           raw, percent);
+    back = mixer_percent_to_raw(percent, min, max);
+    if (max - min <= 100 && back != raw)
+      fail("raw->percent->raw", min, max, raw, back);
+  }
+}
+
+int main(void) {
+  unsigned i;
+  long n;
+
+  for (i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++)
+    check_range(ranges[i][0], ranges[i][1]);
+  /* and every range size around the 100 step boundary */
+  for (n = 1; n <= 300; n++) {
+    check_range(0, n);
+    check_range(-n, 0);
+  }
+  /* outside the range clamps */
+  if ((n = mixer_raw_to_percent(-1, 0, 31)) != 0)
+    fail("raw below min", 0, 31, -1, n);
+  if ((n = mixer_raw_to_percent(32, 0, 31)) != 100)
+    fail("raw above max", 0, 31, 32, n);
+  if ((n = mixer_percent_to_raw(101, -6400, 0)) != 0)
+    fail("percent above 100", -6400, 0, 101, n);
+  if ((n = mixer_raw_to_percent(5, 3, 3)) != 0)
+    fail("empty range", 3, 3, 5, n);
+
+  if (failures) {
+    fprintf(stderr, "convert_test: %d failures\n", failures);
+    return 1;
+  }
+  printf("convert_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,171 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_mixer.h"
+
+volatile gint fake_volumes[2][FAKE_DEVICES][2];
+volatile gint fake_writes = 0;
+fake_write_t fake_log[FAKE_LOG];
+mixer_t *fake_events_mixer = NULL;
+static volatile gint fake_event = 0;
+static volatile gint fake_held = 0;
+static volatile gint fake_in_held = 0;
+
+static int fake_index(mixer_t *mixer) {
+  return mixer == fake_events_mixer;
+}
+
+static mixer_t *fake_open(char *id);
+
+static void fake_close(mixer_t *mixer) {
+  int i;
+  if (mixer == fake_events_mixer) fake_events_mixer = NULL;
+  for (i = 0; i < mixer->nrdevices; i++) {
+    free(mixer->dev_names[i]);
+    free(mixer->dev_realnames[i]);
+  }
+  free(mixer->dev_names);
+  free(mixer->dev_realnames);
+  free(mixer->name);
+  free(mixer);
+}
+
+static long fake_get_fullscale(mixer_t *mixer, int devid) {
+  return 100;
+}
+
+static void fake_get_volume(mixer_t *mixer, int devid, int *left, int *right) {
+  *left = g_atomic_int_get(&fake_volumes[fake_index(mixer)][devid][0]);
+  *right = g_atomic_int_get(&fake_volumes[fake_index(mixer)][devid][1]);
+}
+
+static void fake_set_volume(mixer_t *mixer, int devid, int left, int right) {
+  gint n = g_atomic_int_get(&fake_writes);
+
+  if (g_atomic_int_get(&fake_held)) {
+    g_atomic_int_set(&fake_in_held, 1);
+    while (g_atomic_int_get(&fake_held)) g_usleep(100);
+    g_atomic_int_set(&fake_in_held, 0);
+  }
+  g_atomic_int_set(&fake_volumes[fake_index(mixer)][devid][0], left);
+  g_atomic_int_set(&fake_volumes[fake_index(mixer)][devid][1], right);
+  if (n < FAKE_LOG) {
+    fake_log[n].events = fake_index(mixer);
+    fake_log[n].devid = devid;
+    fake_log[n].left = left;
+    fake_log[n].right = right;
+  }
+  g_atomic_int_inc(&fake_writes);
+}
+
+static mixer_ops_t fake_ops = {
+  .mixer_open = fake_open,
+  .mixer_close = fake_close,
+  .mixer_device_get_fullscale = fake_get_fullscale,
+  .mixer_device_get_volume = fake_get_volume,
+  .mixer_device_set_volume = fake_set_volume
+};
+
+static mixer_t *fake_open(char *id) {
+  const char *names[] = { "Master", "PCM", "Line", "Mic" };
+  mixer_t *result;
+  int i;
+
+  if (strcmp(id, "poll") && strcmp(id, "events")) return NULL;
+  result = calloc(1, sizeof(mixer_t));
+  result->name = strdup(id);
+  result->nrdevices = FAKE_DEVICES;
+  result->dev_names = calloc(FAKE_DEVICES, sizeof(char *));
+  result->dev_realnames = calloc(FAKE_DEVICES, sizeof(char *));
+  for (i = 0; i < FAKE_DEVICES; i++)
+    result->dev_realnames[i] = strdup(names[i % G_N_ELEMENTS(names)]);
+  result->ops = &fake_ops;
+  result->notifies = !strcmp(id, "events");
+  if (result->notifies) fake_events_mixer = result;
+  return result;
+}
+
+/* replaces oss_mixer.o, which isn't linked */
+mixer_ops_t *init_oss_mixer(void) {
+  return &fake_ops;
+}
+
+/* the events of "oss:events", handled in the io thread like a card's */
+static gboolean fake_event_prepare(GSource *source, gint *timeout) {
+  *timeout = -1;
+  return g_atomic_int_get(&fake_event);
+}
+
+static gboolean fake_event_check(GSource *source) {
+  return g_atomic_int_get(&fake_event);
+}
+
+static gboolean fake_event_dispatch(GSource *source, GSourceFunc callback,
+                                    gpointer data) {
+  int i;
+  g_atomic_int_set(&fake_event, 0);
+  if (fake_events_mixer == NULL) return TRUE;
+  for (i = 0; i < FAKE_DEVICES; i++) mixer_notify(fake_events_mixer, i);
+  return TRUE;
+}
+
+static GSourceFuncs fake_event_funcs = {
+  fake_event_prepare,
+  fake_event_check,
+  fake_event_dispatch,
+  NULL
+};
+
+void fake_attach_events(void) {
+  GSource *source = g_source_new(&fake_event_funcs, sizeof(GSource));
+  g_source_attach(source, mixer_get_context());
+  g_source_unref(source);
+}
+
+void fake_change(int volume) {
+  int i, j;
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < FAKE_DEVICES; j++) {
+      g_atomic_int_set(&fake_volumes[i][j][0], volume);
+      g_atomic_int_set(&fake_volumes[i][j][1], 100 - volume);
+    }
+  g_atomic_int_set(&fake_event, 1);
+  g_main_context_wakeup(mixer_get_context());
+}
+
+void fake_hold(void) {
+  g_atomic_int_set(&fake_held, 1);
+}
+
+gboolean fake_wait_held(void) {
+  gint64 start = g_get_monotonic_time();
+  while (!g_atomic_int_get(&fake_in_held))
+    if (g_get_monotonic_time() - start > FAKE_TIMEOUT) return FALSE;
+    else g_usleep(100);
+  return TRUE;
+}
+
+void fake_release(void) {
+  g_atomic_int_set(&fake_held, 0);
+}
+
+gboolean fake_wait_for(volatile gint *counter, gint old) {
+  gint64 start = g_get_monotonic_time();
+  while (g_atomic_int_get(counter) == old)
+    if (g_get_monotonic_time() - start > FAKE_TIMEOUT) return FALSE;
+    else g_usleep(100);
+  return TRUE;
+}
@@ -0,0 +1,56 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* A backend for the tests, linked in place of oss_mixer.o. "oss:poll" is
+ * read every poll like OSS, "oss:events" reports changes itself like ALSA.
+ * Both have FAKE_DEVICES stereo devices with a full scale of 100, what the
+ * hardware has lives in fake_volumes. Writes only ever happen in the io
+ * thread, they are counted and the first FAKE_LOG of them logged. */
+
+#ifndef VOLUME_FAKE_MIXER_H
+#define VOLUME_FAKE_MIXER_H
+
+#include "mixer.h"
+
+#define FAKE_DEVICES 4
+#define FAKE_LOG 1024
+/* how long to wait for the io thread, in us */
+#define FAKE_TIMEOUT 2000000
+
+typedef struct {
+  /* 0 for "oss:poll", 1 for "oss:events" */
+  int events;
+  int devid, left, right;
+} fake_write_t;
+
+extern volatile gint fake_volumes[2][FAKE_DEVICES][2];
+extern volatile gint fake_writes;
+extern fake_write_t fake_log[FAKE_LOG];
+/* the open "oss:events", NULL if none */
+extern mixer_t *fake_events_mixer;
+
+/* starts delivering the events of "oss:events" in the io thread */
+void fake_attach_events(void);
+/* the hardware of both mixers changes behind the plugin's back, left to
+ * volume and right to 100 - volume */
+void fake_change(int volume);
+/* from fake_hold on writes stop inside the backend until fake_release, so
+ * commands pile up behind them. fake_wait_held returns once the io thread
+ * sits in such a write, FALSE if none came within FAKE_TIMEOUT */
+void fake_hold(void);
+gboolean fake_wait_held(void);
+void fake_release(void);
+/* waits for the io thread to move the counter past old */
+gboolean fake_wait_for(volatile gint *counter, gint old);
+
+#endif /* VOLUME_FAKE_MIXER_H */
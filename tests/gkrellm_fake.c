@@ -0,0 +1,79 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* Stand-ins for what gkrellm exports to its plugins, so volume.c links into
+ * a test program. They don't include gkrellm.h and take their arguments as
+ * plain pointers: the tests only go through the update path, none of them
+ * draws anything or hands out a panel */
+
+#include <stddef.h>
+
+int gkrellm_update_HZ(void) { return 10; }
+int gkrellm_client_mode(void) { return 0; }
+void gkrellm_config_modified(void) { }
+
+/* the update path */
+void gkrellm_update_krell(void *panel, void *krell, unsigned long value) { }
+void gkrellm_draw_panel_layers(void *panel) { }
+void gkrellm_draw_decal_text(void *panel, void *decal, char *text, int value) { }
+void gkrellm_insert_krell(void *panel, void *krell, int append) { }
+void gkrellm_remove_krell(void *panel, void *krell) { }
+void gkrellm_set_krell_full_scale(void *krell, int full_scale, int factor) { }
+void gkrellm_monotonic_krell_values(void *krell, int mono) { }
+void gkrellm_move_krell_yoff(void *panel, void *krell, int yoff) { }
+
+/* panels, styles and the config tab, never reached */
+void *gkrellm_panel_new0(void) { return NULL; }
+void gkrellm_panel_create(void *box, void *mon, void *panel) { }
+void gkrellm_panel_configure(void *panel, char *label, void *style) { }
+void gkrellm_panel_destroy(void *panel) { }
+void *gkrellm_create_krell(void *panel, void *image, void *style) {
+  return NULL;
+}
+void *gkrellm_create_decal_text(void *panel, char *text, void *ts,
+                                void *style, int x, int y, int w) {
+  return NULL;
+}
+int gkrellm_add_meter_style(void *mon, char *name) { return 0; }
+void *gkrellm_meter_style(int id) { return NULL; }
+void *gkrellm_meter_style_by_name(char *name) { return NULL; }
+void *gkrellm_meter_textstyle(int id) { return NULL; }
+void *gkrellm_copy_style(void *style) { return NULL; }
+int gkrellm_style_is_themed(void *style, int query) { return 0; }
+void gkrellm_set_style_slider_values_default(void *style, int yoff,
+                                             int left, int right) { }
+void *gkrellm_krell_slider_style(void) { return NULL; }
+void *gkrellm_krell_slider_piximage(void) { return NULL; }
+void *gkrellm_krell_meter_piximage(int id) { return NULL; }
+void gkrellm_locale_dup_string(char **dst, char *src, char **locale) { }
+void gkrellm_message_window(char *title, char *message, void *widget) { }
+void *gkrellm_gtk_notebook_page(void *tabs, char *name) { return NULL; }
+void *gkrellm_gtk_framed_notebook_page(void *tabs, char *name) {
+  return NULL;
+}
+void *gkrellm_gtk_framed_vbox(void *box, char *label, int frame_border,
+                              int frame_expand, int vbox_pad,
+                              int vbox_border) {
+  return NULL;
+}
+void *gkrellm_gtk_scrolled_text_view(void *box, void **view, int h, int v) {
+  return NULL;
+}
+void gkrellm_gtk_text_view_append(void *view, char *text) { }
+void *gkrellm_gtk_spin_button(void *box, void **spin, double value,
+                              double low, double high, double step0,
+                              double step1, int digits, int width,
+                              void (*cb)(), void *data, int right_align,
+                              char *label) {
+  return NULL;
+}
@@ -0,0 +1,228 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+/* The io thread's command queue and volume tables, against the fake
+ * backend. A write held in the backend keeps the io thread busy while
+ * commands pile up behind it:
+ *
+ *  - fifo: sets and batches of several devices reach the backend in the
+ *    order they were made
+ *  - coalesce: SETS sets of one device make one write, of the last volume,
+ *    and reads see that volume while it is queued
+ *  - seqlock: the io thread publishes PUBLISHES rounds of volumes while the
+ *    main thread reads, no read may see a half published device */
+
+#include <stdio.h>
+
+#include "mixer.h"
+#include "fake_mixer.h"
+
+#define SETS 10000
+#define PUBLISHES 200000
+#define PUBLISH_BURST 1000
+
+static int failures = 0;
+
+static void fail(const char *test, const char *what) {
+  fprintf(stderr, "queue_test: %s: %s\n", test, what);
+  failures++;
+}
+
+static void set(mixer_t *mixer, int devid, int volume) {
+  mixer_set_device_volume(mixer, devid, volume, volume);
+}
+
+static void batch(mixer_t *mixer, int n, const int *devids, int volume) {
+  int volumes[FAKE_DEVICES * MIXER_MAX_CHANNELS];
+  int i, c;
+
+  for (i = 0; i < n; i++)
+    for (c = 0; c < MIXER_MAX_CHANNELS; c++)
+      volumes[i * MIXER_MAX_CHANNELS + c] = volume;
+  mixer_set_devices_channels(mixer, n, devids, volumes);
+}
+
+/* waits until the backend saw n writes in total */
+static gboolean wait_writes(gint n) {
+  gint seen;
+  while ((seen = g_atomic_int_get(&fake_writes)) < n)
+    if (!fake_wait_for(&fake_writes, seen)) return FALSE;
+  return TRUE;
+}
+
+static gboolean logged(int n, int devid, int volume) {
+  return fake_log[n].devid == devid && fake_log[n].left == volume &&
+         fake_log[n].right == volume;
+}
+
+/* A write is always of the newest volume of its device, so the values are
+ * what was asked last. The order of the devices is the order of the
+ * commands: newest first would be 2 0 1 3 2 3 1 */
+static void test_fifo(mixer_t *mixer) {
+  static const int expect[][2] = {
+    { 1, 14 },           /* set 1 */
+    { 2, 15 }, { 3, 13 }, /* batch 2 3 */
+    { 3, 13 },           /* set 3 */
+    { 0, 14 }, { 1, 14 }, /* batch 0 1 */
+    { 2, 15 }            /* set 2 */
+  };
+  static const int devs23[] = { 2, 3 }, devs01[] = { 0, 1 };
+  gint first;
+  guint i;
+
+  first = g_atomic_int_get(&fake_writes);
+  fake_hold();
+  set(mixer, 0, 10);
+  if (!fake_wait_held()) {
+    fake_release();
+    fail("fifo", "the io thread didn't write");
+    return;
+  }
+  set(mixer, 1, 11);
+  batch(mixer, 2, devs23, 12);
+  set(mixer, 3, 13);
+  batch(mixer, 2, devs01, 14);
+  set(mixer, 2, 15);
+  fake_release();
+
+  if (!wait_writes(first + 1 + G_N_ELEMENTS(expect))) {
+    fail("fifo", "writes went missing");
+    return;
+  }
+  if (!logged(first, 0, 10)) fail("fifo", "the held write changed");
+  for (i = 0; i < G_N_ELEMENTS(expect); i++)
+    if (!logged(first + 1 + i, expect[i][0], expect[i][1])) {
+      fail("fifo", "commands ran out of order");
+      break;
+    }
+}
+
+static void test_coalesce(mixer_t *mixer) {
+  static const int devs1[] = { 1 };
+  int i, left, right;
+  gint first;
+
+  first = g_atomic_int_get(&fake_writes);
+  fake_hold();
+  set(mixer, 0, 20);
+  if (!fake_wait_held()) {
+    fake_release();
+    fail("coalesce", "the io thread didn't write");
+    return;
+  }
+  for (i = 0; i < SETS; i++) {
+    set(mixer, 1, i % 101);
+    mixer_get_device_volume(mixer, 1, &left, &right);
+    if (left != i % 101 || right != i % 101) {
+      fail("coalesce", "a queued set doesn't read back");
+      break;
+    }
+  }
+  /* a batch behind the queued set and a set after it, the last one wins */
+  batch(mixer, 1, devs1, 30);
+  set(mixer, 1, 40);
+  fake_release();
+
+  /* the held write, the set and the batch */
+  if (!wait_writes(first + 3)) {
+    fail("coalesce", "writes went missing");
+    return;
+  }
+  g_usleep(100000);
+  if (g_atomic_int_get(&fake_writes) != first + 3)
+    fail("coalesce", "sets of one device weren't coalesced");
+  if (!logged(first + 1, 1, 40) || !logged(first + 2, 1, 40))
+    fail("coalesce", "not the last volume was written");
+  mixer_get_device_volume(mixer, 1, &left, &right);
+  if (left != 40 || right != 40)
+    fail("coalesce", "the written volume doesn't read back");
+}
+
+/* in the io thread: every round moves all devices of the event mixer to
+ * the same new volume on both channels and has it published. Rounds come
+ * in bursts, a read gets torn only if two publishes land during it */
+static volatile gint published = 0;
+
+static gboolean publish_rounds(gpointer data) {
+  gint round = g_atomic_int_get(&published);
+  int i, burst;
+
+  for (burst = 0; burst < PUBLISH_BURST && round < PUBLISHES; burst++) {
+    round++;
+    for (i = 0; i < FAKE_DEVICES; i++) {
+      g_atomic_int_set(&fake_volumes[1][i][0], round);
+      g_atomic_int_set(&fake_volumes[1][i][1], round);
+      mixer_notify(fake_events_mixer, i);
+    }
+    g_atomic_int_set(&published, round);
+  }
+  return round < PUBLISHES;
+}
+
+static void test_seqlock(mixer_t *mixer) {
+  int last[FAKE_DEVICES] = { 0 };
+  int volumes[MIXER_MAX_CHANNELS];
+  GSource *idle;
+  long reads = 0;
+  gint64 start;
+  int i;
+
+  idle = g_idle_source_new();
+  g_source_set_callback(idle, publish_rounds, NULL, NULL);
+  g_source_attach(idle, mixer_get_context());
+  g_source_unref(idle);
+
+  start = g_get_monotonic_time();
+  do {
+    for (i = 0; i < FAKE_DEVICES; i++, reads++) {
+      mixer_get_device_channels(mixer, i, volumes);
+      if (volumes[0] != volumes[1] || volumes[0] < last[i]) {
+        fail("seqlock", "read a half published device");
+        return;
+      }
+      last[i] = volumes[0];
+    }
+    if (g_get_monotonic_time() - start > 10 * FAKE_TIMEOUT) {
+      fail("seqlock", "the io thread didn't publish");
+      return;
+    }
+  } while (g_atomic_int_get(&published) < PUBLISHES);
+
+  for (i = 0; i < FAKE_DEVICES; i++) {
+    mixer_get_device_channels(mixer, i, volumes);
+    if (volumes[0] != PUBLISHES || volumes[1] != PUBLISHES)
+      fail("seqlock", "the last round didn't read back");
+  }
+  printf("queue_test: %ld reads during %d publishes\n", reads,
+         PUBLISHES * FAKE_DEVICES);
+}
+
+int main(void) {
+  mixer_t *poll, *events;
+
+  init_mixer();
+  fake_attach_events();
+  if ((poll = mixer_open("oss:poll")) == NULL ||
+      (events = mixer_open("oss:events")) == NULL) {
+    fprintf(stderr, "queue_test: can't open the fake mixers\n");
+    return 1;
+  }
+  test_fifo(poll);
+  test_coalesce(poll);
+  test_seqlock(events);
+  mixer_close(events);
+  mixer_close(poll);
+  if (failures > 0) return 1;
+  printf("queue_test: ok\n");
+  return 0;
+}
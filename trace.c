@@ -0,0 +1,155 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_ENV "GKRELLM_VOLUME_TRACE"
+
+typedef struct {
+  char *name;
+  char *detail;
+  gint64 start, end;
+  int tid;
+} trace_event_t;
+
+G_LOCK_DEFINE_STATIC(trace);
+/* 0 not checked yet, 1 tracing, -1 off or done */
+static int trace_state = 0;
+static GArray *trace_events = NULL;
+/* threads in order of their first event, the index is the tid */
+static GPtrArray *trace_threads = NULL;
+
+/* must be called with the lock held */
+static gboolean
+trace_enabled(void) {
+  if (trace_state == 0) {
+    trace_state = g_getenv(TRACE_ENV) != NULL ? 1 : -1;
+    if (trace_state > 0) {
+      trace_events = g_array_new(FALSE, FALSE, sizeof(trace_event_t));
+      trace_threads = g_ptr_array_new();
+    }
+  }
+  return trace_state > 0;
+}
+
+gint64
+trace_start(void) {
+  gboolean enabled;
+
+  G_LOCK(trace);
+  enabled = trace_enabled();
+  G_UNLOCK(trace);
+  return enabled ? g_get_monotonic_time() : 0;
+}
+
+void
+trace_end(const char *name, const char *detail, gint64 start) {
+  trace_event_t e;
+  GThread *self = g_thread_self();
+  guint i;
+
+  if (start == 0)
+    return;
+  e.end = g_get_monotonic_time();
+  e.start = start;
+  e.name = g_strdup(name);
+  e.detail = g_strdup(detail);
+
+  G_LOCK(trace);
+  if (trace_state > 0) {
+    for (i = 0; i < trace_threads->len; i++)
+      if (g_ptr_array_index(trace_threads, i) == self)
+        break;
+    if (i == trace_threads->len)
+      g_ptr_array_add(trace_threads, self);
+    e.tid = i + 1;
+    g_array_append_val(trace_events, e);
+  } else {
+    g_free(e.name);
+    g_free(e.detail);
+  }
+  G_UNLOCK(trace);
+}
+
+static void
+trace_write_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20)
+      fprintf(f, "\\u%04x", (unsigned char) *s);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+void
+trace_write(void) {
+  const char *path;
+  trace_event_t *e;
+  FILE *f = NULL;
+  guint i;
+
+  G_LOCK(trace);
+  if (trace_state <= 0) {
+    G_UNLOCK(trace);
+    return;
+  }
+  trace_state = -1;
+  G_UNLOCK(trace);
+
+  /* nobody adds events anymore */
+  path = g_getenv(TRACE_ENV);
+  if (path != NULL && (f = fopen(path, "w")) == NULL)
+    fprintf(stderr, "volume: can't write trace to %s\n", path);
+  if (f != NULL) {
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (i = 0; i < trace_events->len; i++) {
+      e = &g_array_index(trace_events, trace_event_t, i);
+      fprintf(f, "{\"name\":");
+      trace_write_string(f, e->name);
+      fprintf(f, ",\"cat\":\"volume\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+              "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT,
+              e->tid, e->start, e->end - e->start);
+      if (e->detail != NULL) {
+        fprintf(f, ",\"args\":{\"detail\":");
+        trace_write_string(f, e->detail);
+        fputc('}', f);
+      }
+      fprintf(f, "},\n");
+    }
+    /* this runs in the main loop, everything else is the io thread */
+    for (i = 0; i < trace_threads->len; i++)
+      fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", i + 1,
+              g_ptr_array_index(trace_threads, i) == g_thread_self() ?
+                "main" : "io");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"gkrellm volume\"}}\n");
+    fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+  }
+
+  for (i = 0; i < trace_events->len; i++) {
+    e = &g_array_index(trace_events, trace_event_t, i);
+    g_free(e->name);
+    g_free(e->detail);
+  }
+  g_array_free(trace_events, TRUE);
+  g_ptr_array_free(trace_threads, TRUE);
+}
@@ -0,0 +1,19 @@
+#ifndef VOLUME_TRACE_H
+#define VOLUME_TRACE_H
+
+#include <glib.h>
+
+/* Startup timeline. When GKRELLM_VOLUME_TRACE names a file, the plugin
+ * records what it does from gkrellm_init_plugin until the first update and
+ * then writes it there in the Chrome trace event format (load it in
+ * chrome://tracing or ui.perfetto.dev). Otherwise all of this does nothing.
+ * Usable from any thread. */
+
+/* returns the start time of an event, 0 if not tracing */
+gint64 trace_start(void);
+/* records the event name (with an optional detail) from start until now */
+void trace_end(const char *name, const char *detail, gint64 start);
+/* writes the file and stops tracing */
+void trace_write(void);
+
+#endif /* VOLUME_TRACE_H */
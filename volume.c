@@ -1,5 +1,4 @@
 #include <stdio.h>
-#include <math.h>
 
 #if !defined(WIN32)
   #include <gkrellm2/gkrellm.h>
@@ -7,6 +6,17 @@
 
 #include "volume.h"
 #include "mixer.h"
+#include "trace.h"
+#include "config_parse.h"
+#ifdef SHM_EXPORT
+  #include "shm_export.h"
+#endif
+#ifdef CONTROL_SOCKET
+  #include "control.h"
+#endif
+#ifdef REMOTE
+  #include "remote_mixer.h"
+#endif
 
 #define VOLUME_STYLE style_id
 static gint style_id;
@@ -17,45 +27,130 @@ static int global_flags = 0;
 static int config_global_flags = 0;
 static GtkWidget *right_click_entry;
 static char right_click_cmd[1024];
+/* longest time between two reads of a mixer that doesn't report changes */
+#define DEFAULT_POLL_CEILING 2000
+static int poll_ceiling = DEFAULT_POLL_CEILING;
+static GtkWidget *poll_ceiling_spin;
+/* ms to ramp into a scene, 0 applies it at once */
+#define DEFAULT_SCENE_RAMP 0
+#define SCENE_STEP_MS 20
+static int scene_ramp = DEFAULT_SCENE_RAMP;
+static GtkWidget *scene_ramp_spin, *scene_combo;
+static Scene *Scenez = NULL;
+/* a slider changed since the state was last exported */
+static gboolean export_dirty = TRUE;
+/* the config lines gkrellm hands us one by one, applied all at once when
+ * the panels are created */
+static config_parser_t *config_parser = NULL;
+
+static void volume_mixer_changed(mixer_t *mixer, int devid, void *data);
+static void volume_apply_config(const volume_config_t *config);
+static void scene_release(Slider *s);
 
 /* functions for the bookkeeping of open mixers and sliders */
+/* returns the open mixer with this id or NULL, ids without a backend scheme
+ * match too */
+static Mixer *find_mixer_by_id(char *id) {
+  Mixer *m;
+  char *canonical = mixer_id_canonical(id);
+  for (m = Mixerz; m != NULL; m = m->next)
+    if (!strcmp(canonical,m->id)) break;
+  g_free(canonical);
+  return m;
+}
+
+static Mixer *new_mixer(char *id, mixer_t *mixer) {
+  Mixer *result = calloc(1, sizeof(Mixer));
+  char *canonical = mixer_id_canonical(id);
+  /* configs written from now on have the scheme in the id */
+  result->id = strdup(canonical);
+  g_free(canonical);
+  result->poll_interval = result->poll_countdown = 1;
+  result->mixer = mixer;
+  result->next = NULL;
+  result->Sliderz = NULL;
+  mixer_set_notify(mixer, volume_mixer_changed, result);
+  return result;
+}
+
 /* retuns the added mixer or and existing one with the same id */
 static Mixer *add_mixer_by_id(char *id) {
   Mixer *result,**m;
   mixer_t *mixer;
 
-  if (Mixerz == NULL) m = &Mixerz;
-  else {
-    result = Mixerz;
-    do {
-        if (!strcmp(id,result->id)) return result;
-    } while (result->next != NULL && (result = result->next));
-    m = &(result->next);
-  }
+  if ((result = find_mixer_by_id(id)) != NULL) return result;
+  for (m = &Mixerz; *m != NULL; m = &((*m)->next));
 
   if ((mixer = mixer_open(id)) == NULL) return NULL;
 
-  result = malloc(sizeof(Mixer));
-  result->id = strdup(id);
-  result->mixer = mixer;
-  result->next = NULL;
-  result->Sliderz = NULL;
+  result = new_mixer(id, mixer);
   /* add The Mixer to the end */
   *m = result;
   return result;
 }
 
-static void remove_mixer(Mixer *m) {
-  Slider *s,*s1;
-  Mixer *tmp;
+/* moves the mixer with this id to *pos, opening it if it isn't in the list
+ * after pos yet */
+static Mixer *place_mixer(Mixer **pos, char *id) {
+  Mixer *result,**m;
+  mixer_t *mixer;
+  char *canonical = mixer_id_canonical(id);
 
-  for (s = m->Sliderz ; s != NULL ;s = s1) {
-    gkrellm_panel_destroy(s->panel);
-    if (s->bal) gkrellm_panel_destroy(s->bal->panel);
-    s1 = s->next;
+  for (m = pos; *m != NULL; m = &((*m)->next))
+    if (!strcmp(canonical,(*m)->id)) break;
+
+  if (*m != NULL) {
+    result = *m;
+    *m = result->next;
+  } else {
+    mixer = mixer_open(canonical);
+    result = mixer != NULL ? new_mixer(canonical, mixer) : NULL;
+  }
+  g_free(canonical);
+  if (result == NULL) return NULL;
+  result->next = *pos;
+  *pos = result;
+  return result;
+}
+
+static void remove_bslider(Slider *s) {
+  if (s->bal != NULL) {
+    gkrellm_panel_destroy(s->bal->panel);
     free(s->bal);
-    free(s);
+    s->bal = NULL;
   }
+  if (s->fad != NULL) {
+    gkrellm_panel_destroy(s->fad->panel);
+    free(s->fad);
+    s->fad = NULL;
+  }
+}
+
+static void remove_slider_panels(Slider *s) {
+  if (s->panel != NULL) gkrellm_panel_destroy(s->panel);
+  s->panel = NULL;
+  s->krell = NULL;
+  remove_bslider(s);
+#ifdef VU_METER
+  if (s->vu != NULL) vu_meter_close(s->vu);
+  s->vu = NULL;
+  s->vu_krell = NULL;
+#endif
+}
+
+/* removes the slider at *pos from its list */
+static void remove_slider(Slider **pos) {
+  Slider *s = *pos;
+  *pos = s->next;
+  scene_release(s);
+  remove_slider_panels(s);
+  free(s);
+}
+
+static void remove_mixer(Mixer *m) {
+  Mixer *tmp;
+
+  while (m->Sliderz != NULL) remove_slider(&m->Sliderz);
 
   mixer_close(m->mixer);
   free(m->id);
@@ -65,26 +160,39 @@ static void remove_mixer(Mixer *m) {
     /* tmp->next == m */
     tmp->next = m->next;
   }
+  free(m);
 }
 
-static void remove_all_mixers() {
-  while(Mixerz != NULL) remove_mixer(Mixerz);
-}
-
-static Slider *add_slider(Mixer *m, int dev) {
-  Slider *result,*s;
-  if (dev < 0 || dev >= mixer_get_nr_devices(m->mixer)) return NULL;
-  result = malloc(sizeof(Slider));
+static Slider *new_slider(Mixer *m, int dev) {
+  Slider *result = malloc(sizeof(Slider));
   result->mixer = m->mixer;
   result->parent = m;
   result->dev = dev;
+  result->desc = mixer_get_device(m->mixer, dev);
   result->flags = 0;
   result->next = NULL;
   result->krell = NULL;
   result->panel = NULL;
   result->balance = 0;
-  result->pleft = result->pright = -1;
+  result->fader = 0;
+  /* no volume seen yet */
+  memset(result->saved, 0, sizeof(result->saved));
+  result->saved[0] = -1;
   result->bal = NULL;
+  result->fad = NULL;
+#ifdef VU_METER
+  result->vu = NULL;
+  result->vu_krell = NULL;
+#endif
+  /* some backends only load the devices that are shown */
+  mixer_want_device(m->mixer, dev);
+  return result;
+}
+
+static Slider *add_slider(Mixer *m, int dev) {
+  Slider *result,*s;
+  if (dev < 0 || dev >= mixer_get_nr_devices(m->mixer)) return NULL;
+  result = new_slider(m, dev);
   if (m->Sliderz == NULL) m->Sliderz = result;
   else {
     for (s = m->Sliderz ; s->next != NULL; s = s->next);
@@ -93,6 +201,28 @@ static Slider *add_slider(Mixer *m, int dev) {
   return result;
 }
 
+/* moves the slider for dev to *pos, creating it if it isn't in the list after
+ * pos yet. *created tells which of the two happened */
+static Slider *place_slider(Mixer *m, Slider **pos, int dev, int *created) {
+  Slider *result,**s;
+
+  for (s = pos; *s != NULL; s = &((*s)->next))
+    if ((*s)->dev == dev) break;
+
+  if (*s != NULL) {
+    result = *s;
+    *s = result->next;
+    *created = FALSE;
+  } else {
+    if (dev < 0 || dev >= mixer_get_nr_devices(m->mixer)) return NULL;
+    result = new_slider(m, dev);
+    *created = TRUE;
+  }
+  result->next = *pos;
+  *pos = result;
+  return result;
+}
+
 /*---*/
 
 static gint
@@ -119,66 +249,134 @@ volume_expose_event(GtkWidget *widget, GdkEventExpose *event,gpointer slide) {
 
 static gint
 volume_get_volume(Slider *s) {
-  gint left,right;
-  mixer_get_device_volume(s->mixer,s->dev,&left,&right);
-  return left > right ?  left : right;
+  gint volumes[MIXER_MAX_CHANNELS];
+  gint volume,balance,fader;
+  mixer_get_device_channels(s->mixer,s->dev,volumes);
+  mixer_measure_channels(s->desc,volumes,&volume,&balance,&fader);
+  return volume;
 }
 
+#ifdef CONTROL_SOCKET
+/* what the control socket reports, while muted the volume that gets
+ * restored rather than the 0 on the hardware */
+static void
+volume_get_stereo(Slider *s,gint *left,gint *right) {
+  if (GET_FLAG(s->flags,MUTED))
+    mixer_channels_to_stereo(s->desc,s->saved,left,right);
+  else mixer_get_device_volume(s->mixer,s->dev,left,right);
+}
+#endif
+
 static void
 volume_show_volume(Slider *s) {
   if (s->krell != NULL)
     gkrellm_update_krell(s->panel,s->krell,volume_get_volume(s));
   gkrellm_draw_panel_layers(s->panel);
   gkrellm_config_modified();
+  export_dirty = TRUE;
+#ifdef CONTROL_SOCKET
+  {
+    gint left,right;
+    volume_get_stereo(s,&left,&right);
+    control_changed(s->parent->id,s->dev,left,right,
+                    GET_FLAG(s->flags,MUTED) != 0);
+  }
+#endif
 }
 
+/* the sliders of an offline mixer lose their knob until it's back */
+static void
+volume_show_health(Slider *s) {
+  gboolean offline = mixer_get_health(s->mixer) == MIXER_OFFLINE;
+
+  if (s->krell == NULL || s->panel == NULL ||
+      offline == (GET_FLAG(s->flags,OFFLINE) != 0))
+    return;
+  if (offline) {
+    SET_FLAG(s->flags,OFFLINE);
+    gkrellm_remove_krell(s->panel,s->krell);
+  } else {
+    DEL_FLAG(s->flags,OFFLINE);
+    gkrellm_insert_krell(s->panel,s->krell,TRUE);
+    gkrellm_update_krell(s->panel,s->krell,volume_get_volume(s));
+  }
+  gkrellm_draw_panel_layers(s->panel);
+}
+
+/* the user is doing something, read the mixer every tick for a while */
+static void
+volume_poll_fast(Mixer *m) {
+  m->poll_interval = m->poll_countdown = 1;
+  m->poll_changed = TRUE;
+}
 
 static void
 volume_set_volume(Slider *s,gint volume) {
-  gint left,right;
+  gint volumes[MIXER_MAX_CHANNELS];
 
+  scene_release(s);
   if (GET_FLAG(s->flags,MUTED)) return;
   volume = volume < 0 ? 0 : volume;
   if (volume < 0) volume = 0;
-  else if (volume > mixer_get_device_fullscale(s->mixer,s->dev))
-      volume = mixer_get_device_fullscale(s->mixer,s->dev);
-
-  if (s->balance == 0 && !GET_FLAG(s->flags,BALANCE)) left = right = volume;
-  else if (s->balance > 0) {
-    right = volume;
-    left = ((100 - s->balance)* volume) / 100;
-  } else { /* balance < 0 */
-    left = volume;
-    right = ((100 + s->balance)* volume) / 100;
-  }
-  mixer_set_device_volume(s->mixer,s->dev,left,right);
-  s->pleft = left; s->pright = right;
+  else if (volume > s->desc->fullscale) volume = s->desc->fullscale;
+
+  mixer_scale_channels(s->desc,volume,s->balance,s->fader,volumes);
+  mixer_set_device_channels(s->mixer,s->dev,volumes);
+  memcpy(s->saved,volumes,sizeof(s->saved));
+  volume_poll_fast(s->parent);
   volume_show_volume(s);
 }
 
+static gint bvolume_get(Bslider *b) {
+  return b->fader ? b->slider->fader : b->slider->balance;
+}
+
+/* the decal texts of the balance and fader sliders for every amount in
+ * [-100..100], in the locale gkrellm draws with. Made with the first slider
+ * so showing a change doesn't allocate */
+static gchar *bslider_labels[2][201];
+
+static void make_bslider_labels(void) {
+  gchar *buf,*buf_utf8;
+  gint fader,amount;
+  if (bslider_labels[0][0] != NULL) return;
+  for (fader = 0; fader < 2; fader++)
+    for (amount = -100; amount <= 100; amount++) {
+      if (amount == 0) buf = g_strdup(_("Centered"));
+      else if (fader) buf = g_strdup_printf("%3d%% %s",abs(amount),
+                     amount > 0 ? _("Rear") : _("Front"));
+      else buf = g_strdup_printf("%3d%% %s",abs(amount),
+                     amount > 0 ? _("Right") : _("Left"));
+      buf_utf8 = NULL;
+      gkrellm_locale_dup_string(&buf_utf8,buf,
+                                &bslider_labels[fader][amount + 100]);
+      g_free(buf);
+      g_free(buf_utf8);
+    }
+}
+
+static void volume_show_bslider(Bslider *b) {
+  gint amount = CLAMP(bvolume_get(b),-100,100);
+  gkrellm_draw_decal_text(b->panel,b->decal,
+                          bslider_labels[b->fader != 0][amount + 100],-1);
+  gkrellm_update_krell(b->panel,b->krell,amount + 100 );
+  gkrellm_draw_panel_layers(b->panel);
+}
+
 static void volume_show_balance(Slider *s) {
-  gchar *buf;
-  gchar *buf_utf8 = NULL, *buf_locale = NULL;
-  if (s->bal == NULL) return;
-  if (s->balance == 0) buf = g_strdup(_("Centered"));
-  else buf = g_strdup_printf("%3d%% %s",abs(s->balance),
-                   s->balance > 0 ? _("Right") : _("Left"));
-
-  gkrellm_locale_dup_string(&buf_utf8, buf, &buf_locale);
-  gkrellm_draw_decal_text(s->bal->panel,s->bal->decal,buf_locale,-1);
-  gkrellm_update_krell(s->bal->panel,s->bal->krell,s->balance + 100 );
-  gkrellm_draw_panel_layers(s->bal->panel);
-  g_free(buf);
-  g_free(buf_locale);
-  g_free(buf_utf8);
+  if (s->bal != NULL) volume_show_bslider(s->bal);
+  if (s->fad != NULL) volume_show_bslider(s->fad);
 }
 
+/* sets the balance, or the fader of the front/rear slider */
 static void
-volume_set_balance(Slider *s,gint amount) {
+bvolume_set(Bslider *b,gint amount) {
+  Slider *s = b->slider;
   if (amount < -100) amount = -100;
   else if (amount > 100) amount = 100;
   if (abs(amount) <= 3) amount = 0;
-  s->balance = amount;
+  if (b->fader) s->fader = amount;
+  else s->balance = amount;
   volume_set_volume(s,volume_get_volume(s));
   volume_show_balance(s);
 }
@@ -187,9 +385,10 @@ static void
 volume_mute_mixer(Mixer *m) {
   Slider *s;
   for (s = m->Sliderz ; s != NULL ; s = s->next) {
+      scene_release(s);
       mixer_set_device_volume(s->mixer,s->dev,0,0);
-      volume_show_volume(s);
       SET_FLAG(s->flags,MUTED);
+      volume_show_volume(s);
   }
 }
 
@@ -197,8 +396,9 @@ static void
 volume_unmute_mixer(Mixer *m) {
   Slider *s;
   for (s = m->Sliderz ; s != NULL ; s = s->next) {
+      scene_release(s);
       DEL_FLAG(s->flags,MUTED);
-      mixer_set_device_volume(s->mixer,s->dev,s->pleft,s->pright);
+      mixer_set_device_channels(s->mixer,s->dev,s->saved);
       volume_show_volume(s);
   }
 }
@@ -206,6 +406,7 @@ volume_unmute_mixer(Mixer *m) {
 static void
 volume_toggle_mute(Slider *s) {
   Mixer *m;
+  volume_poll_fast(s->parent);
   if (GET_FLAG(s->flags,MUTED)) {
     if (GET_FLAG(global_flags,MUTEALL)) {
       for (m = Mixerz ; m != NULL; m = m->next) volume_unmute_mixer(m);
@@ -217,6 +418,300 @@ volume_toggle_mute(Slider *s) {
   }
 }
 
+static Slider *find_mixer_slider(Mixer *m, int devid) {
+  Slider *s;
+  for (s = m->Sliderz; s != NULL; s = s->next)
+    if (s->dev == devid) return s;
+  return NULL;
+}
+
+/* Scenes: the volumes, balance and mute of every slider under a name. A
+ * scene is applied with one batch per mixer, or a batch per mixer every
+ * SCENE_STEP_MS while ramping into it */
+static Scene *ramp_scene = NULL;
+static int ramp_step, ramp_steps;
+static guint ramp_id = 0;
+/* what a step hands to mixer_set_devices_channels, made big enough for the
+ * scene by apply_scene so the steps don't allocate */
+static int *ramp_devids = NULL, *ramp_volumes = NULL;
+static Slider **ramp_sliders = NULL;
+static guint ramp_size = 0;
+
+static Scene *find_scene(const char *name) {
+  Scene *sc;
+  for (sc = Scenez; sc != NULL; sc = sc->next)
+    if (!strcmp(sc->name,name)) return sc;
+  return NULL;
+}
+
+static void scene_stop_ramp(void) {
+  if (ramp_id != 0) g_source_remove(ramp_id);
+  ramp_id = 0;
+  ramp_scene = NULL;
+}
+
+/* the user took over the slider, the ramp leaves it alone from now on */
+static void scene_release(Slider *s) {
+  SceneDev *d;
+  gboolean ramping = FALSE;
+  guint i;
+  if (ramp_scene == NULL) return;
+  for (i = 0; i < ramp_scene->devs->len; i++) {
+    d = &g_array_index(ramp_scene->devs,SceneDev,i);
+    if (d->dev == s->dev && !strcmp(d->id,s->parent->id)) d->ramping = FALSE;
+    ramping |= d->ramping;
+  }
+  if (!ramping) scene_stop_ramp();
+}
+
+static void scene_clear(Scene *sc) {
+  guint i;
+  if (sc == ramp_scene) scene_stop_ramp();
+  for (i = 0; i < sc->devs->len; i++)
+    free(g_array_index(sc->devs,SceneDev,i).id);
+  g_array_set_size(sc->devs,0);
+}
+
+/* an empty scene, at the end of Scenez if it's new */
+static Scene *add_scene(const char *name) {
+  Scene *sc, **pos;
+  if ((sc = find_scene(name)) != NULL) {
+    scene_clear(sc);
+    return sc;
+  }
+  for (pos = &Scenez; *pos != NULL; pos = &(*pos)->next);
+  sc = *pos = g_new0(Scene,1);
+  sc->name = g_strdup(name);
+  sc->devs = g_array_new(FALSE,TRUE,sizeof(SceneDev));
+  return sc;
+}
+
+static void remove_scene(const char *name) {
+  Scene **pos, *sc;
+  for (pos = &Scenez; *pos != NULL; pos = &(*pos)->next)
+    if (!strcmp((*pos)->name,name)) break;
+  if ((sc = *pos) == NULL) return;
+  scene_clear(sc);
+  *pos = sc->next;
+  g_array_free(sc->devs,TRUE);
+  g_free(sc->name);
+  g_free(sc);
+}
+
+/* takes a snapshot of every slider */
+static void save_scene(const char *name) {
+  Scene *sc = add_scene(name);
+  SceneDev d;
+  Mixer *m;
+  Slider *s;
+  for (m = Mixerz; m != NULL; m = m->next)
+    for (s = m->Sliderz; s != NULL; s = s->next) {
+      memset(&d,0,sizeof(d));
+      d.id = strdup(m->id);
+      d.dev = s->dev;
+      d.muted = GET_FLAG(s->flags,MUTED) != 0;
+      if (d.muted) memcpy(d.volumes,s->saved,sizeof(d.volumes));
+      else mixer_get_device_channels(s->mixer,s->dev,d.volumes);
+      d.balance = s->balance;
+      d.fader = s->fader;
+      g_array_append_val(sc->devs,d);
+    }
+  gkrellm_config_modified();
+}
+
+/* moves the sliders of the scene step/steps of the way from where the ramp
+ * started, the last step also sets their mute state */
+static void scene_step(Scene *sc, int step, int steps) {
+  int *devids = ramp_devids, *volumes = ramp_volumes;
+  Slider **sliders = ramp_sliders;
+  SceneDev *d;
+  Mixer *m;
+  Slider *s;
+  int i,n,c,target;
+
+  for (m = Mixerz; m != NULL; m = m->next) {
+    n = 0;
+    for (i = 0; i < sc->devs->len; i++) {
+      d = &g_array_index(sc->devs,SceneDev,i);
+      if (!d->ramping || strcmp(d->id,m->id) ||
+          (s = find_mixer_slider(m,d->dev)) == NULL)
+        continue;
+      for (c = 0; c < MIXER_MAX_CHANNELS; c++) {
+        target = d->muted ? 0 : MIN(d->volumes[c],s->desc->fullscale);
+        volumes[n * MIXER_MAX_CHANNELS + c] =
+          d->from[c] + (target - d->from[c]) * step / steps;
+      }
+      if (step == steps) {
+        if (d->muted) SET_FLAG(s->flags,MUTED);
+        memcpy(s->saved,d->volumes,sizeof(s->saved));
+      }
+      devids[n] = d->dev;
+      sliders[n++] = s;
+    }
+    mixer_set_devices_channels(m->mixer,n,devids,volumes);
+    for (i = 0; i < n; i++) {
+      if (sliders[i]->panel == NULL) continue;
+      volume_show_volume(sliders[i]);
+      if (step == steps) volume_show_balance(sliders[i]);
+    }
+  }
+}
+
+static gboolean scene_ramp_cb(gpointer data) {
+  scene_step(ramp_scene,++ramp_step,ramp_steps);
+  if (ramp_step < ramp_steps) return TRUE;
+  ramp_scene = NULL;
+  ramp_id = 0;
+  return FALSE;
+}
+
+/* ramp in ms, < 0 for the configured one. FALSE if there's no such scene */
+static gboolean apply_scene(const char *name, int ramp) {
+  Scene *sc = find_scene(name);
+  SceneDev *d;
+  Slider *s;
+  Mixer *m;
+  int i;
+
+  if (sc == NULL) return FALSE;
+  scene_stop_ramp();
+  if (sc->devs->len > ramp_size) {
+    ramp_size = sc->devs->len;
+    ramp_devids = g_renew(int,ramp_devids,ramp_size);
+    ramp_volumes = g_renew(int,ramp_volumes,ramp_size * MIXER_MAX_CHANNELS);
+    ramp_sliders = g_renew(Slider *,ramp_sliders,ramp_size);
+  }
+  for (i = 0; i < sc->devs->len; i++) {
+    d = &g_array_index(sc->devs,SceneDev,i);
+    d->ramping = FALSE;
+    if ((m = find_mixer_by_id(d->id)) == NULL ||
+        (s = find_mixer_slider(m,d->dev)) == NULL)
+      continue;
+    d->ramping = TRUE;
+    mixer_get_device_channels(s->mixer,s->dev,d->from);
+    /* muting only happens at the end, unmuting right away */
+    if (!d->muted) DEL_FLAG(s->flags,MUTED);
+    s->balance = d->balance;
+    s->fader = d->fader;
+    volume_poll_fast(m);
+  }
+  ramp_scene = sc;
+  ramp_step = 0;
+  ramp_steps = MAX(1,(ramp < 0 ? scene_ramp : ramp) / SCENE_STEP_MS);
+  if (ramp_steps == 1) scene_ramp_cb(NULL);
+  else ramp_id = g_timeout_add(SCENE_STEP_MS,scene_ramp_cb,NULL);
+  return TRUE;
+}
+
+static void scene_menu_activate(GtkMenuItem *item, gpointer data) {
+  apply_scene(g_object_get_data(G_OBJECT(item),"scene"),-1);
+}
+
+/* right click without a command picks a scene */
+static void scene_popup(GdkEventButton *ev) {
+  GtkWidget *menu = gtk_menu_new();
+  GtkWidget *item;
+  Scene *sc;
+
+  for (sc = Scenez; sc != NULL; sc = sc->next) {
+    item = gtk_menu_item_new_with_label(sc->name);
+    g_object_set_data_full(G_OBJECT(item),"scene",g_strdup(sc->name),g_free);
+    g_signal_connect(G_OBJECT(item),"activate",
+                     G_CALLBACK(scene_menu_activate),NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu),item);
+  }
+  g_signal_connect(G_OBJECT(menu),"selection-done",
+                   G_CALLBACK(gtk_widget_destroy),NULL);
+  gtk_widget_show_all(menu);
+  gtk_menu_popup(GTK_MENU(menu),NULL,NULL,NULL,NULL,ev->button,ev->time);
+}
+
+#ifdef CONTROL_SOCKET
+/* the control socket addresses devices by mixer id and devid */
+static Slider *find_slider(const char *id, int devid) {
+  Mixer *m;
+  if ((m = find_mixer_by_id((char *) id)) == NULL) return NULL;
+  return find_mixer_slider(m,devid);
+}
+
+static mixer_t *control_find_mixer(const char *id) {
+  Mixer *m = find_mixer_by_id((char *) id);
+  return m != NULL ? m->mixer : NULL;
+}
+
+static gboolean control_set_volume(const char *id, int devid,
+                                   int left, int right) {
+  Slider *s = find_slider(id, devid);
+  mixer_t *mixer;
+
+  if (s == NULL) {
+    if ((mixer = control_find_mixer(id)) == NULL) return FALSE;
+    mixer_set_device_volume(mixer,devid,left,right);
+    return TRUE;
+  }
+  /* a muted slider gets the new volume when unmuted */
+  scene_release(s);
+  mixer_stereo_to_channels(s->desc,left,right,s->saved);
+  if (!GET_FLAG(s->flags,MUTED))
+    mixer_set_device_channels(s->mixer,s->dev,s->saved);
+  if (s->panel != NULL) volume_show_volume(s);
+  return TRUE;
+}
+
+static int control_get_mute(const char *id, int devid) {
+  Slider *s = find_slider(id, devid);
+  if (s == NULL) return -1;
+  return GET_FLAG(s->flags,MUTED) != 0;
+}
+
+static gboolean control_get_volume(const char *id, int devid,
+                                   int *left, int *right) {
+  Slider *s = find_slider(id, devid);
+  if (s == NULL) return FALSE;
+  volume_get_stereo(s,left,right);
+  return TRUE;
+}
+
+static int control_set_mute(const char *id, int devid, int mute) {
+  Slider *s = find_slider(id, devid);
+  if (s == NULL) return -1;
+  if (mute < 0 || mute != (GET_FLAG(s->flags,MUTED) != 0))
+    volume_toggle_mute(s);
+  return GET_FLAG(s->flags,MUTED) != 0;
+}
+
+static gboolean control_get_stats(const char *id, int *interval,
+                                  int *changes) {
+  Mixer *m = find_mixer_by_id((char *) id);
+  if (m == NULL) return FALSE;
+  *interval = mixer_notifies(m->mixer) ? 0 :
+                m->poll_interval * 1000 / gkrellm_update_HZ();
+  *changes = m->change_rate;
+  return TRUE;
+}
+
+static gchar **control_get_scenes(void) {
+  GPtrArray *names = g_ptr_array_new();
+  Scene *sc;
+  for (sc = Scenez; sc != NULL; sc = sc->next)
+    g_ptr_array_add(names,g_strdup(sc->name));
+  g_ptr_array_add(names,NULL);
+  return (gchar **) g_ptr_array_free(names,FALSE);
+}
+
+static const control_ops_t control_ops = {
+  control_find_mixer,
+  control_set_volume,
+  control_set_mute,
+  control_get_mute,
+  control_get_volume,
+  control_get_stats,
+  apply_scene,
+  save_scene,
+  control_get_scenes
+};
+#endif
+
 static gint
 bvolume_cb_scroll(GtkWidget *widget, GdkEventScroll *event,Bslider *s) {
   int amount = 0;
@@ -230,7 +725,7 @@ bvolume_cb_scroll(GtkWidget *widget, GdkEventScroll *event,Bslider *s) {
       amount = -5;
       break;
   }
-  volume_set_balance(s->slider,s->slider->balance + amount);
+  bvolume_set(s,bvolume_get(s) + amount);
   return TRUE;
 }
 
@@ -253,9 +748,11 @@ volume_cb_scroll(GtkWidget *widget, GdkEventScroll *event,Slider *s) {
 }
 
 static void
-run_right_click_cmd() {
-    if (right_click_cmd) {
+run_right_click_cmd(GdkEventButton *ev) {
+    if (right_click_cmd[0] != '\0') {
       g_spawn_command_line_async(right_click_cmd,NULL);
+    } else if (Scenez != NULL) {
+      scene_popup(ev);
     }
 }
 
@@ -264,30 +761,29 @@ bvolume_button_press(GtkWidget *widget, GdkEventButton *ev,Bslider *s) {
   long location;
   if (ev->button == 1) {
     SET_FLAG(s->flags,IS_PRESSED);
-    location = ev->x  - s->krell->x0 ;
-    location = location >= 0 ? location : 0;
-    location = (location * 200)
-              / s->krell->w_scale;
-    volume_set_balance(s->slider,location - 100);
+    location = mixer_rescale(ev->x - s->krell->x0,s->krell->w_scale,200);
+    bvolume_set(s,location - 100);
   }
   else if (ev->button == 3) {
-    run_right_click_cmd();
+    run_right_click_cmd(ev);
   }
 }
 
 static void
 volume_button_press(GtkWidget *widget,GdkEventButton *ev,Slider *s) {
   long location;
-  if (ev->button == 1) {
+  if (ev->button == 1 && s->desc->kind == MIXER_SWITCH) {
+    /* a switch flips on every click */
+    volume_set_volume(s,!volume_get_volume(s));
+  }
+  else if (ev->button == 1) {
     SET_FLAG(s->flags,IS_PRESSED);
-    location = ev->x  - s->krell->x0 ;
-    location = location >= 0 ? location : 0;
-    location = (location * mixer_get_device_fullscale(s->mixer,s->dev))
-              / s->krell->w_scale;
+    location = mixer_rescale(ev->x - s->krell->x0,s->krell->w_scale,
+                             s->desc->fullscale);
     volume_set_volume(s,location);
   }
   else if (ev->button == 3) {
-    run_right_click_cmd();
+    run_right_click_cmd(ev);
   }
 }
 
@@ -306,35 +802,39 @@ volume_button_release(GtkWidget *widget,GdkEventButton *ev,Slider *s) {
 
 static void
 bvolume_motion(GtkWidget *widget,GdkEventMotion *ev,Bslider *s) {
-  gdouble location;
+  long location;
   if (!(GET_FLAG(s->flags,IS_PRESSED))) return;
   if (!(ev->state & GDK_BUTTON1_MASK)) {
     /* just to be sure */
     DEL_FLAG(s->flags,IS_PRESSED); return ;
   }
-  location = ev->x  - s->krell->x0 ;
-  location = location >= 0 ? location : 0;
-  location = (location * 200)
-              / s->krell->w_scale;
-  volume_set_balance(s->slider,location - 100);
+  location = mixer_rescale(ev->x - s->krell->x0,s->krell->w_scale,200);
+  bvolume_set(s,location - 100);
 }
 
 static void
 volume_motion(GtkWidget *widget,GdkEventMotion *ev,Slider *s) {
-  gdouble location;
+  long location;
   if (!GET_FLAG(s->flags,IS_PRESSED)) return;
   if (!(ev->state & GDK_BUTTON1_MASK)) {
     /* just to be sure */
     DEL_FLAG(s->flags,IS_PRESSED); return ;
   }
-  location = ev->x  - s->krell->x0 ;
-  location = location >= 0 ? location : 0;
-  location = (location * mixer_get_device_fullscale(s->mixer,s->dev))
-              / s->krell->w_scale;
+  location = mixer_rescale(ev->x - s->krell->x0,s->krell->w_scale,
+                           s->desc->fullscale);
   volume_set_volume(s,location);
 }
 
-static void create_bslider(Slider *slide,int first_create) {
+/* only stereo volumes have a balance, and only surround ones a fader */
+static gboolean volume_has_balance(Slider *s) {
+  return s->desc->kind == MIXER_VOLUME && s->desc->channels > 1;
+}
+
+static gboolean volume_has_fader(Slider *s) {
+  return s->desc->kind == MIXER_VOLUME && mixer_device_has_rear(s->desc);
+}
+
+static void create_bslider(Slider *slide,int first_create,int fader) {
   GkrellmStyle *panel_style = gkrellm_meter_style(VOLUME_STYLE);
   GkrellmStyle *slider_style = //gkrellm_krell_slider_style();
     gkrellm_copy_style(gkrellm_meter_style_by_name("volume.balance_slider"));
@@ -344,13 +844,16 @@ static void create_bslider(Slider *slide,int first_create) {
   Bslider *result;
 
   gkrellm_set_style_slider_values_default(slider_style,0,0,0);
+  make_bslider_labels();
 
   if (first_create) {
     result = malloc(sizeof(Bslider));
     result->panel = gkrellm_panel_new0();
-    slide->bal = result;
+    result->fader = fader;
+    if (fader) slide->fad = result;
+    else slide->bal = result;
     result->slider = slide;
-  } else result = slide->bal;
+  } else result = fader ? slide->fad : slide->bal;
 
   krell_image = gkrellm_krell_slider_piximage();
   result->krell = gkrellm_create_krell(result->panel,krell_image,slider_style);
@@ -387,22 +890,47 @@ static void create_bslider(Slider *slide,int first_create) {
   volume_show_balance(slide);
 }
 
-void
-toggle_button_press(GkrellmDecalbutton *button, Slider *s) {
-  int l,r ;
-  mixer_get_device_volume(s->mixer, s->dev, &l, &r);
-  mixer_set_device_volume(s->mixer, s->dev, ++l % 2, ++r % 2);
+#ifdef VU_METER
+static gboolean volume_has_vu(Slider *s) {
+  return GET_FLAG(s->flags,SHOW_VU) && s->desc->kind == MIXER_VOLUME &&
+    (s->desc->flags & MIXER_DEVICE_CAPTURE);
+}
+
+/* a meter krell on the slider panel. Only alsa cards have a capture pcm
+ * that goes with their mixer, "alsa:hw:N" is metered through "plughw:N" */
+static void create_vu(Slider *s,int first_create) {
+  GkrellmStyle *style = gkrellm_meter_style(VOLUME_STYLE);
+  gchar *pcm;
+
+  if (first_create && s->vu == NULL &&
+      !strncmp(s->parent->id,"alsa:hw:",strlen("alsa:hw:"))) {
+    pcm = g_strconcat("plug",s->parent->id + strlen("alsa:"),NULL);
+    s->vu = vu_meter_open(pcm);
+    g_free(pcm);
+  }
+  if (s->vu == NULL) return;
+  s->vu_krell = gkrellm_create_krell(s->panel,
+                  gkrellm_krell_meter_piximage(VOLUME_STYLE),style);
+  gkrellm_set_krell_full_scale(s->vu_krell,VU_FULLSCALE,1);
+  gkrellm_monotonic_krell_values(s->vu_krell,FALSE);
 }
 
+/* the loudness, and full scale as long as the input clips */
+static void volume_show_vu(Slider *s) {
+  int peak,rms;
+  vu_meter_read(s->vu,&peak,&rms);
+  gkrellm_update_krell(s->panel,s->vu_krell,
+                       peak >= VU_FULLSCALE ? VU_FULLSCALE : rms);
+  gkrellm_draw_panel_layers(s->panel);
+}
+#endif
+
 static void create_slider(Slider *s,int first_create) {
   GkrellmStyle *panel_style = gkrellm_meter_style(VOLUME_STYLE);
   GkrellmStyle *slider_style =
     gkrellm_copy_style(gkrellm_meter_style_by_name("volume.level_slider"));
   GkrellmPiximage *krell_image;
 
-  /* Switches not supported yet ! */
-  if (mixer_get_device_fullscale(s->mixer, s->dev) == 1) return;
-
   gkrellm_set_style_slider_values_default(slider_style,0,0,0);
 
   if (first_create) s->panel = gkrellm_panel_new0();
@@ -412,37 +940,32 @@ static void create_slider(Slider *s,int first_create) {
                           mixer_get_device_name(s->mixer,s->dev),
                           panel_style);
   gkrellm_panel_create(pluginbox, monitor, s->panel);
+  /* a switch is a krell with two positions, off and on */
+  krell_image = gkrellm_krell_slider_piximage();
+  s->krell = gkrellm_create_krell(s->panel,krell_image,slider_style);
+  DEL_FLAG(s->flags,OFFLINE);
+  gkrellm_set_krell_full_scale(s->krell, s->desc->fullscale, 1);
+  gkrellm_monotonic_krell_values(s->krell, FALSE);
+
   /* center the krell if the style is not themed */
-  if (mixer_get_device_fullscale(s->mixer, s->dev) != 1) {
-    krell_image = gkrellm_krell_slider_piximage();
-    s->krell = gkrellm_create_krell(s->panel,krell_image,slider_style);
-    gkrellm_set_krell_full_scale(s->krell,
-                               mixer_get_device_fullscale(s->mixer,s->dev), 1);
-    gkrellm_monotonic_krell_values(s->krell, FALSE);
-
-    if (!gkrellm_style_is_themed(slider_style,GKRELLMSTYLE_KRELL_YOFF))
-      gkrellm_move_krell_yoff(s->panel,
-          s->krell,(s->panel->h - s->krell->h_frame) / 2);
-
-    if (first_create) {
-       g_signal_connect(G_OBJECT(s->panel->drawing_area),
-                           "scroll_event", G_CALLBACK(volume_cb_scroll), s);
-       g_signal_connect(G_OBJECT(s->panel->drawing_area), "button_press_event",
-                        G_CALLBACK(volume_button_press),s);
-       g_signal_connect(GTK_OBJECT(s->panel->drawing_area),
-                        "button_release_event",
-                        G_CALLBACK(volume_button_release),s);
-       g_signal_connect(GTK_OBJECT(s->panel->drawing_area),
-                       "motion_notify_event",
-                      G_CALLBACK(volume_motion),s);
-    }
-  } else {
-    g_assert_not_reached();
-    s->button = gkrellm_make_scaled_button(s->panel, NULL,
-                                           toggle_button_press, s,
-                                           FALSE, FALSE, 0, 0, 0,
-                                           gkrellm_chart_width() - 15, 0,
-                                           10, 0 );
+  if (!gkrellm_style_is_themed(slider_style,GKRELLMSTYLE_KRELL_YOFF))
+    gkrellm_move_krell_yoff(s->panel,
+        s->krell,(s->panel->h - s->krell->h_frame) / 2);
+#ifdef VU_METER
+  if (volume_has_vu(s)) create_vu(s,first_create);
+#endif
+
+  if (first_create) {
+     g_signal_connect(G_OBJECT(s->panel->drawing_area),
+                         "scroll_event", G_CALLBACK(volume_cb_scroll), s);
+     g_signal_connect(G_OBJECT(s->panel->drawing_area), "button_press_event",
+                      G_CALLBACK(volume_button_press),s);
+     g_signal_connect(GTK_OBJECT(s->panel->drawing_area),
+                      "button_release_event",
+                      G_CALLBACK(volume_button_release),s);
+     g_signal_connect(GTK_OBJECT(s->panel->drawing_area),
+                     "motion_notify_event",
+                    G_CALLBACK(volume_motion),s);
   }
 
   if (first_create) {
@@ -450,53 +973,164 @@ static void create_slider(Slider *s,int first_create) {
       G_CALLBACK(volume_expose_event),s);
   }
   volume_show_volume(s);
-  if (GET_FLAG(s->flags,BALANCE)) create_bslider(s,first_create);
+  volume_show_health(s);
+  if (GET_FLAG(s->flags,BALANCE) && volume_has_balance(s))
+    create_bslider(s,first_create,FALSE);
+  if (GET_FLAG(s->flags,BALANCE) && volume_has_fader(s))
+    create_bslider(s,first_create,TRUE);
 }
 
 static void create_volume_plugin(GtkWidget *vbox,gint first_create) {
   Mixer *m;
   Slider *s;
+  volume_config_t *config;
+  gint64 start = trace_start();
+
+  if (config_parser != NULL) {
+    config = config_parser_finish(config_parser);
+    config_parser = NULL;
+    volume_apply_config(config);
+    config_free(config);
+    trace_end("apply config",NULL,start);
+  }
 
   pluginbox = vbox;
   for (m = Mixerz ; m != NULL; m = m->next)
     for (s = m->Sliderz; s != NULL ; s = s->next) {
     create_slider(s,first_create);
   }
+  trace_end("create_volume_plugin",NULL,start);
+}
+
+/* returns TRUE if the volume changed */
+static gboolean volume_update_slider(Slider *s) {
+  int volumes[MIXER_MAX_CHANNELS];
+  int volume;
+  mixer_get_device_channels(s->mixer,s->dev,volumes);
+  /* leaves balance and fader alone if all channels are at 0 */
+  mixer_measure_channels(s->desc,volumes,&volume,&s->balance,&s->fader);
+  if (GET_FLAG(s->flags,MUTED)) {
+    /* a muted slider keeps its volume to restore in saved */
+    if (volume == 0) return FALSE;
+    /* someone else turned it up, the mute is over */
+    DEL_FLAG(s->flags,MUTED);
+  } else if (!memcmp(s->saved,volumes,sizeof(int) * s->desc->channels))
+    return FALSE;
+  /* show volume and balance */
+  memcpy(s->saved,volumes,sizeof(s->saved));
+  if (GET_FLAG(s->flags,BALANCE)) volume_show_balance(s);
+  volume_show_volume(s);
+  return TRUE;
+}
+
+#ifdef SHM_EXPORT
+/* publishes all sliders for other processes, see volume_shm.h */
+static void volume_export(void) {
+  volume_shm_slider_t sliders[VOLUME_SHM_MAX_SLIDERS];
+  volume_shm_slider_t *e;
+  Mixer *m;
+  Slider *s;
+  int nr = 0, left, right;
+
+  memset(sliders, 0, sizeof(sliders));
+  for (m = Mixerz; m != NULL; m = m->next)
+    for (s = m->Sliderz; s != NULL && nr < VOLUME_SHM_MAX_SLIDERS;
+         s = s->next) {
+      e = &sliders[nr++];
+      g_strlcpy(e->mixer, m->id, sizeof(e->mixer));
+      g_strlcpy(e->name, mixer_get_device_name(s->mixer, s->dev),
+                sizeof(e->name));
+      mixer_channels_to_stereo(s->desc,s->saved,&left,&right);
+      e->left = left;
+      e->right = right;
+      e->fullscale = s->desc->fullscale;
+      if (GET_FLAG(s->flags,MUTED)) e->flags |= VOLUME_SHM_MUTED;
+      if (GET_FLAG(s->flags,BALANCE)) e->flags |= VOLUME_SHM_BALANCE;
+    }
+  shm_export_publish(sliders, nr);
+}
+#endif
+
+/* Mixers that don't report changes are read every tick while they change or
+ * the user touches them, and twice as far apart after every read that found
+ * nothing new, up to poll_ceiling ms */
+static void volume_poll(Mixer *m) {
+  int hz = gkrellm_update_HZ();
+  int ceiling = MAX(1, poll_ceiling * hz / 1000);
+
+  if (--m->poll_countdown > 0) return;
+  if (m->poll_changed) m->poll_interval = 1;
+  else m->poll_interval = MIN(m->poll_interval * 2, ceiling);
+  m->poll_changed = FALSE;
+  m->poll_countdown = m->poll_interval;
+  /* shows up in the published volumes by one of the next ticks */
+  mixer_refresh(m->mixer);
 }
 
 static void update_volume_plugin(void) {
   Slider *s;
   Mixer *m;
-  for (m = Mixerz; m != NULL; m = m->next)
+  int hz = gkrellm_update_HZ();
+  gint64 start = trace_start();
+  for (m = Mixerz; m != NULL; m = m->next) {
+    if (!mixer_notifies(m->mixer)) volume_poll(m);
     for (s = m->Sliderz ; s != NULL; s = s->next) {
-      int left,right;
-      mixer_get_device_volume(s->mixer,s->dev,&left,&right);
-      /* calculate the balance and show volume if needed */
-      if (s->pleft!=left || s->pright!=right) {
-        if (GET_FLAG(s->flags,BALANCE)) {
-          if (left < right) {
-            s->balance = 100 - (gint) rint(((gdouble)left/right) * 100);
-          } else if (left > right) {
-            s->balance = (gint) rint(((gdouble)right/left) * 100) - 100;
-          } else if (left == right && left != 0) s->balance = 0;
-          volume_show_balance(s);
-        }
-       if (!GET_FLAG(s->flags,MUTED)) { s->pleft = left; s->pright = right; }
-       volume_show_volume(s);
-     }
-   }
+      if (volume_update_slider(s)) {
+        m->poll_changes++;
+        volume_poll_fast(m);
+      }
+#ifdef VU_METER
+      if (s->vu_krell != NULL) volume_show_vu(s);
+#endif
+    }
+    if (++m->poll_ticks >= 60 * hz) {
+      m->change_rate = m->poll_changes;
+      m->poll_ticks = m->poll_changes = 0;
+    }
+  }
+#ifdef SHM_EXPORT
+  if (export_dirty) volume_export();
+#endif
+  export_dirty = FALSE;
+  /* the startup trace ends with the first update */
+  if (start != 0) {
+    trace_end("update_volume_plugin",NULL,start);
+    trace_write();
+  }
+}
+
+/* event driven backends report changes right away instead of waiting for the
+ * next update */
+static void volume_mixer_changed(mixer_t *mixer, int devid, void *data) {
+  Mixer *m = (Mixer *) data;
+  Slider *s;
+  if (devid < 0) {
+    for (s = m->Sliderz ; s != NULL; s = s->next)
+      volume_show_health(s);
+    return;
+  }
+  for (s = m->Sliderz ; s != NULL; s = s->next)
+    if (s->dev == devid && s->panel != NULL && volume_update_slider(s))
+      m->poll_changes++;
 }
 
 static void
 save_volume_plugin_config(FILE *f) {
   Mixer *m;
   Slider *s;
+  Scene *sc;
+  SceneDev *d;
+  int i,c;
   if (GET_FLAG(global_flags,MUTEALL)) fprintf(f,"%s MUTEALL\n",CONFIG_KEYWORD);
 
   if (right_click_cmd) {
       fprintf(f, "%s RIGHT_CLICK_CMD %s\n", CONFIG_KEYWORD,
               right_click_cmd);
   }
+  if (poll_ceiling != DEFAULT_POLL_CEILING)
+    fprintf(f,"%s POLL_CEILING %d\n",CONFIG_KEYWORD,poll_ceiling);
+  if (scene_ramp != DEFAULT_SCENE_RAMP)
+    fprintf(f,"%s SCENE_RAMP %d\n",CONFIG_KEYWORD,scene_ramp);
 
   for (m = Mixerz ; m != NULL ; m = m->next) {
     fprintf(f,"%s ADDMIXER %s\n",CONFIG_KEYWORD,m->id);
@@ -511,44 +1145,112 @@ save_volume_plugin_config(FILE *f) {
       }
       if (GET_FLAG(s->flags,BALANCE))
         fprintf(f,"%s SHOWBALANCE\n",CONFIG_KEYWORD);
+      if (GET_FLAG(s->flags,SHOW_VU))
+        fprintf(f,"%s SHOWVU\n",CONFIG_KEYWORD);
 
       if (GET_FLAG(s->flags,SAVE_VOLUME)) {
-        int left,right;
-        mixer_get_device_volume(s->mixer,s->dev,&left,&right);
-        fprintf(f,"%s SETVOLUME %d %d\n",CONFIG_KEYWORD,left,right);
+        int left,right,i,volumes[MIXER_MAX_CHANNELS];
+        /* surround devices save every channel, front left and right come
+         * first there as well */
+        if (s->desc->channels > 2) {
+          mixer_get_device_channels(s->mixer,s->dev,volumes);
+          fprintf(f,"%s SETVOLUME",CONFIG_KEYWORD);
+          for (i = 0; i < s->desc->channels; i++)
+            fprintf(f," %d",volumes[i]);
+          fprintf(f,"\n");
+        } else {
+          mixer_get_device_volume(s->mixer,s->dev,&left,&right);
+          fprintf(f,"%s SETVOLUME %d %d\n",CONFIG_KEYWORD,left,right);
+        }
       }
     }
   }
+
+  /* SCENEDEV <devid> <muted> <balance> <fader> <volume of every channel>
+   * <mixer id> */
+  for (sc = Scenez; sc != NULL; sc = sc->next) {
+    fprintf(f,"%s SCENE %s\n",CONFIG_KEYWORD,sc->name);
+    for (i = 0; i < sc->devs->len; i++) {
+      d = &g_array_index(sc->devs,SceneDev,i);
+      fprintf(f,"%s SCENEDEV %d %d %d %d",CONFIG_KEYWORD,d->dev,d->muted,
+              d->balance,d->fader);
+      for (c = 0; c < MIXER_MAX_CHANNELS; c++)
+        fprintf(f," %d",d->volumes[c]);
+      fprintf(f," %s\n",d->id);
+    }
+  }
 }
 
 static void
 load_volume_plugin_config(gchar *command) {
-  static Mixer *m = NULL;
-  static Slider *s = NULL;
-  gchar *arg;
-  /* gkrellm doesn't care if we fsck the string it gives us */
-  for (arg = command; !isspace(*arg); arg++);
-  *arg = '\0'; arg++;
-
-  if (!strcmp("MUTEALL",command)) SET_FLAG(global_flags,MUTEALL);
-  else if (!strcmp("ADDMIXER",command)) {
-    m = add_mixer_by_id(arg);
-  } else if (!strcmp("RIGHT_CLICK_CMD",command)) {
-    g_strlcpy(right_click_cmd, arg, sizeof(right_click_cmd));
-  } else if (!strcmp("ADDDEV",command)) {
-    if (m != NULL) s = add_slider(m,atoi(arg));
-  } else if (!strcmp("SETDEVNAME",command)) {
-    if (s != NULL) mixer_set_device_name(s->mixer,s->dev,arg);
-  } else if (!strcmp("SHOWBALANCE",command)) {
-    if (s != NULL) SET_FLAG(s->flags,BALANCE);
-  } else if (!strcmp("SETVOLUME",command)) {
-    if (s != NULL) {
-      char *next;
-      int left,right;
-      left = strtol(arg,&next,10);
-      right = strtol(next,NULL,10);
-      mixer_set_device_volume(s->mixer,s->dev,left,right);
-      SET_FLAG(s->flags,SAVE_VOLUME);
+  gint64 start = trace_start();
+  if (config_parser == NULL) config_parser = config_parser_new();
+  config_parse_line(config_parser,command,strlen(command));
+  trace_end("config line",command,start);
+}
+
+/* opens the configured mixers, adds their sliders and sets the saved
+ * volumes with one batch per mixer */
+static void volume_apply_config(const volume_config_t *config) {
+  const config_mixer_t *cm;
+  const config_dev_t *cd;
+  const config_scene_t *cs;
+  const config_scene_dev_t *csd;
+  Mixer *m;
+  Slider *s;
+  Scene *sc;
+  SceneDev d;
+  int *devids, *volumes, n;
+  guint i,j;
+
+  if (config->muteall) SET_FLAG(global_flags,MUTEALL);
+  if (config->right_click_cmd != NULL)
+    g_strlcpy(right_click_cmd,config->right_click_cmd,
+              sizeof(right_click_cmd));
+  if (config->poll_ceiling >= 0) poll_ceiling = config->poll_ceiling;
+  if (config->scene_ramp >= 0) scene_ramp = config->scene_ramp;
+
+  for (i = 0; i < config->mixers->len; i++) {
+    cm = &g_array_index(config->mixers,config_mixer_t,i);
+    if ((m = add_mixer_by_id(cm->id)) == NULL) continue;
+    devids = g_new(int,cm->devs->len);
+    volumes = g_new0(int,cm->devs->len * MIXER_MAX_CHANNELS);
+    n = 0;
+    for (j = 0; j < cm->devs->len; j++) {
+      cd = &g_array_index(cm->devs,config_dev_t,j);
+      if ((s = add_slider(m,cd->dev)) == NULL) continue;
+      if (cd->name != NULL) mixer_set_device_name(s->mixer,s->dev,cd->name);
+      if (cd->balance) SET_FLAG(s->flags,BALANCE);
+      if (cd->vu) SET_FLAG(s->flags,SHOW_VU);
+      if (cd->save_volume) SET_FLAG(s->flags,SAVE_VOLUME);
+      /* left and right, or every channel of a surround device */
+      if (cd->nr_volumes == s->desc->channels && cd->nr_volumes > 2)
+        memcpy(&volumes[n * MIXER_MAX_CHANNELS],cd->volumes,
+               sizeof(cd->volumes));
+      else if (cd->nr_volumes >= 2)
+        mixer_stereo_to_channels(s->desc,cd->volumes[0],cd->volumes[1],
+                                 &volumes[n * MIXER_MAX_CHANNELS]);
+      else continue;
+      devids[n++] = s->dev;
+    }
+    mixer_set_devices_channels(m->mixer,n,devids,volumes);
+    g_free(devids);
+    g_free(volumes);
+  }
+
+  for (i = 0; i < config->scenes->len; i++) {
+    cs = &g_array_index(config->scenes,config_scene_t,i);
+    sc = add_scene(cs->name);
+    for (j = 0; j < cs->devs->len; j++) {
+      csd = &g_array_index(cs->devs,config_scene_dev_t,j);
+      memset(&d,0,sizeof(d));
+      d.id = strdup(csd->id);
+      d.dev = csd->dev;
+      d.muted = csd->muted;
+      d.balance = csd->balance;
+      d.fader = csd->fader;
+      memcpy(d.volumes,csd->volumes,sizeof(d.volumes));
+      g_array_append_val(sc->devs,d);
     }
   }
 }
@@ -566,6 +1268,7 @@ enum {
   C_ENABLED_COLUMN = 0,
   C_VOLUME_COLUMN,
   C_BALANCE_COLUMN,
+  C_VU_COLUMN,
   C_NAME_COLUMN,
   C_SNAME_COLUMN,
   C_DEVNR_COLUMN,
@@ -578,6 +1281,37 @@ GtkWidget *config_notebook;
  * flickering */
 gboolean mixer_config_changed = FALSE;
 
+/* a single background probe, either for the id list (id == NULL) or for
+ * opening one mixer */
+typedef struct {
+  guint generation;
+  char *id;
+  mixer_idz_t *idz;
+  mixer_t *mixer;
+  gboolean found;
+  GtkTreeIter iter;
+} MixerProbe;
+
+static GThreadPool *probe_pool = NULL;
+/* bumped when the config tab goes away, so stale probes get dropped */
+static volatile gint probe_generation = 0;
+
+static MixerProbe *new_probe(char *id) {
+  MixerProbe *p = g_new0(MixerProbe,1);
+  p->generation = probe_generation;
+  p->id = g_strdup(id);
+  return p;
+}
+
+static void config_notebook_destroyed(GtkWidget *widget, gpointer data) {
+  g_atomic_int_inc(&probe_generation);
+  config_notebook = NULL;
+  model = NULL;
+  poll_ceiling_spin = NULL;
+  scene_ramp_spin = NULL;
+  scene_combo = NULL;
+}
+
 static void
 toggle_item(gchar *path_str,gpointer data,gint column) {
   GtkTreePath *path = gtk_tree_path_new_from_string(path_str);
@@ -608,6 +1342,13 @@ toggle_balance(GtkCellRendererToggle *cell,gchar *path_str,gpointer data) {
   toggle_item(path_str,data,C_BALANCE_COLUMN);
 }
 
+#ifdef VU_METER
+static void
+toggle_vu(GtkCellRendererToggle *cell,gchar *path_str,gpointer data) {
+  toggle_item(path_str,data,C_VU_COLUMN);
+}
+#endif
+
 static void
 device_name_edited(GtkCellRendererText *text,
                     gchar *pathstr,gchar *value,gpointer user_data) {
@@ -746,6 +1487,17 @@ create_device_notebook(GtkListStore *store, char *name) {
       NULL);
 #endif
 
+#ifdef VU_METER
+  renderer = gtk_cell_renderer_toggle_new();
+  g_signal_connect(G_OBJECT(renderer),"toggled",
+      G_CALLBACK(toggle_vu),store);
+  gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(treeview), -1,
+      _("Level"),renderer,
+      "active",C_VU_COLUMN,
+      "activatable",C_ENABLED_COLUMN,
+      NULL);
+#endif
+
   renderer = gtk_cell_renderer_text_new();
   gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(treeview), -1,
       _("Name"),renderer,
@@ -787,34 +1539,33 @@ create_device_notebook(GtkListStore *store, char *name) {
   return topvbox;
 }
 
-static void add_mixer_to_model(char *id, mixer_t *mixer, Slider *s) {
+static GtkListStore *new_device_store(void) {
+  return gtk_list_store_new(C_N_COLUMNS,
+                            G_TYPE_BOOLEAN, /* enabled or not */
+                            G_TYPE_BOOLEAN, /* save volume or not */
+                            G_TYPE_BOOLEAN, /* show balance or not */
+                            G_TYPE_BOOLEAN, /* show the level meter or not */
+                            G_TYPE_STRING,  /* real name */
+                            G_TYPE_STRING,  /* set name */
+                            G_TYPE_INT      /* device number */
+      );
+}
+
+static void fill_device_store(GtkListStore *child_model, mixer_t *mixer,
+                              Slider *s) {
   GtkTreeIter iter;
-  GtkListStore *child_model;
-  gboolean enabled,save_volume,balance;
-  GtkWidget *notebook;
+  gboolean enabled,save_volume,balance,vu;
   int i;
 
-  child_model = gtk_list_store_new(C_N_COLUMNS,
-                                  G_TYPE_BOOLEAN, /* enabled or not */
-                                  G_TYPE_BOOLEAN, /* save volume or not */
-                                  G_TYPE_BOOLEAN, /* show balance or not */
-                                  G_TYPE_STRING,  /* real name */
-                                  G_TYPE_STRING,  /* set name */
-                                  G_TYPE_INT      /* device number */
-      );
-
    for(i = 0; i < mixer_get_nr_devices(mixer); i++) {
-     if (mixer_get_device_fullscale(mixer, i) == 1) {
-       /*Switch not supported yet */
-       continue;
-     }
      if (s != NULL && s->dev == i) {
        enabled = TRUE;
        save_volume = GET_FLAG(s->flags,SAVE_VOLUME);
        balance = GET_FLAG(s->flags,BALANCE);
+       vu = GET_FLAG(s->flags,SHOW_VU);
        s = s->next;
       } else {
-        enabled = save_volume = balance = FALSE;
+        enabled = save_volume = balance = vu = FALSE;
       }
 
       gtk_list_store_append(child_model,&iter);
@@ -822,12 +1573,21 @@ static void add_mixer_to_model(char *id, mixer_t *mixer, Slider *s) {
         C_ENABLED_COLUMN,enabled,
         C_VOLUME_COLUMN,save_volume,
         C_BALANCE_COLUMN,balance,
+        C_VU_COLUMN,vu,
         C_NAME_COLUMN,mixer_get_device_real_name(mixer,i),
         C_SNAME_COLUMN,mixer_get_device_name(mixer,i),
         C_DEVNR_COLUMN,i,
         -1);
   }
+}
+
+static void add_mixer_to_model(char *id, mixer_t *mixer, Slider *s) {
+  GtkTreeIter iter;
+  GtkListStore *child_model;
+  GtkWidget *notebook;
 
+  child_model = new_device_store();
+  fill_device_store(child_model, mixer, s);
   notebook = create_device_notebook(child_model,mixer_get_name(mixer));
 
   gtk_list_store_append(model,&iter);
@@ -840,41 +1600,148 @@ static void add_mixer_to_model(char *id, mixer_t *mixer, Slider *s) {
   return;
 }
 
+/* Adds a row for a mixer that is still being probed in the background. The
+ * device store stays empty until the probe is done */
+static void add_placeholder_to_model(char *id) {
+  GtkTreeIter iter;
+  GtkListStore *child_model;
+  GtkWidget *notebook;
+
+  child_model = new_device_store();
+  notebook = create_device_notebook(child_model,id);
+
+  gtk_list_store_append(model,&iter);
+  gtk_list_store_set(model,&iter,
+                       ID_COLUMN,id,
+                       NAME_COLUMN,_("Probing..."),
+                       C_MODEL_COLUMN,child_model,
+                       C_NB_COLUMN,notebook,
+                       -1);
+}
+
 static gboolean findid(GtkTreeModel *m,GtkTreePath *path,
                                             GtkTreeIter *iter,gpointer data) {
-  char *item;
+  char *item,*canonical;
+  gboolean found;
   char **arg = (char **) data;
   gtk_tree_model_get(m,iter,ID_COLUMN,&item,-1);
-  if (!strcmp(item,*arg)) {
-    *arg = NULL;
-    return TRUE;
+  /* *arg is canonical already, rows from old configs might not be */
+  canonical = mixer_id_canonical(item);
+  found = !strcmp(canonical,*arg);
+  g_free(canonical);
+  g_free(item);
+  if (found) *arg = NULL;
+  return found;
+}
+
+static gboolean findrow(GtkTreeModel *m,GtkTreePath *path,
+                                            GtkTreeIter *iter,gpointer data) {
+  char *item;
+  gboolean found;
+  MixerProbe *p = (MixerProbe *) data;
+
+  gtk_tree_model_get(m,iter,ID_COLUMN,&item,-1);
+  found = !strcmp(item,p->id);
+  g_free(item);
+  if (found) {
+    p->iter = *iter;
+    p->found = TRUE;
   }
-  return FALSE;
+  return found;
 }
 
 static void add_mixerid_to_model(char *id,gboolean gui) {
-  char **arg = &id;
+  /* the model only holds canonical ids, a chosen /dev/mixer is oss:/dev/mixer */
+  char *canonical = mixer_id_canonical(id);
+  char *arg = canonical;
   char *name;
   mixer_t *mixer;
+  Mixer *m;
 
-  gtk_tree_model_foreach(GTK_TREE_MODEL(model),findid,arg);
-  if (id == NULL) {
+  gtk_tree_model_foreach(GTK_TREE_MODEL(model),findid,&arg);
+  if (arg == NULL) {
     if (gui) gkrellm_message_window(_("Error"),_("Id already in list"),NULL);
-    return;
+    goto out;
+  }
+  /* don't open a mixer a second time if it's already in use */
+  if ((m = find_mixer_by_id(canonical)) != NULL) {
+    add_mixer_to_model(canonical, m->mixer, m->Sliderz);
+    goto out;
   }
-  if ((mixer = mixer_open(id)) == NULL) {
+  if ((mixer = mixer_open(canonical)) == NULL) {
     if (gui) {
       name =
         g_strdup_printf(_("Couldn't open %s or %s isn't a mixer device"),id,id);
       gkrellm_message_window(_("Error"),name,NULL);
       g_free(name);
     }
-    return;
+    goto out;
   }
-  add_mixer_to_model(id,mixer, NULL);
+  add_mixer_to_model(canonical,mixer, NULL);
   mixer_close(mixer);
-  return;
+out:
+  g_free(canonical);
+}
+
+/* Background probing of the available mixers. Detecting and opening mixers can
+ * take a while (D-Bus timeouts, slow cards), so it's done in a worker thread
+ * while the config tab shows placeholder rows. Results are handed back to the
+ * main loop, which owns all gtk objects. */
+static gboolean probe_done(gpointer data) {
+  MixerProbe *p = (MixerProbe *) data;
+  mixer_idz_t *t;
+  GtkListStore *store;
+  GtkWidget *nb;
+
+  if (p->generation != (guint) probe_generation || model == NULL) goto out;
+
+  if (p->id == NULL) {
+    /* the id list is in, add a placeholder for every new mixer */
+    for (t = p->idz; t != NULL; t = t->next) {
+      char *id = t->id;
+      gtk_tree_model_foreach(GTK_TREE_MODEL(model),findid,&id);
+      if (id == NULL) continue;
+      add_placeholder_to_model(t->id);
+      g_thread_pool_push(probe_pool, new_probe(t->id), NULL);
+    }
+    goto out;
+  }
+
+  gtk_tree_model_foreach(GTK_TREE_MODEL(model),findrow,p);
+  if (!p->found) goto out;
+
+  gtk_tree_model_get(GTK_TREE_MODEL(model),&p->iter,
+                     C_MODEL_COLUMN,&store,C_NB_COLUMN,&nb,-1);
+  if (p->mixer == NULL) {
+    gtk_list_store_remove(model,&p->iter);
+    gtk_widget_destroy(nb);
+  } else {
+    fill_device_store(store, p->mixer, NULL);
+    gtk_list_store_set(model,&p->iter,
+                       NAME_COLUMN,mixer_get_name(p->mixer),-1);
+    gtk_notebook_set_tab_label_text(GTK_NOTEBOOK(config_notebook),nb,
+                                    mixer_get_name(p->mixer));
+  }
+
+out:
+  if (p->mixer != NULL) mixer_close(p->mixer);
+  mixer_free_idz(p->idz);
+  g_free(p->id);
+  g_free(p);
+  return FALSE;
+}
+
+static void probe_task(gpointer data, gpointer user_data) {
+  MixerProbe *p = (MixerProbe *) data;
+
+  /* config tab closed in the meantime, don't bother */
+  if (p->generation == (guint) g_atomic_int_get(&probe_generation)) {
+    if (p->id == NULL) p->idz = mixer_get_id_list();
+    else p->mixer = mixer_open(p->id);
+  }
+  g_idle_add(probe_done, p);
 }
+
 #ifndef WIN32
 static void file_choosen(GtkWidget *w,gpointer selector) {
   char *id;
@@ -905,7 +1772,6 @@ static void select_file(GtkWidget *widget,gpointer user_data) {
 
 static void create_volume_model(void) {
   Mixer *m;
-  mixer_idz_t *idz,*t;
 
   model = gtk_list_store_new(N_COLUMNS,
                              G_TYPE_STRING,  /* id */
@@ -913,14 +1779,13 @@ static void create_volume_model(void) {
                              G_TYPE_POINTER, /* pointer to the child store */
                              G_TYPE_POINTER  /* pointer to the child NB */
       );
+  /* mixers in use are already open, the rest gets probed in the background */
   for (m = Mixerz; m != NULL; m = m->next) {
     add_mixer_to_model(m->id,m->mixer,m->Sliderz);
   }
-  idz = mixer_get_id_list();
-  for (t = idz; t != NULL; t = t->next) {
-    add_mixerid_to_model(t->id,FALSE);
-  }
-  mixer_free_idz(idz);
+  if (probe_pool == NULL)
+    probe_pool = g_thread_pool_new(probe_task, NULL, 1, FALSE, NULL);
+  g_thread_pool_push(probe_pool, new_probe(NULL), NULL);
 }
 
 static void create_volume_plugin_mixer_tabs(void) {
@@ -1001,6 +1866,38 @@ static void create_volume_plugin_mixer_tabs(void) {
   gtk_widget_show_all(notebook);
 }
 
+/* saves (data TRUE) or deletes the scene named in the combo right away */
+static void scene_button_clicked(GtkWidget *widget,gpointer data) {
+  GtkTreeModel *m = gtk_combo_box_get_model(GTK_COMBO_BOX(scene_combo));
+  GtkTreeIter iter;
+  gchar *name, *item;
+  gboolean found = FALSE;
+  gint i = 0;
+
+  name = g_strdup(gtk_entry_get_text(GTK_ENTRY(GTK_BIN(scene_combo)->child)));
+  /* scene names are single words for the control socket */
+  g_strdelimit(g_strstrip(name)," \t",'_');
+  if (*name == '\0') {
+    g_free(name);
+    return;
+  }
+  if (gtk_tree_model_get_iter_first(m,&iter)) do {
+    gtk_tree_model_get(m,&iter,0,&item,-1);
+    found = !strcmp(item,name);
+    g_free(item);
+  } while (!found && (i++, gtk_tree_model_iter_next(m,&iter)));
+
+  if (GPOINTER_TO_INT(data)) {
+    save_scene(name);
+    if (!found) gtk_combo_box_append_text(GTK_COMBO_BOX(scene_combo),name);
+  } else if (found) {
+    remove_scene(name);
+    gtk_combo_box_remove_text(GTK_COMBO_BOX(scene_combo),i);
+    gkrellm_config_modified();
+  }
+  g_free(name);
+}
+
 static void option_toggle(GtkWidget *widget,gpointer data) {
   if ( gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)))
     SET_FLAG(config_global_flags,GPOINTER_TO_INT(data));
@@ -1011,6 +1908,8 @@ static void option_toggle(GtkWidget *widget,gpointer data) {
 static void
 create_volume_plugin_config(GtkWidget *tab) {
   GtkWidget *label,*text,*page,*toggle,*right_click_hbox,*right_click_label;
+  GtkWidget *scene_hbox,*button;
+  Scene *sc;
   gchar *info_text[] = {
    N_("<b>Gkrellm Volume Plugin\n\n"),
    N_("This plugin allows you to control your mixers with gkrellm\n\n"),
@@ -1039,7 +1938,10 @@ create_volume_plugin_config(GtkWidget *tab) {
    N_("\t* Mute all mixers at the same time: Mutes all devices on a middle\n"\
       "\t  mouse button click instead of only the one the slider belongs to.\n"\
       "\t* Right-click command: The command to run when the right mouse\n"\
-      "\t  button is clicked on the plugin\n")
+      "\t  button is clicked on the plugin\n"\
+      "\t* Scene: Save current stores the volume, balance and mute state of\n"\
+      "\t  every slider under the name. Without a right-click command the\n"\
+      "\t  right mouse button offers the scenes to switch to.\n")
   };
 
   gint i;
@@ -1061,6 +1963,8 @@ create_volume_plugin_config(GtkWidget *tab) {
   gtk_notebook_set_tab_pos(GTK_NOTEBOOK(config_notebook), GTK_POS_TOP);
 
   gtk_box_pack_start(GTK_BOX(tab), config_notebook, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(config_notebook), "destroy",
+                   G_CALLBACK(config_notebook_destroyed), NULL);
 
   /* global options tab */
   page = gkrellm_gtk_framed_notebook_page(config_notebook,_("Options"));
@@ -1082,6 +1986,33 @@ create_volume_plugin_config(GtkWidget *tab) {
   gtk_box_pack_start(GTK_BOX(right_click_hbox),right_click_entry,TRUE,TRUE,8);
   gtk_box_pack_start(GTK_BOX(page),right_click_hbox,FALSE,FALSE,3);
 
+  /* option - polling of mixers that don't report changes */
+  gkrellm_gtk_spin_button(page, &poll_ceiling_spin, (gfloat) poll_ceiling,
+                          100.0, 60000.0, 100.0, 1000.0, 0, 70, NULL, NULL,
+                          FALSE,
+                          _("Max. ms between reads of idle polled mixers"));
+
+  /* option - scenes */
+  gkrellm_gtk_spin_button(page, &scene_ramp_spin, (gfloat) scene_ramp,
+                          0.0, 5000.0, 50.0, 500.0, 0, 70, NULL, NULL,
+                          FALSE, _("Ms to ramp into a scene, 0 for at once"));
+  scene_hbox = gtk_hbox_new(FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(scene_hbox),gtk_label_new(_("Scene: ")),
+                     FALSE,FALSE,0);
+  scene_combo = gtk_combo_box_entry_new_text();
+  for (sc = Scenez; sc != NULL; sc = sc->next)
+    gtk_combo_box_append_text(GTK_COMBO_BOX(scene_combo),sc->name);
+  gtk_box_pack_start(GTK_BOX(scene_hbox),scene_combo,TRUE,TRUE,8);
+  button = gtk_button_new_with_label(_("Save current"));
+  g_signal_connect(G_OBJECT(button),"clicked",
+                   G_CALLBACK(scene_button_clicked),GINT_TO_POINTER(TRUE));
+  gtk_box_pack_start(GTK_BOX(scene_hbox),button,FALSE,FALSE,3);
+  button = gtk_button_new_from_stock(GTK_STOCK_DELETE);
+  g_signal_connect(G_OBJECT(button),"clicked",
+                   G_CALLBACK(scene_button_clicked),GINT_TO_POINTER(FALSE));
+  gtk_box_pack_start(GTK_BOX(scene_hbox),button,FALSE,FALSE,3);
+  gtk_box_pack_start(GTK_BOX(page),scene_hbox,FALSE,FALSE,3);
+
   /* info tab */
   page = gkrellm_gtk_notebook_page(config_notebook,_("Info"));
   text = gkrellm_gtk_scrolled_text_view(page,NULL,
@@ -1103,36 +2034,81 @@ create_volume_plugin_config(GtkWidget *tab) {
   gtk_widget_show_all(config_notebook);
 }
 
+/* Applying the config only touches what changed: mixers and sliders that are
+ * still configured are moved into place in Mixerz and keep their open handles
+ * and panels, everything after the last configured entry is removed */
+typedef struct {
+  gchar *id;
+  /* where the next configured mixer goes */
+  Mixer **mpos;
+  /* mixer of the current row, NULL until one of its devices is enabled */
+  Mixer *mixer;
+  /* where the next configured slider of mixer goes */
+  Slider **spos;
+} ApplyState;
+
 static gboolean add_configed_mixer_device(GtkTreeModel *m, GtkTreePath *path,
                                               GtkTreeIter *iter,gpointer data) {
   gboolean enabled;
   gboolean save_volume;
   gboolean balance;
+  gboolean vu, vu_changed;
+  gboolean renamed;
   gint nr;
+  int created;
   Slider *s;
-  gchar *rname,*name;
-  gchar *id = (gchar *) data;
-  Mixer *mixer;
+  gchar *name;
+  ApplyState *state = (ApplyState *) data;
 
   gtk_tree_model_get(m,iter,C_ENABLED_COLUMN,&enabled,-1);
-  if (enabled) {
-    mixer = add_mixer_by_id(id);
-
-    gtk_tree_model_get(m,iter,
-          C_DEVNR_COLUMN,&nr,
-          C_VOLUME_COLUMN,&save_volume,
-          C_BALANCE_COLUMN,&balance,
-          C_NAME_COLUMN,&rname,
-          C_SNAME_COLUMN,&name,
-          -1);
-    if (strcmp(name,rname)) mixer_set_device_name(mixer->mixer,nr,name);
-
-    s = add_slider(mixer,nr);
-    if (save_volume) SET_FLAG(s->flags,SAVE_VOLUME);
-    else DEL_FLAG(s->flags,SAVE_VOLUME);
+  if (!enabled) return FALSE;
+
+  if (state->mixer == NULL) {
+    state->mixer = place_mixer(state->mpos, state->id);
+    if (state->mixer == NULL) return TRUE;
+    state->spos = &state->mixer->Sliderz;
+  }
+
+  gtk_tree_model_get(m,iter,
+        C_DEVNR_COLUMN,&nr,
+        C_VOLUME_COLUMN,&save_volume,
+        C_BALANCE_COLUMN,&balance,
+        C_VU_COLUMN,&vu,
+        C_SNAME_COLUMN,&name,
+        -1);
+
+  s = place_slider(state->mixer, state->spos, nr, &created);
+  if (s == NULL) {
+    g_free(name);
+    return FALSE;
+  }
+  state->spos = &s->next;
+
+  renamed = strcmp(name,mixer_get_device_name(s->mixer,nr)) != 0;
+  if (renamed) mixer_set_device_name(s->mixer,nr,name);
+  g_free(name);
+
+  if (save_volume) SET_FLAG(s->flags,SAVE_VOLUME);
+  else DEL_FLAG(s->flags,SAVE_VOLUME);
+
+  /* the meter krell is part of the slider panel, so it's recreated too */
+  vu_changed = !vu != !GET_FLAG(s->flags,SHOW_VU);
+  if (vu) SET_FLAG(s->flags,SHOW_VU);
+  else DEL_FLAG(s->flags,SHOW_VU);
+
+  if (created || renamed || vu_changed) {
+    /* the panel label can only be set at creation */
+    remove_slider_panels(s);
     if (balance) SET_FLAG(s->flags,BALANCE);
     else DEL_FLAG(s->flags,BALANCE);
     create_slider(s,1);
+  } else if (balance && !GET_FLAG(s->flags,BALANCE)) {
+    SET_FLAG(s->flags,BALANCE);
+    if (volume_has_balance(s)) create_bslider(s,1,FALSE);
+    if (volume_has_fader(s)) create_bslider(s,1,TRUE);
+  } else if (!balance && GET_FLAG(s->flags,BALANCE)) {
+    DEL_FLAG(s->flags,BALANCE);
+    remove_bslider(s);
   }
   return FALSE;
 }
@@ -1140,25 +2116,64 @@ static gboolean add_configed_mixer_device(GtkTreeModel *m, GtkTreePath *path,
 static gboolean add_configed_mixer(GtkTreeModel *m,GtkTreePath *path,
                              GtkTreeIter *iter,gpointer data) {
   GtkListStore *store;
-  gchar *id;
+  ApplyState *state = (ApplyState *) data;
+
+  gtk_tree_model_get(m,iter,ID_COLUMN,&state->id,C_MODEL_COLUMN,&store,-1);
+  state->mixer = NULL;
+  gtk_tree_model_foreach(GTK_TREE_MODEL(store),add_configed_mixer_device,state);
 
-  gtk_tree_model_get(m,iter,ID_COLUMN,&id,C_MODEL_COLUMN,&store,-1);
-  gtk_tree_model_foreach(GTK_TREE_MODEL(store),add_configed_mixer_device,id);
+  if (state->mixer != NULL) {
+    /* sliders that weren't configured anymore */
+    while (*state->spos != NULL) remove_slider(state->spos);
+    state->mpos = &state->mixer->next;
+  }
+  g_free(state->id);
 
   return FALSE;
 }
 
+/* puts the panels in the same order as Mixerz */
+static void reorder_panels(void) {
+  Mixer *m;
+  Slider *s;
+  gint position = 0;
+
+  for (m = Mixerz ; m != NULL; m = m->next)
+    for (s = m->Sliderz; s != NULL ; s = s->next) {
+      if (s->panel != NULL)
+        gtk_box_reorder_child(GTK_BOX(pluginbox),s->panel->hbox,position++);
+      if (s->bal != NULL)
+        gtk_box_reorder_child(GTK_BOX(pluginbox),s->bal->panel->hbox,
+                              position++);
+      if (s->fad != NULL)
+        gtk_box_reorder_child(GTK_BOX(pluginbox),s->fad->panel->hbox,
+                              position++);
+    }
+}
+
 void apply_volume_plugin_config(void) {
+  ApplyState state;
+
   if (mixer_config_changed) {
-    remove_all_mixers();
-    gtk_tree_model_foreach(GTK_TREE_MODEL(model),add_configed_mixer,NULL);
+    state.mpos = &Mixerz;
+    gtk_tree_model_foreach(GTK_TREE_MODEL(model),add_configed_mixer,&state);
+    /* mixers that weren't configured anymore */
+    while (*state.mpos != NULL) remove_mixer(*state.mpos);
+    reorder_panels();
     mixer_config_changed = FALSE;
+    export_dirty = TRUE;
   }
   global_flags = config_global_flags;
   if (right_click_entry) {
     g_strlcpy(right_click_cmd, gtk_entry_get_text((GtkEntry *)right_click_entry),
             sizeof(right_click_cmd));
   }
+  if (poll_ceiling_spin)
+    poll_ceiling = gtk_spin_button_get_value_as_int(
+                     GTK_SPIN_BUTTON(poll_ceiling_spin));
+  if (scene_ramp_spin)
+    scene_ramp = gtk_spin_button_get_value_as_int(
+                   GTK_SPIN_BUTTON(scene_ramp_spin));
 }
 
 /* end of configuration code */
@@ -1190,6 +2205,7 @@ static GkrellmMonitor plugin_mon  = {
     GkrellmMonitor * gkrellm_init_plugin(void)
 #endif
 {
+  gint64 start = trace_start();
   #if defined(WIN32)
     callbacks = calls;
   #endif
@@ -1200,7 +2216,17 @@ static GkrellmMonitor plugin_mon  = {
 
   style_id = gkrellm_add_meter_style(&plugin_mon,"volume");
   init_mixer();
+#ifdef REMOTE
+  if (gkrellm_client_mode()) remote_mixer_connect(&plugin_mon);
+#endif
+#ifdef SHM_EXPORT
+  shm_export_open();
+#endif
+#ifdef CONTROL_SOCKET
+  control_open(&control_ops);
+#endif
   Mixerz = NULL;
   monitor = &plugin_mon;
+  trace_end("gkrellm_init_plugin",NULL,start);
   return monitor;
 }
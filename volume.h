@@ -18,6 +18,9 @@
 */
 
 #include "mixer.h"
+#ifdef VU_METER
+  #include "vu_meter.h"
+#endif
 
 #define VOLUME_MAJOR_VERSION 3
 #define VOLUME_MINOR_VERSION 0
@@ -37,7 +40,9 @@ enum {
  IS_PRESSED =0,
  SAVE_VOLUME,
  BALANCE,
- MUTED
+ MUTED,
+ OFFLINE,
+ SHOW_VU
 };
 
 /* global flags */
@@ -52,27 +57,37 @@ enum {
 
 typedef struct Slider Slider;
 typedef struct Mixer Mixer;
+typedef struct Scene Scene;
 
 typedef struct{
   GkrellmKrell *krell;
   GkrellmPanel *panel;
   GkrellmDecal *decal;
   int flags;
+  /* the front/rear fader instead of the balance */
+  int fader;
   Slider *slider;
 } Bslider;
 
 struct  Slider {
   GkrellmKrell *krell;
   GkrellmPanel *panel;
-  GkrellmDecalbutton *button;
   mixer_t *mixer;
   Mixer *parent;
   int dev;
+  const mixer_device_t *desc;
   int flags;
-  int pleft,pright;
+  /* the volume we last set or saw, restored when unmuted */
+  int saved[MIXER_MAX_CHANNELS];
   int balance; /* [-100..100] */
+  int fader; /* [-100..100], front to rear */
   Slider *next;
-  Bslider *bal;
+  Bslider *bal, *fad;
+#ifdef VU_METER
+  /* level of the capture pcm, only on capture sliders with SHOW_VU */
+  vu_meter_t *vu;
+  GkrellmKrell *vu_krell;
+#endif
 };
 
 
@@ -82,4 +97,32 @@ struct Mixer {
   mixer_t *mixer;
   Slider *Sliderz;
   Mixer *next;
+  /* mixers that don't report changes are read every poll_interval ticks */
+  int poll_interval, poll_countdown;
+  /* a slider changed or was touched since the last read */
+  int poll_changed;
+  /* slider changes seen in the current and the last minute */
+  int poll_ticks, poll_changes;
+  int change_rate;
+};
+
+/* one slider in a scene, what it had when the scene was saved */
+typedef struct {
+  char *id;
+  int dev;
+  /* while muted the volume that gets restored */
+  int volumes[MIXER_MAX_CHANNELS];
+  int balance, fader;
+  int muted;
+  /* where a ramp into the scene started */
+  int from[MIXER_MAX_CHANNELS];
+  /* still moved by that ramp, the user hasn't taken over */
+  int ramping;
+} SceneDev;
+
+/* named volume profile over all sliders */
+struct Scene {
+  char *name;
+  GArray *devs; /* of SceneDev */
+  Scene *next;
 };
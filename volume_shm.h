@@ -0,0 +1,125 @@
+/* GKrellM Volume plugin, shared memory export
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ */
+
+/* The plugin publishes the state of its sliders in a POSIX shared memory
+ * object named "/gkrellm-volume-<uid>". This header is all another process
+ * needs to read it: map it once with volume_shm_map(), afterwards
+ * volume_shm_read() takes a consistent copy without any system call.
+ *
+ * The region is guarded by a sequence counter that is odd while the plugin
+ * is writing. Readers copy the data and retry if the counter was odd or
+ * changed in between. The plugin only writes when a slider changed. */
+
+#ifndef VOLUME_SHM_H
+#define VOLUME_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define VOLUME_SHM_NAME_FMT "/gkrellm-volume-%u"
+#define VOLUME_SHM_MAGIC 0x4d534b47u /* "GKSM" */
+/* bumped on every incompatible change of the layout */
+#define VOLUME_SHM_VERSION 1
+#define VOLUME_SHM_MAX_SLIDERS 64
+#define VOLUME_SHM_NAME_LEN 64
+/* reads of the counter before volume_shm_read gives up on a writer that
+ * stays in the middle of an update, several milliseconds. Far longer than
+ * any update takes, even one the scheduler interrupts */
+#define VOLUME_SHM_RETRIES 10000000
+
+/* slider flags */
+#define VOLUME_SHM_MUTED   (1u << 0)
+#define VOLUME_SHM_BALANCE (1u << 1)
+
+typedef struct {
+  /* id of the mixer, as in the plugin config */
+  char mixer[VOLUME_SHM_NAME_LEN];
+  /* name of the slider shown in the panel */
+  char name[VOLUME_SHM_NAME_LEN];
+  /* 0 <= left, right <= fullscale. While muted these are the volumes that
+   * will be restored */
+  int32_t left, right, fullscale;
+  uint32_t flags;
+} volume_shm_slider_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /* pid of the writer, the region stays behind if it crashes */
+  int32_t pid;
+  uint32_t seq;
+  uint32_t nr_sliders;
+  volume_shm_slider_t sliders[VOLUME_SHM_MAX_SLIDERS];
+} volume_shm_t;
+
+/* copies the current state to *copy. Returns 0 on success, -1 if the
+ * region isn't (or no longer) a compatible export, or if no consistent copy
+ * could be taken within VOLUME_SHM_RETRIES. The latter happens when the
+ * plugin died in the middle of an update, the region then stays behind
+ * with an odd counter until the plugin runs again. Callers can tell that
+ * case from a busy writer with kill(shm->pid, 0) and read again later */
+static inline int
+volume_shm_read(const volume_shm_t *shm, volume_shm_t *copy) {
+  uint32_t seq;
+  int retries;
+
+  if (shm->magic != VOLUME_SHM_MAGIC || shm->version != VOLUME_SHM_VERSION)
+    return -1;
+  for (retries = 0; ; retries++) {
+    if (retries == VOLUME_SHM_RETRIES)
+      return -1;
+    seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+    memcpy(copy, shm, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+      break;
+  }
+  if (copy->nr_sliders > VOLUME_SHM_MAX_SLIDERS)
+    copy->nr_sliders = VOLUME_SHM_MAX_SLIDERS;
+  return 0;
+}
+
+/* the sequence counter alone, to cheaply find out whether anything changed
+ * since the last read */
+static inline uint32_t
+volume_shm_seq(const volume_shm_t *shm) {
+  return __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+}
+
+#ifndef VOLUME_SHM_NO_MAP
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* maps the export of the current user read-only, NULL if the plugin isn't
+ * running. Unmap with munmap(shm, sizeof(volume_shm_t)) */
+static inline const volume_shm_t *
+volume_shm_map(void) {
+  char name[64];
+  struct stat st;
+  void *p;
+  int fd;
+
+  snprintf(name, sizeof(name), VOLUME_SHM_NAME_FMT, (unsigned) getuid());
+  if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+    return NULL;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(volume_shm_t)) {
+    close(fd);
+    return NULL;
+  }
+  p = mmap(NULL, sizeof(volume_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? NULL : (const volume_shm_t *) p;
+}
+#endif
+
+#endif /* VOLUME_SHM_H */
@@ -0,0 +1,233 @@
+/* GKrellM Volume plugin
+ |
+ |  This program is free software which I release under the GNU General Public
+ |  License. You may redistribute and/or modify this program under the terms
+ |  of that license as published by the Free Software Foundation; either
+ |  version 2 of the License, or (at your option) any later version.
+ |
+ |  This program is distributed in the hope that it will be useful,
+ |  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ |  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ |  GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <poll.h>
+#include <alsa/asoundlib.h>
+
+#include "vu_meter.h"
+
+struct vu_meter {
+  snd_pcm_t *pcm;
+  GThread *thread;
+  unsigned int channels;
+  snd_pcm_uframes_t period;
+  /* the pcm descriptors and the read end of wakeup last */
+  struct pollfd *fds;
+  int nfds;
+  int wakeup[2];
+  volatile gint stop;
+  /* highest peak since the last read, rms of the last period */
+  volatile guint peak;
+  volatile gint rms;
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("tree-vectorize")))
+#endif
+void
+vu_measure(const gint16 *samples, int n, int *peak, gint64 *energy) {
+  int i, v, max = 0;
+  gint64 sum = 0;
+
+  /* no branches and fixed types, so this runs 8 or 16 samples at a time */
+  for (i = 0; i < n; i++) {
+    v = samples[i];
+    max = MAX(max, ABS(v));
+    sum += v * v;
+  }
+  *peak = max;
+  *energy = sum;
+}
+
+/* amplitude of a sample (0..32768) in [0..VU_FULLSCALE] over VU_RANGE_DB */
+static int
+vu_level(double amplitude) {
+  double db;
+
+  if (amplitude < 1)
+    return 0;
+  db = 20 * log10(amplitude / 32768.0);
+  return CLAMP((int) ((db + VU_RANGE_DB) * VU_FULLSCALE / VU_RANGE_DB), 0,
+               VU_FULLSCALE);
+}
+
+static void
+vu_publish(vu_meter_t *vu, int peak, gint64 energy, snd_pcm_uframes_t frames) {
+  guint level = vu_level(peak), old;
+
+  /* the reader takes the peak and resets it, a period never lowers it */
+  do {
+    old = g_atomic_int_get(&vu->peak);
+  } while (level > old &&
+           !g_atomic_int_compare_and_exchange(&vu->peak, old, level));
+  g_atomic_int_set(&vu->rms,
+                   vu_level(sqrt((double) energy / (frames * vu->channels))));
+}
+
+/* after an overrun or suspend, returns < 0 if the pcm is gone */
+static int
+vu_recover(vu_meter_t *vu, int err) {
+  if ((err = snd_pcm_recover(vu->pcm, err, 1)) < 0) {
+    fprintf(stderr, "volume: vu meter stopped: %s\n", snd_strerror(err));
+    return err;
+  }
+  return snd_pcm_start(vu->pcm);
+}
+
+/* waits for a period or vu_meter_close, returns FALSE when told to stop */
+static gboolean
+vu_wait(vu_meter_t *vu) {
+  unsigned short revents;
+
+  if (poll(vu->fds, vu->nfds, -1) < 0)
+    return TRUE;
+  if (vu->fds[vu->nfds - 1].revents)
+    return FALSE;
+  snd_pcm_poll_descriptors_revents(vu->pcm, vu->fds, vu->nfds - 1, &revents);
+  return TRUE;
+}
+
+static gpointer
+vu_thread(gpointer data) {
+  vu_meter_t *vu = (vu_meter_t *) data;
+  const snd_pcm_channel_area_t *areas;
+  const gint16 *samples;
+  snd_pcm_uframes_t offset, frames, done = 0;
+  snd_pcm_sframes_t avail, committed;
+  gint64 energy = 0, e;
+  int peak = 0, p;
+
+  while (!g_atomic_int_get(&vu->stop)) {
+    if ((avail = snd_pcm_avail_update(vu->pcm)) < 0) {
+      if (vu_recover(vu, avail) < 0)
+        break;
+      continue;
+    }
+    if ((snd_pcm_uframes_t) avail < vu->period - done) {
+      if (!vu_wait(vu))
+        break;
+      continue;
+    }
+    /* the mapped part ends at the end of the ring buffer, the rest of the
+     * period comes with the next round */
+    frames = vu->period - done;
+    if ((p = snd_pcm_mmap_begin(vu->pcm, &areas, &offset, &frames)) < 0) {
+      if (vu_recover(vu, p) < 0)
+        break;
+      continue;
+    }
+    /* interleaved, the first area has every channel */
+    samples = (const gint16 *) ((const char *) areas[0].addr +
+              areas[0].first / 8 + offset * areas[0].step / 8);
+    vu_measure(samples, frames * vu->channels, &p, &e);
+    committed = snd_pcm_mmap_commit(vu->pcm, offset, frames);
+    if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+      if (vu_recover(vu, committed < 0 ? committed : -EPIPE) < 0)
+        break;
+      peak = energy = done = 0;
+      continue;
+    }
+    peak = MAX(peak, p);
+    energy += e;
+    if ((done += frames) >= vu->period) {
+      vu_publish(vu, peak, energy, done);
+      peak = energy = done = 0;
+    }
+  }
+  return NULL;
+}
+
+static void
+vu_meter_free(vu_meter_t *vu) {
+  if (vu->wakeup[0] >= 0) {
+    close(vu->wakeup[0]);
+    close(vu->wakeup[1]);
+  }
+  g_free(vu->fds);
+  snd_pcm_close(vu->pcm);
+  g_free(vu);
+}
+
+vu_meter_t *
+vu_meter_open(const char *name) {
+  snd_pcm_hw_params_t *hw;
+  vu_meter_t *vu;
+  snd_pcm_t *pcm;
+  unsigned int rate = VU_RATE, period_time = VU_PERIOD_US;
+  unsigned int buffer_time = 4 * VU_PERIOD_US;
+  int err, dir = 0;
+
+  if ((err = snd_pcm_open(&pcm, name, SND_PCM_STREAM_CAPTURE,
+                          SND_PCM_NONBLOCK)) < 0) {
+    fprintf(stderr, "volume: can't open %s for the vu meter: %s\n", name,
+            snd_strerror(err));
+    return NULL;
+  }
+  vu = g_new0(vu_meter_t, 1);
+  vu->pcm = pcm;
+  vu->channels = 2;
+  vu->wakeup[0] = vu->wakeup[1] = -1;
+
+  snd_pcm_hw_params_alloca(&hw);
+  if ((err = snd_pcm_hw_params_any(pcm, hw)) < 0 ||
+      (err = snd_pcm_hw_params_set_access(pcm, hw,
+                SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0 ||
+      (err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16)) < 0 ||
+      (err = snd_pcm_hw_params_set_rate_resample(pcm, hw, 0)) < 0 ||
+      (err = snd_pcm_hw_params_set_channels_near(pcm, hw,
+                                                 &vu->channels)) < 0 ||
+      (err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, &dir)) < 0 ||
+      (err = snd_pcm_hw_params_set_period_time_near(pcm, hw, &period_time,
+                                                    &dir)) < 0 ||
+      (err = snd_pcm_hw_params_set_buffer_time_near(pcm, hw, &buffer_time,
+                                                    &dir)) < 0 ||
+      (err = snd_pcm_hw_params(pcm, hw)) < 0 ||
+      (err = snd_pcm_hw_params_get_period_size(hw, &vu->period, &dir)) < 0) {
+    fprintf(stderr, "volume: can't set up %s for the vu meter: %s\n", name,
+            snd_strerror(err));
+    vu_meter_free(vu);
+    return NULL;
+  }
+
+  vu->nfds = snd_pcm_poll_descriptors_count(pcm) + 1;
+  vu->fds = g_new0(struct pollfd, vu->nfds);
+  snd_pcm_poll_descriptors(pcm, vu->fds, vu->nfds - 1);
+  if (pipe(vu->wakeup) < 0 || (err = snd_pcm_start(pcm)) < 0) {
+    fprintf(stderr, "volume: can't start the vu meter on %s\n", name);
+    vu_meter_free(vu);
+    return NULL;
+  }
+  vu->fds[vu->nfds - 1].fd = vu->wakeup[0];
+  vu->fds[vu->nfds - 1].events = POLLIN;
+  vu->thread = g_thread_new("volume-vu", vu_thread, vu);
+  return vu;
+}
+
+void
+vu_meter_close(vu_meter_t *vu) {
+  g_atomic_int_set(&vu->stop, 1);
+  if (write(vu->wakeup[1], "", 1) < 0)
+    fprintf(stderr, "volume: can't stop the vu meter\n");
+  g_thread_join(vu->thread);
+  vu_meter_free(vu);
+}
+
+void
+vu_meter_read(vu_meter_t *vu, int *peak, int *rms) {
+  *peak = (int) g_atomic_int_and(&vu->peak, 0);
+  *rms = g_atomic_int_get(&vu->rms);
+}
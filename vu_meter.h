@@ -0,0 +1,31 @@
+#ifndef VOLUME_VU_METER_H
+#define VOLUME_VU_METER_H
+
+#include <glib.h>
+
+/* Level meter of a capture PCM. Each meter has a thread that reads the PCM
+ * in mmap mode a period (VU_PERIOD_US) at a time and measures it in place,
+ * nothing gets copied or allocated after vu_meter_open. At 16 kHz and 20
+ * periods a second that is well below 0.1% of a CPU. */
+
+/* levels go from 0 (VU_RANGE_DB below full scale or less) to VU_FULLSCALE */
+#define VU_FULLSCALE 100
+#define VU_RANGE_DB 60
+#define VU_PERIOD_US 50000
+/* the hardware rate closest to this is used as is, never resampled */
+#define VU_RATE 16000
+
+typedef struct vu_meter vu_meter_t;
+
+/* starts metering an ALSA capture PCM, NULL if it can't be opened */
+vu_meter_t *vu_meter_open(const char *pcm);
+void vu_meter_close(vu_meter_t *vu);
+
+/* the highest peak since the last read and the rms of the last period.
+ * Never blocks, callable from any one thread */
+void vu_meter_read(vu_meter_t *vu, int *peak, int *rms);
+
+/* the loudest sample and the sum of the squares of n samples */
+void vu_measure(const gint16 *samples, int n, int *peak, gint64 *energy);
+
+#endif /* VOLUME_VU_METER_H */
@@ -102,7 +102,7 @@ win32_mixer_open(char *id) {
                 fixName(mxl.szShortName);
 
                 if (strcmp(mxl.szShortName, id) == 0) {
-                    result = malloc(sizeof(mixer_t));
+                    result = calloc(1, sizeof(mixer_t));
                     win32result = malloc(sizeof(win32_mixer_t));
                     result->name = g_strdup("Master");
                     result->hMixer = hMixer;
@@ -114,7 +114,7 @@ win32_mixer_open(char *id) {
         else {        
             if(mixerGetLineInfo((HMIXEROBJ)hMixer, &mxl, MIXER_OBJECTF_HMIXER | MIXER_GETLINEINFOF_COMPONENTTYPE) != MMSYSERR_NOERROR)
 	    		return NULL;
-            result = malloc(sizeof(mixer_t));
+            result = calloc(1, sizeof(mixer_t));
             win32result = malloc(sizeof(win32_mixer_t));
             result->name = g_strdup("Master");
             result->hMixer = hMixer;